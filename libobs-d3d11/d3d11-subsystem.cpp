@@ -266,8 +266,10 @@ ID3D11BlendState *gs_device::AddBlendState()
 		bd.RenderTarget[i].BlendEnable    = blendState.blendEnabled;
 		bd.RenderTarget[i].BlendOp        = D3D11_BLEND_OP_ADD;
 		bd.RenderTarget[i].BlendOpAlpha   = D3D11_BLEND_OP_ADD;
-		bd.RenderTarget[i].SrcBlendAlpha  = D3D11_BLEND_ONE;
-		bd.RenderTarget[i].DestBlendAlpha = D3D11_BLEND_ZERO;
+		bd.RenderTarget[i].SrcBlendAlpha  =
+			ConvertGSBlendType(blendState.srcFactorAlpha);
+		bd.RenderTarget[i].DestBlendAlpha =
+			ConvertGSBlendType(blendState.destFactorAlpha);
 		bd.RenderTarget[i].SrcBlend =
 			ConvertGSBlendType(blendState.srcFactor);
 		bd.RenderTarget[i].DestBlend =
@@ -1197,13 +1199,25 @@ void device_enable_color(device_t device, bool red, bool green,
 void device_blendfunction(device_t device, enum gs_blend_type src,
 		enum gs_blend_type dest)
 {
-	if (device->blendState.srcFactor  == src &&
-	    device->blendState.destFactor == dest)
+	device_blendfunction_separate(device, src, dest,
+			GS_BLEND_ONE, GS_BLEND_ZERO);
+}
+
+void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	if (device->blendState.srcFactor       == src_c &&
+	    device->blendState.destFactor      == dest_c &&
+	    device->blendState.srcFactorAlpha  == src_a &&
+	    device->blendState.destFactorAlpha == dest_a)
 		return;
 
-	device->blendState.srcFactor  = src;
-	device->blendState.destFactor = dest;
-	device->blendStateChanged     = true;
+	device->blendState.srcFactor       = src_c;
+	device->blendState.destFactor      = dest_c;
+	device->blendState.srcFactorAlpha  = src_a;
+	device->blendState.destFactorAlpha = dest_a;
+	device->blendStateChanged          = true;
 }
 
 void device_depthfunction(device_t device, enum gs_depth_test test)
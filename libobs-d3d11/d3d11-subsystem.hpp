@@ -461,6 +461,8 @@ struct BlendState {
 	bool          blendEnabled;
 	gs_blend_type srcFactor;
 	gs_blend_type destFactor;
+	gs_blend_type srcFactorAlpha;
+	gs_blend_type destFactorAlpha;
 
 	bool          redEnabled;
 	bool          greenEnabled;
@@ -468,13 +470,15 @@ struct BlendState {
 	bool          alphaEnabled;
 
 	inline BlendState()
-		: blendEnabled (true),
-		  srcFactor    (GS_BLEND_SRCALPHA),
-		  destFactor   (GS_BLEND_INVSRCALPHA),
-		  redEnabled   (true),
-		  greenEnabled (true),
-		  blueEnabled  (true),
-		  alphaEnabled (true)
+		: blendEnabled    (true),
+		  srcFactor       (GS_BLEND_SRCALPHA),
+		  destFactor      (GS_BLEND_INVSRCALPHA),
+		  srcFactorAlpha  (GS_BLEND_ONE),
+		  destFactorAlpha (GS_BLEND_ZERO),
+		  redEnabled      (true),
+		  greenEnabled    (true),
+		  blueEnabled     (true),
+		  alphaEnabled    (true)
 	{
 	}
 
@@ -0,0 +1,110 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "null-subsystem.h"
+
+/* buffers take ownership of the data they are created with, the same as the
+ * other backends, and simply keep it in system memory */
+
+vertbuffer_t device_create_vertexbuffer(device_t device,
+		struct vb_data *data, uint32_t flags)
+{
+	struct gs_vertex_buffer *vb = bmalloc(sizeof(struct gs_vertex_buffer));
+	memset(vb, 0, sizeof(struct gs_vertex_buffer));
+
+	vb->device  = device;
+	vb->data    = data;
+	vb->dynamic = (flags & GS_DYNAMIC) != 0;
+
+	return vb;
+}
+
+void vertexbuffer_destroy(vertbuffer_t vb)
+{
+	if (vb) {
+		vbdata_destroy(vb->data);
+		bfree(vb);
+	}
+}
+
+void vertexbuffer_flush(vertbuffer_t vb, bool rebuild)
+{
+	if (!vb->dynamic)
+		blog(LOG_ERROR, "vertex buffer is not dynamic");
+}
+
+struct vb_data *vertexbuffer_getdata(vertbuffer_t vb)
+{
+	return vb->data;
+}
+
+void device_load_vertexbuffer(device_t device, vertbuffer_t vb)
+{
+	device->cur_vertex_buffer = vb;
+}
+
+/* ------------------------------------------------------------------------- */
+
+indexbuffer_t device_create_indexbuffer(device_t device,
+		enum gs_index_type type, void *indices, size_t num,
+		uint32_t flags)
+{
+	struct gs_index_buffer *ib = bmalloc(sizeof(struct gs_index_buffer));
+	memset(ib, 0, sizeof(struct gs_index_buffer));
+
+	ib->device  = device;
+	ib->type    = type;
+	ib->data    = indices;
+	ib->num     = num;
+	ib->dynamic = (flags & GS_DYNAMIC) != 0;
+
+	return ib;
+}
+
+void indexbuffer_destroy(indexbuffer_t ib)
+{
+	if (ib) {
+		bfree(ib->data);
+		bfree(ib);
+	}
+}
+
+void indexbuffer_flush(indexbuffer_t ib)
+{
+	if (!ib->dynamic)
+		blog(LOG_ERROR, "Index buffer is not dynamic");
+}
+
+void *indexbuffer_getdata(indexbuffer_t ib)
+{
+	return ib->data;
+}
+
+size_t indexbuffer_numindices(indexbuffer_t ib)
+{
+	return ib->num;
+}
+
+enum gs_index_type indexbuffer_gettype(indexbuffer_t ib)
+{
+	return ib->type;
+}
+
+void device_load_indexbuffer(device_t device, indexbuffer_t ib)
+{
+	device->cur_index_buffer = ib;
+}
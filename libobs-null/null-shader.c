@@ -0,0 +1,315 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <assert.h>
+
+#include <graphics/shader-parser.h>
+#include <graphics/vec2.h>
+#include <graphics/vec3.h>
+#include <graphics/vec4.h>
+#include <graphics/matrix3.h>
+#include "null-subsystem.h"
+
+static inline void shader_param_free(struct shader_param *param)
+{
+	bfree(param->name);
+	da_free(param->cur_value);
+	da_free(param->def_value);
+}
+
+static void add_params(struct gs_shader *shader, struct shader_parser *sp)
+{
+	size_t i;
+
+	for (i = 0; i < sp->params.num; i++) {
+		struct shader_var *var = sp->params.array+i;
+		struct shader_param param = {0};
+
+		if (var->var_type != SHADER_VAR_UNIFORM)
+			continue;
+
+		param.array_count = var->array_count;
+		param.name        = bstrdup(var->name);
+		param.shader      = shader;
+		param.type        = get_shader_param_type(var->type);
+
+		da_move(param.def_value, var->default_val);
+		da_copy(param.cur_value, param.def_value);
+
+		da_push_back(shader->params, &param);
+	}
+
+	shader->viewproj = shader_getparambyname(shader, "ViewProj");
+	shader->world    = shader_getparambyname(shader, "World");
+}
+
+static void add_samplers(struct gs_shader *shader, struct shader_parser *sp)
+{
+	size_t i;
+
+	for (i = 0; i < sp->samplers.num; i++) {
+		struct gs_sampler_info info;
+		samplerstate_t sampler;
+
+		shader_sampler_convert(sp->samplers.array+i, &info);
+		sampler = device_create_samplerstate(shader->device, &info);
+		da_push_back(shader->samplers, &sampler);
+	}
+}
+
+static struct gs_shader *shader_create(device_t device, enum shader_type type,
+		const char *shader_str, const char *file, char **error_string)
+{
+	struct gs_shader *shader = bmalloc(sizeof(struct gs_shader));
+	struct shader_parser sp;
+
+	memset(shader, 0, sizeof(struct gs_shader));
+	shader->device = device;
+	shader->type   = type;
+
+	shader_parser_init(&sp);
+	if (shader_parse(&sp, shader_str, file)) {
+		add_params(shader, &sp);
+		add_samplers(shader, &sp);
+	} else {
+		if (error_string)
+			*error_string = shader_parser_geterrors(&sp);
+
+		shader_destroy(shader);
+		shader = NULL;
+	}
+
+	shader_parser_free(&sp);
+	return shader;
+}
+
+shader_t device_create_vertexshader(device_t device,
+		const char *shader, const char *file,
+		char **error_string)
+{
+	struct gs_shader *ptr;
+	ptr = shader_create(device, SHADER_VERTEX, shader, file, error_string);
+	if (!ptr)
+		blog(LOG_ERROR, "device_create_vertexshader (null) failed");
+	return ptr;
+}
+
+shader_t device_create_pixelshader(device_t device,
+		const char *shader, const char *file,
+		char **error_string)
+{
+	struct gs_shader *ptr;
+	ptr = shader_create(device, SHADER_PIXEL, shader, file, error_string);
+	if (!ptr)
+		blog(LOG_ERROR, "device_create_pixelshader (null) failed");
+	return ptr;
+}
+
+void shader_destroy(shader_t shader)
+{
+	size_t i;
+
+	if (!shader)
+		return;
+
+	for (i = 0; i < shader->samplers.num; i++)
+		samplerstate_destroy(shader->samplers.array[i]);
+
+	for (i = 0; i < shader->params.num; i++)
+		shader_param_free(shader->params.array+i);
+
+	da_free(shader->samplers);
+	da_free(shader->params);
+	bfree(shader);
+}
+
+int shader_numparams(shader_t shader)
+{
+	return (int)shader->params.num;
+}
+
+sparam_t shader_getparambyidx(shader_t shader, uint32_t param)
+{
+	assert(param < shader->params.num);
+	return shader->params.array+param;
+}
+
+sparam_t shader_getparambyname(shader_t shader, const char *name)
+{
+	size_t i;
+	for (i = 0; i < shader->params.num; i++) {
+		struct shader_param *param = shader->params.array+i;
+
+		if (strcmp(param->name, name) == 0)
+			return param;
+	}
+
+	return NULL;
+}
+
+static inline bool matching_shader(shader_t shader, sparam_t sparam)
+{
+	if (shader != sparam->shader) {
+		blog(LOG_ERROR, "Shader and shader parameter do not match");
+		return false;
+	}
+
+	return true;
+}
+
+void shader_getparaminfo(shader_t shader, sparam_t param,
+		struct shader_param_info *info)
+{
+	if (!matching_shader(shader, param))
+		return;
+
+	info->type = param->type;
+	info->name = param->name;
+}
+
+sparam_t shader_getviewprojmatrix(shader_t shader)
+{
+	return shader->viewproj;
+}
+
+sparam_t shader_getworldmatrix(shader_t shader)
+{
+	return shader->world;
+}
+
+static inline void shader_store(shader_t shader, sparam_t param,
+		const void *val, size_t size)
+{
+	if (matching_shader(shader, param))
+		da_copy_array(param->cur_value, val, size);
+}
+
+void shader_setbool(shader_t shader, sparam_t param, bool val)
+{
+	int int_val = (int)val;
+	shader_store(shader, param, &int_val, sizeof(int));
+}
+
+void shader_setfloat(shader_t shader, sparam_t param, float val)
+{
+	shader_store(shader, param, &val, sizeof(float));
+}
+
+void shader_setint(shader_t shader, sparam_t param, int val)
+{
+	shader_store(shader, param, &val, sizeof(int));
+}
+
+void shader_setmatrix3(shader_t shader, sparam_t param,
+		const struct matrix3 *val)
+{
+	struct matrix4 mat;
+	matrix4_from_matrix3(&mat, val);
+	shader_store(shader, param, &mat, sizeof(struct matrix4));
+}
+
+void shader_setmatrix4(shader_t shader, sparam_t param,
+		const struct matrix4 *val)
+{
+	shader_store(shader, param, val, sizeof(struct matrix4));
+}
+
+void shader_setvec2(shader_t shader, sparam_t param,
+		const struct vec2 *val)
+{
+	shader_store(shader, param, val, sizeof(float)*2);
+}
+
+void shader_setvec3(shader_t shader, sparam_t param,
+		const struct vec3 *val)
+{
+	shader_store(shader, param, val, sizeof(float)*3);
+}
+
+void shader_setvec4(shader_t shader, sparam_t param,
+		const struct vec4 *val)
+{
+	shader_store(shader, param, val, sizeof(struct vec4));
+}
+
+void shader_settexture(shader_t shader, sparam_t param, texture_t val)
+{
+	if (matching_shader(shader, param))
+		param->texture = val;
+}
+
+void shader_setval(shader_t shader, sparam_t param, const void *val,
+		size_t size)
+{
+	int count = param->array_count;
+	size_t expected_size = 0;
+	if (!count)
+		count = 1;
+
+	if (!matching_shader(shader, param))
+		return;
+
+	switch ((uint32_t)param->type) {
+	case SHADER_PARAM_FLOAT:     expected_size = sizeof(float); break;
+	case SHADER_PARAM_BOOL:
+	case SHADER_PARAM_INT:       expected_size = sizeof(int); break;
+	case SHADER_PARAM_VEC2:      expected_size = sizeof(float)*2; break;
+	case SHADER_PARAM_VEC3:      expected_size = sizeof(float)*3; break;
+	case SHADER_PARAM_VEC4:      expected_size = sizeof(float)*4; break;
+	case SHADER_PARAM_MATRIX4X4: expected_size = sizeof(float)*4*4; break;
+	case SHADER_PARAM_TEXTURE:   expected_size = sizeof(void*); break;
+	default:                     expected_size = 0;
+	}
+
+	expected_size *= count;
+	if (!expected_size)
+		return;
+
+	if (expected_size != size) {
+		blog(LOG_ERROR, "shader_setval (null): Size of shader param "
+		                "does not match the size of the input");
+		return;
+	}
+
+	if (param->type == SHADER_PARAM_TEXTURE)
+		shader_settexture(shader, param, *(texture_t*)val);
+	else
+		shader_store(shader, param, val, size);
+}
+
+void shader_setdefault(shader_t shader, sparam_t param)
+{
+	shader_setval(shader, param, param->def_value.array,
+			param->def_value.num);
+}
+
+struct gs_texture *shader_get_texture(struct gs_shader *shader)
+{
+	size_t i;
+
+	if (!shader)
+		return NULL;
+
+	for (i = 0; i < shader->params.num; i++) {
+		struct shader_param *param = shader->params.array+i;
+
+		if (param->type == SHADER_PARAM_TEXTURE && param->texture)
+			return param->texture;
+	}
+
+	return NULL;
+}
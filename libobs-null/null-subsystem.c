@@ -0,0 +1,562 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <graphics/matrix3.h>
+#include <graphics/vec4.h>
+#include "null-subsystem.h"
+
+device_t device_create(struct gs_init_data *info)
+{
+	struct gs_device *device = bmalloc(sizeof(struct gs_device));
+	memset(device, 0, sizeof(struct gs_device));
+
+	device->default_swap.device = device;
+	device->default_swap.info   = *info;
+	device->cur_swap            = &device->default_swap;
+
+	blog(LOG_INFO, "Using null graphics subsystem, nothing will be "
+	               "rasterized");
+	return device;
+}
+
+void device_destroy(device_t device)
+{
+	if (device) {
+		da_free(device->proj_stack);
+		bfree(device);
+	}
+}
+
+void device_entercontext(device_t device)
+{
+}
+
+void device_leavecontext(device_t device)
+{
+}
+
+swapchain_t device_create_swapchain(device_t device, struct gs_init_data *info)
+{
+	struct gs_swap_chain *swap = bmalloc(sizeof(struct gs_swap_chain));
+	memset(swap, 0, sizeof(struct gs_swap_chain));
+
+	swap->device = device;
+	swap->info   = *info;
+	return swap;
+}
+
+void device_resize(device_t device, uint32_t cx, uint32_t cy)
+{
+	device->cur_swap->info.cx = cx;
+	device->cur_swap->info.cy = cy;
+}
+
+void device_getsize(device_t device, uint32_t *cx, uint32_t *cy)
+{
+	*cx = device->cur_swap->info.cx;
+	*cy = device->cur_swap->info.cy;
+}
+
+uint32_t device_getwidth(device_t device)
+{
+	return device->cur_swap->info.cx;
+}
+
+uint32_t device_getheight(device_t device)
+{
+	return device->cur_swap->info.cy;
+}
+
+zstencil_t device_create_zstencil(device_t device, uint32_t width,
+		uint32_t height, enum gs_zstencil_format format)
+{
+	struct gs_zstencil_buffer *zs;
+
+	zs = bmalloc(sizeof(struct gs_zstencil_buffer));
+	zs->format = format;
+	zs->width  = width;
+	zs->height = height;
+	return zs;
+}
+
+samplerstate_t device_create_samplerstate(device_t device,
+		struct gs_sampler_info *info)
+{
+	struct gs_sampler_state *sampler;
+
+	sampler = bmalloc(sizeof(struct gs_sampler_state));
+	sampler->info = *info;
+	return sampler;
+}
+
+void device_load_texture(device_t device, texture_t tex, int unit)
+{
+	if (unit < 0 || unit >= GS_MAX_TEXTURES)
+		return;
+
+	device->cur_textures[unit] = tex;
+}
+
+void device_load_samplerstate(device_t device, samplerstate_t ss, int unit)
+{
+	if (unit < 0 || unit >= GS_MAX_TEXTURES)
+		return;
+
+	device->cur_samplers[unit] = ss;
+}
+
+void device_load_vertexshader(device_t device, shader_t vertshader)
+{
+	if (vertshader && vertshader->type != SHADER_VERTEX) {
+		blog(LOG_ERROR, "Specified shader is not a vertex shader");
+		blog(LOG_ERROR, "device_load_vertexshader (null) failed");
+		return;
+	}
+
+	device->cur_vertex_shader = vertshader;
+}
+
+void device_load_pixelshader(device_t device, shader_t pixelshader)
+{
+	size_t i;
+
+	if (pixelshader && pixelshader->type != SHADER_PIXEL) {
+		blog(LOG_ERROR, "Specified shader is not a pixel shader");
+		blog(LOG_ERROR, "device_load_pixelshader (null) failed");
+		return;
+	}
+
+	device->cur_pixel_shader = pixelshader;
+
+	for (i = 0; i < GS_MAX_TEXTURES; i++) {
+		samplerstate_t ss = NULL;
+		if (pixelshader && i < pixelshader->samplers.num)
+			ss = pixelshader->samplers.array[i];
+		device->cur_samplers[i] = ss;
+	}
+}
+
+void device_load_defaultsamplerstate(device_t device, bool b_3d, int unit)
+{
+	/* TODO */
+}
+
+shader_t device_getvertexshader(device_t device)
+{
+	return device->cur_vertex_shader;
+}
+
+shader_t device_getpixelshader(device_t device)
+{
+	return device->cur_pixel_shader;
+}
+
+texture_t device_getrendertarget(device_t device)
+{
+	return device->cur_render_target;
+}
+
+zstencil_t device_getzstenciltarget(device_t device)
+{
+	return device->cur_zstencil_buffer;
+}
+
+void device_setrendertarget(device_t device, texture_t tex, zstencil_t zstencil)
+{
+	if (tex) {
+		if (tex->type != GS_TEXTURE_2D) {
+			blog(LOG_ERROR, "Texture is not a 2D texture");
+			goto fail;
+		}
+
+		if (!tex->is_render_target) {
+			blog(LOG_ERROR, "Texture is not a render target");
+			goto fail;
+		}
+	}
+
+	device->cur_render_target   = tex;
+	device->cur_render_side     = 0;
+	device->cur_zstencil_buffer = zstencil;
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_setrendertarget (null) failed");
+}
+
+void device_setcuberendertarget(device_t device, texture_t cubetex,
+		int side, zstencil_t zstencil)
+{
+	if (cubetex) {
+		if (cubetex->type != GS_TEXTURE_CUBE) {
+			blog(LOG_ERROR, "Texture is not a cube texture");
+			goto fail;
+		}
+
+		if (!cubetex->is_render_target) {
+			blog(LOG_ERROR, "Texture is not a render target");
+			goto fail;
+		}
+	}
+
+	device->cur_render_target   = cubetex;
+	device->cur_render_side     = side;
+	device->cur_zstencil_buffer = zstencil;
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_setcuberendertarget (null) failed");
+}
+
+void device_beginscene(device_t device)
+{
+	/* does nothing */
+}
+
+static void update_viewproj_matrix(struct gs_device *device)
+{
+	struct gs_shader *vs = device->cur_vertex_shader;
+	struct matrix3 cur_matrix;
+	gs_matrix_get(&cur_matrix);
+
+	matrix4_from_matrix3(&device->cur_view, &cur_matrix);
+	matrix4_mul(&device->cur_viewproj, &device->cur_view,
+			&device->cur_proj);
+	matrix4_transpose(&device->cur_viewproj, &device->cur_viewproj);
+
+	if (vs && vs->viewproj)
+		shader_setmatrix4(vs, vs->viewproj, &device->cur_viewproj);
+}
+
+static inline bool is_32bit_format(enum gs_color_format format)
+{
+	return format == GS_RGBA || format == GS_BGRA || format == GS_BGRX;
+}
+
+static inline uint32_t swap_red_blue(uint32_t pixel)
+{
+	return (pixel & 0xFF00FF00) |
+	       ((pixel & 0x00FF0000) >> 16) |
+	       ((pixel & 0x000000FF) << 16);
+}
+
+/* point-sampled copy of the source texture into the current viewport of the
+ * render target.  this stands in for rasterization so that the output of
+ * the render pipeline still reflects its inputs. */
+static void blit_to_target(struct gs_device *device, struct gs_texture *src)
+{
+	struct gs_texture *dst = device->cur_render_target;
+	struct gs_rect    *vp  = &device->cur_viewport;
+	uint8_t *dst_data;
+	bool     swap_rb;
+	int      x, y, x_start, y_start, x_end, y_end;
+
+	if (!is_32bit_format(src->format) || !is_32bit_format(dst->format))
+		return;
+	if (vp->cx <= 0 || vp->cy <= 0)
+		return;
+
+	swap_rb  = (src->format == GS_RGBA) != (dst->format == GS_RGBA);
+	dst_data = texture_slice(dst, (uint32_t)device->cur_render_side);
+
+	x_start = vp->x < 0 ? 0 : vp->x;
+	y_start = vp->y < 0 ? 0 : vp->y;
+	x_end   = vp->x + vp->cx;
+	y_end   = vp->y + vp->cy;
+	if (x_end > (int)dst->width)  x_end = (int)dst->width;
+	if (y_end > (int)dst->height) y_end = (int)dst->height;
+
+	for (y = y_start; y < y_end; y++) {
+		uint32_t src_y = (uint32_t)((uint64_t)(y - vp->y) *
+				src->height / (uint32_t)vp->cy);
+		const uint32_t *src_row = (const uint32_t*)(src->data +
+				(size_t)src_y * src->row_bytes);
+		uint32_t *dst_row = (uint32_t*)(dst_data +
+				(size_t)y * dst->row_bytes);
+
+		for (x = x_start; x < x_end; x++) {
+			uint32_t src_x = (uint32_t)((uint64_t)(x - vp->x) *
+					src->width / (uint32_t)vp->cx);
+			uint32_t pixel = src_row[src_x];
+
+			dst_row[x] = swap_rb ? swap_red_blue(pixel) : pixel;
+		}
+	}
+}
+
+void device_draw(device_t device, enum gs_draw_mode draw_mode,
+		uint32_t start_vert, uint32_t num_verts)
+{
+	struct gs_texture *src;
+	effect_t effect = gs_geteffect();
+
+	if (!device->cur_vertex_shader || !device->cur_pixel_shader) {
+		blog(LOG_ERROR, "No shader loaded");
+		goto fail;
+	}
+
+	if (effect)
+		effect_updateparams(effect);
+
+	update_viewproj_matrix(device);
+
+	if (!device->cur_render_target)
+		return;
+
+	src = shader_get_texture(device->cur_pixel_shader);
+	if (!src)
+		src = device->cur_textures[0];
+
+	if (src && src != device->cur_render_target &&
+	    src->type == GS_TEXTURE_2D)
+		blit_to_target(device, src);
+
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_draw (null) failed");
+}
+
+void device_endscene(device_t device)
+{
+	/* does nothing */
+}
+
+void device_load_swapchain(device_t device, swapchain_t swapchain)
+{
+	device->cur_swap = swapchain ? swapchain : &device->default_swap;
+}
+
+void device_clear(device_t device, uint32_t clear_flags,
+		struct vec4 *color, float depth, uint8_t stencil)
+{
+	struct gs_texture *tex = device->cur_render_target;
+	uint8_t *data;
+	uint32_t pixel, x, y;
+
+	if (!(clear_flags & GS_CLEAR_COLOR) || !tex)
+		return;
+	if (!is_32bit_format(tex->format))
+		return;
+
+	pixel = tex->format == GS_RGBA ?
+		vec4_to_rgba(color) : vec4_to_bgra(color);
+	data  = texture_slice(tex, (uint32_t)device->cur_render_side);
+
+	for (y = 0; y < tex->height; y++) {
+		uint32_t *row = (uint32_t*)(data + (size_t)y * tex->row_bytes);
+		for (x = 0; x < tex->width; x++)
+			row[x] = pixel;
+	}
+}
+
+void device_present(device_t device)
+{
+	/* nothing to present */
+}
+
+void device_setcullmode(device_t device, enum gs_cull_mode mode)
+{
+	device->cur_cull_mode = mode;
+}
+
+enum gs_cull_mode device_getcullmode(device_t device)
+{
+	return device->cur_cull_mode;
+}
+
+void device_enable_blending(device_t device, bool enable)
+{
+}
+
+void device_enable_depthtest(device_t device, bool enable)
+{
+}
+
+void device_enable_stenciltest(device_t device, bool enable)
+{
+}
+
+void device_enable_stencilwrite(device_t device, bool enable)
+{
+}
+
+void device_enable_color(device_t device, bool red, bool green,
+		bool blue, bool alpha)
+{
+}
+
+void device_blendfunction(device_t device, enum gs_blend_type src,
+		enum gs_blend_type dest)
+{
+}
+
+void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+}
+
+void device_depthfunction(device_t device, enum gs_depth_test test)
+{
+}
+
+void device_stencilfunction(device_t device, enum gs_stencil_side side,
+		enum gs_depth_test test)
+{
+}
+
+void device_stencilop(device_t device, enum gs_stencil_side side,
+		enum gs_stencil_op fail, enum gs_stencil_op zfail,
+		enum gs_stencil_op zpass)
+{
+}
+
+void device_enable_fullscreen(device_t device, bool enable)
+{
+	device->fullscreen = enable;
+}
+
+int device_fullscreen_enabled(device_t device)
+{
+	return device->fullscreen;
+}
+
+void device_setdisplaymode(device_t device,
+		const struct gs_display_mode *mode)
+{
+	device->display_mode = *mode;
+}
+
+void device_getdisplaymode(device_t device,
+		struct gs_display_mode *mode)
+{
+	*mode = device->display_mode;
+}
+
+void device_setcolorramp(device_t device, float gamma, float brightness,
+		float contrast)
+{
+}
+
+void device_setviewport(device_t device, int x, int y, int width,
+		int height)
+{
+	device->cur_viewport.x  = x;
+	device->cur_viewport.y  = y;
+	device->cur_viewport.cx = width;
+	device->cur_viewport.cy = height;
+}
+
+void device_getviewport(device_t device, struct gs_rect *rect)
+{
+	*rect = device->cur_viewport;
+}
+
+void device_setscissorrect(device_t device, struct gs_rect *rect)
+{
+}
+
+void device_ortho(device_t device, float left, float right,
+		float top, float bottom, float near, float far)
+{
+	struct matrix4 *dst = &device->cur_proj;
+
+	float rml = right-left;
+	float bmt = bottom-top;
+	float fmn = far-near;
+
+	vec4_zero(&dst->x);
+	vec4_zero(&dst->y);
+	vec4_zero(&dst->z);
+	vec4_zero(&dst->t);
+
+	dst->x.x =         2.0f /  rml;
+	dst->t.x = (left+right) / -rml;
+
+	dst->y.y =         2.0f / -bmt;
+	dst->t.y = (bottom+top) /  bmt;
+
+	dst->z.z =        -2.0f /  fmn;
+	dst->t.z =   (far+near) / -fmn;
+
+	dst->t.w = 1.0f;
+}
+
+void device_frustum(device_t device, float left, float right,
+		float top, float bottom, float near, float far)
+{
+	struct matrix4 *dst = &device->cur_proj;
+
+	float rml    = right-left;
+	float tmb    = top-bottom;
+	float nmf    = near-far;
+	float nearx2 = 2.0f*near;
+
+	vec4_zero(&dst->x);
+	vec4_zero(&dst->y);
+	vec4_zero(&dst->z);
+	vec4_zero(&dst->t);
+
+	dst->x.x =            nearx2 / rml;
+	dst->z.x =      (left+right) / rml;
+
+	dst->y.y =            nearx2 / tmb;
+	dst->z.y =      (bottom+top) / tmb;
+
+	dst->z.z =        (far+near) / nmf;
+	dst->t.z = 2.0f * (near*far) / nmf;
+
+	dst->z.w = -1.0f;
+}
+
+void device_projection_push(device_t device)
+{
+	da_push_back(device->proj_stack, &device->cur_proj);
+}
+
+void device_projection_pop(device_t device)
+{
+	struct matrix4 *end;
+	if (!device->proj_stack.num)
+		return;
+
+	end = da_end(device->proj_stack);
+	device->cur_proj = *end;
+	da_pop_back(device->proj_stack);
+}
+
+void swapchain_destroy(swapchain_t swapchain)
+{
+	if (!swapchain)
+		return;
+
+	if (swapchain->device->cur_swap == swapchain)
+		device_load_swapchain(swapchain->device, NULL);
+
+	bfree(swapchain);
+}
+
+void zstencil_destroy(zstencil_t zstencil)
+{
+	bfree(zstencil);
+}
+
+void samplerstate_destroy(samplerstate_t samplerstate)
+{
+	bfree(samplerstate);
+}
@@ -0,0 +1,141 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/darray.h>
+#include <graphics/graphics.h>
+#include <graphics/matrix4.h>
+
+#include "null-exports.h"
+
+/*
+ * Null graphics subsystem.  All resources live in system memory and nothing
+ * is rasterized, which allows libobs (video thread, outputs, encoders) to run
+ * on machines without a GPU or display.
+ *
+ * Draw calls copy the texture bound to the pixel shader over the current
+ * render target (scaled with point sampling), so frames still flow through
+ * the pipeline to stage surfaces and outputs.
+ */
+
+struct gs_texture {
+	device_t             device;
+	enum gs_texture_type type;
+	enum gs_color_format format;
+	uint32_t             width;
+	uint32_t             height;
+	uint32_t             depth; /* 6 for cube textures */
+	uint32_t             row_bytes;
+	bool                 is_dynamic;
+	bool                 is_render_target;
+	uint8_t              *data;
+};
+
+static inline uint8_t *texture_slice(struct gs_texture *tex, uint32_t slice)
+{
+	return tex->data + (size_t)tex->row_bytes * tex->height * slice;
+}
+
+struct gs_stage_surface {
+	enum gs_color_format format;
+	uint32_t             width;
+	uint32_t             height;
+	uint32_t             row_bytes;
+	uint8_t              *data;
+};
+
+struct gs_zstencil_buffer {
+	enum gs_zstencil_format format;
+	uint32_t                width;
+	uint32_t                height;
+};
+
+struct gs_sampler_state {
+	struct gs_sampler_info info;
+};
+
+struct gs_vertex_buffer {
+	device_t             device;
+	bool                 dynamic;
+	struct vb_data       *data;
+};
+
+struct gs_index_buffer {
+	device_t             device;
+	enum gs_index_type   type;
+	bool                 dynamic;
+	void                 *data;
+	size_t               num;
+};
+
+struct shader_param {
+	enum shader_param_type type;
+
+	char                 *name;
+	shader_t             shader;
+	int                  array_count;
+
+	struct gs_texture    *texture;
+
+	DARRAY(uint8_t)      cur_value;
+	DARRAY(uint8_t)      def_value;
+};
+
+struct gs_shader {
+	device_t             device;
+	enum shader_type     type;
+
+	struct shader_param  *viewproj;
+	struct shader_param  *world;
+
+	DARRAY(struct shader_param) params;
+	DARRAY(samplerstate_t)      samplers;
+};
+
+extern struct gs_texture *shader_get_texture(struct gs_shader *shader);
+
+struct gs_swap_chain {
+	device_t             device;
+	struct gs_init_data  info;
+};
+
+struct gs_device {
+	struct gs_swap_chain *cur_swap;
+	struct gs_swap_chain default_swap;
+
+	texture_t            cur_render_target;
+	zstencil_t           cur_zstencil_buffer;
+	int                  cur_render_side;
+	texture_t            cur_textures[GS_MAX_TEXTURES];
+	samplerstate_t       cur_samplers[GS_MAX_TEXTURES];
+	vertbuffer_t         cur_vertex_buffer;
+	indexbuffer_t        cur_index_buffer;
+	shader_t             cur_vertex_shader;
+	shader_t             cur_pixel_shader;
+
+	enum gs_cull_mode    cur_cull_mode;
+	struct gs_rect       cur_viewport;
+	struct gs_display_mode display_mode;
+	bool                 fullscreen;
+
+	struct matrix4       cur_proj;
+	struct matrix4       cur_view;
+	struct matrix4       cur_viewproj;
+
+	DARRAY(struct matrix4) proj_stack;
+};
@@ -0,0 +1,341 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "null-subsystem.h"
+
+static inline uint32_t get_row_bytes(enum gs_color_format format,
+		uint32_t width)
+{
+	uint32_t row_bytes = (width * gs_get_format_bpp(format) + 7) / 8;
+	return (row_bytes + 3) & 0xFFFFFFFC;
+}
+
+/* only the first mip level is stored, the remaining levels of each face
+ * are skipped */
+static struct gs_texture *texture_create(device_t device,
+		enum gs_texture_type type, uint32_t width, uint32_t height,
+		uint32_t depth, enum gs_color_format color_format,
+		uint32_t levels, const void **data, uint32_t flags)
+{
+	struct gs_texture *tex;
+	size_t   slice_size;
+	uint32_t i;
+
+	if (!width || !height || !gs_get_format_bpp(color_format))
+		return NULL;
+
+	if (!levels)
+		levels = gs_num_total_levels(width, height);
+	if (!levels)
+		levels = 1;
+
+	tex = bmalloc(sizeof(struct gs_texture));
+	memset(tex, 0, sizeof(struct gs_texture));
+
+	tex->device           = device;
+	tex->type             = type;
+	tex->format           = color_format;
+	tex->width            = width;
+	tex->height           = height;
+	tex->depth            = depth;
+	tex->row_bytes        = get_row_bytes(color_format, width);
+	tex->is_dynamic       = (flags & GS_DYNAMIC) != 0;
+	tex->is_render_target = (flags & GS_RENDERTARGET) != 0;
+
+	slice_size = (size_t)tex->row_bytes * height;
+	tex->data  = bmalloc(slice_size * depth);
+	memset(tex->data, 0, slice_size * depth);
+
+	if (data) {
+		for (i = 0; i < depth; i++) {
+			const void *slice_data = data[i * levels];
+			if (slice_data)
+				memcpy(texture_slice(tex, i), slice_data,
+						slice_size);
+		}
+	}
+
+	return tex;
+}
+
+texture_t device_create_texture(device_t device, uint32_t width,
+		uint32_t height, enum gs_color_format color_format,
+		uint32_t levels, const void **data, uint32_t flags)
+{
+	struct gs_texture *tex = texture_create(device, GS_TEXTURE_2D,
+			width, height, 1, color_format, levels, data, flags);
+	if (!tex)
+		blog(LOG_ERROR, "device_create_texture (null) failed");
+	return tex;
+}
+
+texture_t device_create_cubetexture(device_t device, uint32_t size,
+		enum gs_color_format color_format, uint32_t levels,
+		const void **data, uint32_t flags)
+{
+	struct gs_texture *tex = texture_create(device, GS_TEXTURE_CUBE,
+			size, size, 6, color_format, levels, data, flags);
+	if (!tex)
+		blog(LOG_ERROR, "device_create_cubetexture (null) failed");
+	return tex;
+}
+
+texture_t device_create_volumetexture(device_t device, uint32_t width,
+		uint32_t height, uint32_t depth,
+		enum gs_color_format color_format, uint32_t levels,
+		const void **data, uint32_t flags)
+{
+	struct gs_texture *tex = texture_create(device, GS_TEXTURE_3D,
+			width, height, depth, color_format, levels, data,
+			flags);
+	if (!tex)
+		blog(LOG_ERROR, "device_create_volumetexture (null) failed");
+	return tex;
+}
+
+enum gs_texture_type device_gettexturetype(device_t device,
+		texture_t texture)
+{
+	return texture->type;
+}
+
+static inline bool is_texture_2d(texture_t tex, const char *func)
+{
+	bool is_tex2d = tex->type == GS_TEXTURE_2D;
+	if (!is_tex2d)
+		blog(LOG_ERROR, "%s (null) failed:  Not a 2D texture", func);
+	return is_tex2d;
+}
+
+void texture_destroy(texture_t tex)
+{
+	if (!tex)
+		return;
+
+	bfree(tex->data);
+	bfree(tex);
+}
+
+uint32_t texture_getwidth(texture_t tex)
+{
+	if (!is_texture_2d(tex, "texture_getwidth"))
+		return 0;
+	return tex->width;
+}
+
+uint32_t texture_getheight(texture_t tex)
+{
+	if (!is_texture_2d(tex, "texture_getheight"))
+		return 0;
+	return tex->height;
+}
+
+enum gs_color_format texture_getcolorformat(texture_t tex)
+{
+	return tex->format;
+}
+
+bool texture_map(texture_t tex, void **ptr, uint32_t *row_bytes)
+{
+	if (!is_texture_2d(tex, "texture_map"))
+		return false;
+
+	if (!tex->is_dynamic) {
+		blog(LOG_ERROR, "Texture is not dynamic");
+		return false;
+	}
+
+	*ptr       = tex->data;
+	*row_bytes = tex->row_bytes;
+	return true;
+}
+
+void texture_unmap(texture_t tex)
+{
+}
+
+bool texture_isrect(texture_t tex)
+{
+	return false;
+}
+
+void cubetexture_destroy(texture_t cubetex)
+{
+	texture_destroy(cubetex);
+}
+
+uint32_t cubetexture_getsize(texture_t cubetex)
+{
+	return cubetex->width;
+}
+
+enum gs_color_format cubetexture_getcolorformat(texture_t cubetex)
+{
+	return cubetex->format;
+}
+
+void volumetexture_destroy(texture_t voltex)
+{
+	texture_destroy(voltex);
+}
+
+uint32_t volumetexture_getwidth(texture_t voltex)
+{
+	return voltex->width;
+}
+
+uint32_t volumetexture_getheight(texture_t voltex)
+{
+	return voltex->height;
+}
+
+uint32_t volumetexture_getdepth(texture_t voltex)
+{
+	return voltex->depth;
+}
+
+enum gs_color_format volumetexture_getcolorformat(texture_t voltex)
+{
+	return voltex->format;
+}
+
+/* ------------------------------------------------------------------------- */
+
+stagesurf_t device_create_stagesurface(device_t device, uint32_t width,
+		uint32_t height, enum gs_color_format color_format)
+{
+	struct gs_stage_surface *surf;
+
+	if (!width || !height || !gs_get_format_bpp(color_format)) {
+		blog(LOG_ERROR, "device_create_stagesurface (null) failed");
+		return NULL;
+	}
+
+	surf = bmalloc(sizeof(struct gs_stage_surface));
+	surf->format    = color_format;
+	surf->width     = width;
+	surf->height    = height;
+	surf->row_bytes = get_row_bytes(color_format, width);
+	surf->data      = bmalloc((size_t)surf->row_bytes * height);
+	memset(surf->data, 0, (size_t)surf->row_bytes * height);
+
+	return surf;
+}
+
+void stagesurface_destroy(stagesurf_t stagesurf)
+{
+	if (!stagesurf)
+		return;
+
+	bfree(stagesurf->data);
+	bfree(stagesurf);
+}
+
+uint32_t stagesurface_getwidth(stagesurf_t stagesurf)
+{
+	return stagesurf->width;
+}
+
+uint32_t stagesurface_getheight(stagesurf_t stagesurf)
+{
+	return stagesurf->height;
+}
+
+enum gs_color_format stagesurface_getcolorformat(stagesurf_t stagesurf)
+{
+	return stagesurf->format;
+}
+
+bool stagesurface_map(stagesurf_t stagesurf, const void **data,
+		uint32_t *row_bytes)
+{
+	*data      = stagesurf->data;
+	*row_bytes = stagesurf->row_bytes;
+	return true;
+}
+
+void stagesurface_unmap(stagesurf_t stagesurf)
+{
+}
+
+/* ------------------------------------------------------------------------- */
+
+void device_copy_texture(device_t device, texture_t dst, texture_t src)
+{
+	if (!src) {
+		blog(LOG_ERROR, "Source texture is NULL");
+		goto fail;
+	}
+
+	if (!dst) {
+		blog(LOG_ERROR, "Destination texture is NULL");
+		goto fail;
+	}
+
+	if (dst->type != src->type || dst->format != src->format) {
+		blog(LOG_ERROR, "Source and destination textures must be "
+		                "the same type and format");
+		goto fail;
+	}
+
+	if (dst->width != src->width || dst->height != src->height ||
+	    dst->depth != src->depth) {
+		blog(LOG_ERROR, "Source and destination must have "
+		                "the same dimensions");
+		goto fail;
+	}
+
+	memcpy(dst->data, src->data,
+			(size_t)src->row_bytes * src->height * src->depth);
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_copy_texture (null) failed");
+}
+
+void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
+{
+	uint32_t y;
+
+	if (!src) {
+		blog(LOG_ERROR, "Source texture is NULL");
+		goto fail;
+	}
+
+	if (!is_texture_2d(src, "device_stage_texture"))
+		goto fail;
+
+	if (src->format != dst->format) {
+		blog(LOG_ERROR, "Source and destination formats do not match");
+		goto fail;
+	}
+
+	if (src->width != dst->width || src->height != dst->height) {
+		blog(LOG_ERROR, "Source and destination must have "
+		                "the same dimensions");
+		goto fail;
+	}
+
+	for (y = 0; y < src->height; y++)
+		memcpy(dst->data + (size_t)y * dst->row_bytes,
+		       src->data + (size_t)y * src->row_bytes,
+		       src->row_bytes);
+	return;
+
+fail:
+	blog(LOG_ERROR, "device_stage_texture (null) failed");
+}
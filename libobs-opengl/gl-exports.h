@@ -96,6 +96,9 @@ EXPORT void device_enable_color(device_t device, bool red, bool green,
 		bool blue, bool alpha);
 EXPORT void device_blendfunction(device_t device, enum gs_blend_type src,
 		enum gs_blend_type dest);
+EXPORT void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a);
 EXPORT void device_depthfunction(device_t device, enum gs_depth_test test);
 EXPORT void device_stencilfunction(device_t device, enum gs_stencil_side side,
 		enum gs_depth_test test);
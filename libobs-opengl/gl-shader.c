@@ -17,6 +17,8 @@
 
 #include <assert.h>
 
+#include <util/platform.h>
+#include <util/dstr.h>
 #include <graphics/vec2.h>
 #include <graphics/vec3.h>
 #include <graphics/vec4.h>
@@ -37,21 +39,30 @@ static inline void shader_param_free(struct shader_param *param)
 	da_free(param->def_value);
 }
 
-static void gl_get_program_info(GLuint program, const char *file,
+/* gets the info log of a program, or of a shader object if 'program' is
+ * false */
+static void gl_get_info_log(GLuint object, bool program, const char *file,
 		char **error_string)
 {
 	char    *errors;
 	GLint   info_len = 0;
 	GLsizei chars_written = 0;
 
-	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_len);
-	if (!gl_success("glGetProgramiv") || !info_len)
+	if (program)
+		glGetProgramiv(object, GL_INFO_LOG_LENGTH, &info_len);
+	else
+		glGetShaderiv(object, GL_INFO_LOG_LENGTH, &info_len);
+	if (!gl_success(program ? "glGetProgramiv" : "glGetShaderiv") ||
+	    !info_len)
 		return;
 
 	errors = bmalloc(info_len+1);
 	memset(errors, 0, info_len+1);
-	glGetProgramInfoLog(program, info_len, &chars_written, errors);
-	gl_success("glGetProgramInfoLog");
+	if (program)
+		glGetProgramInfoLog(object, info_len, &chars_written, errors);
+	else
+		glGetShaderInfoLog(object, info_len, &chars_written, errors);
+	gl_success(program ? "glGetProgramInfoLog" : "glGetShaderInfoLog");
 
 	blog(LOG_DEBUG, "Compiler warnings/errors for %s:\n%s", file, errors);
 
@@ -196,33 +207,231 @@ static inline bool gl_process_attribs(struct gs_shader *shader,
 	return true;
 }
 
-static bool gl_shader_init(struct gs_shader *shader,
-		struct gl_shader_parser *glsp,
-		const char *file, char **error_string)
+/*
+ * Linked programs are cached as driver binaries when a graphics cache path
+ * is set, named after a hash of the driver strings and the GLSL text.  If the
+ * driver rejects a cached binary (after a driver update for example), the
+ * program is simply compiled again.
+ */
+
+#define GL_PROGRAM_CACHE_MAGIC 0x4750424F /* "OBPG" */
+
+struct gl_program_cache_header {
+	uint32_t magic;
+	uint32_t format;
+};
+
+static bool gl_get_program_cache_file(struct dstr *path, const char *gl_str)
 {
-	GLenum type = convert_shader_type(shader->type);
-	int compiled = 0;
-	bool success = true;
+	const char *cache_path = gs_get_cache_path();
+	GLenum driver_strings[3] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+	uint64_t hash = GS_CACHE_HASH_INIT;
+	GLint num_formats = 0;
+	size_t i;
 
-	shader->program = glCreateShaderProgramv(type, 1,
-			(const GLchar**)&glsp->gl_string.array);
-	if (!gl_success("glCreateShaderProgramv") || !shader->program)
+	if (!cache_path || !ogl_IsVersionGEQ(4, 1))
 		return false;
 
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+	if (!gl_success("glGetIntegerv") || !num_formats)
+		return false;
+
+	for (i = 0; i < 3; i++) {
+		const char *str = (const char*)glGetString(driver_strings[i]);
+		if (str)
+			hash = gs_cache_hash(hash, str, strlen(str) + 1);
+	}
+
+	hash = gs_cache_hash(hash, gl_str, strlen(gl_str));
+
+	dstr_printf(path, "%s/%016llx.glprogram", cache_path,
+			(unsigned long long)hash);
+	return true;
+}
+
+static GLuint gl_load_program_binary(const char *path)
+{
+	struct gl_program_cache_header header;
+	FILE    *file = os_fopen(path, "rb");
+	GLuint  program = 0;
+	GLint   linked = 0;
+	uint8_t *binary = NULL;
+	off_t   size;
+	int     i;
+
+	if (!file)
+		return 0;
+
+	size = os_fgetsize(file) - (off_t)sizeof(header);
+	if (size <= 0 || fread(&header, sizeof(header), 1, file) != 1 ||
+	    header.magic != GL_PROGRAM_CACHE_MAGIC)
+		goto exit;
+
+	binary = bmalloc((size_t)size);
+	if (fread(binary, 1, (size_t)size, file) != (size_t)size)
+		goto exit;
+
+	program = glCreateProgram();
+	if (!gl_success("glCreateProgram") || !program)
+		goto exit;
+
+	glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	glProgramBinary(program, header.format, binary, (GLsizei)size);
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	/* errors are expected here if the driver changed.  a lost context
+	 * keeps reporting an error, so only clear a limited number */
+	for (i = 0; i < 32 && glGetError() != GL_NO_ERROR; i++)
+		;
+
+	if (!linked) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+
+exit:
+	fclose(file);
+	bfree(binary);
+	return program;
+}
+
+static void gl_save_program_binary(GLuint program, const char *path)
+{
+	struct gl_program_cache_header header;
+	GLint   size = 0;
+	GLenum  format = 0;
+	uint8_t *binary;
+	FILE    *file;
+
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+	if (!gl_success("glGetProgramiv") || size <= 0)
+		return;
+
+	binary = bmalloc(size);
+	glGetProgramBinary(program, size, &size, &format, binary);
+	if (!gl_success("glGetProgramBinary"))
+		goto exit;
+
+	header.magic  = GL_PROGRAM_CACHE_MAGIC;
+	header.format = format;
+
+	file = os_fopen(path, "wb");
+	if (!file)
+		goto exit;
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+	    fwrite(binary, 1, size, file) != (size_t)size)
+		blog(LOG_WARNING, "Could not write program cache '%s'", path);
+
+	fclose(file);
+
+exit:
+	bfree(binary);
+}
+
+static GLuint gl_compile_shader(GLenum type, const GLchar *str,
+		const char *file, char **error_string)
+{
+	GLuint gl_shader = glCreateShader(type);
+	int    compiled = 0;
+
+	if (!gl_success("glCreateShader") || !gl_shader)
+		return 0;
+
+	glShaderSource(gl_shader, 1, &str, NULL);
+	if (!gl_success("glShaderSource"))
+		goto fail;
+
+	glCompileShader(gl_shader);
+	if (!gl_success("glCompileShader"))
+		goto fail;
+
+	glGetShaderiv(gl_shader, GL_COMPILE_STATUS, &compiled);
+	if (!gl_success("glGetShaderiv"))
+		goto fail;
+
+	if (!compiled) {
+		gl_get_info_log(gl_shader, false, file, error_string);
+		goto fail;
+	}
+
+	return gl_shader;
+
+fail:
+	glDeleteShader(gl_shader);
+	return 0;
+}
+
+/*
+ * The program is built explicitly rather than with glCreateShaderProgramv so
+ * that GL_PROGRAM_BINARY_RETRIEVABLE_HINT can be set before it's linked; some
+ * drivers won't return a binary without it.
+ */
+static bool gl_compile_program(struct gs_shader *shader,
+		struct gl_shader_parser *glsp, const char *file,
+		char **error_string, const char *cache_file)
+{
+	GLenum type = convert_shader_type(shader->type);
+	GLuint gl_shader;
+	int    linked = 0;
+
 	blog(LOG_DEBUG, "+++++++++++++++++++++++++++++++++++");
 	blog(LOG_DEBUG, "  GL shader string for: %s", file);
 	blog(LOG_DEBUG, "-----------------------------------");
 	blog(LOG_DEBUG, "%s", glsp->gl_string.array);
 	blog(LOG_DEBUG, "+++++++++++++++++++++++++++++++++++");
 
-	glGetProgramiv(shader->program, GL_LINK_STATUS, &compiled);
+	gl_shader = gl_compile_shader(type, glsp->gl_string.array, file,
+			error_string);
+	if (!gl_shader)
+		return false;
+
+	shader->program = glCreateProgram();
+	if (!gl_success("glCreateProgram") || !shader->program) {
+		glDeleteShader(gl_shader);
+		return false;
+	}
+
+	glProgramParameteri(shader->program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+	if (cache_file)
+		glProgramParameteri(shader->program,
+				GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	gl_success("glProgramParameteri");
+
+	glAttachShader(shader->program, gl_shader);
+	glLinkProgram(shader->program);
+	glDetachShader(shader->program, gl_shader);
+	glDeleteShader(gl_shader);
+	if (!gl_success("glLinkProgram"))
+		return false;
+
+	glGetProgramiv(shader->program, GL_LINK_STATUS, &linked);
 	if (!gl_success("glGetProgramiv"))
 		return false;
 
-	if (!compiled)
-		success = false;
+	gl_get_info_log(shader->program, true, file, error_string);
+
+	if (linked && cache_file)
+		gl_save_program_binary(shader->program, cache_file);
+
+	return linked != 0;
+}
+
+static bool gl_shader_init(struct gs_shader *shader,
+		struct gl_shader_parser *glsp,
+		const char *file, char **error_string)
+{
+	struct dstr cache_file = {0};
+	bool success = true;
+
+	if (gl_get_program_cache_file(&cache_file, glsp->gl_string.array))
+		shader->program = gl_load_program_binary(cache_file.array);
+
+	if (!shader->program)
+		success = gl_compile_program(shader, glsp, file, error_string,
+				cache_file.array);
 
-	gl_get_program_info(shader->program, file, error_string);
+	dstr_free(&cache_file);
 
 	if (success)
 		success = gl_add_params(shader, glsp);
@@ -28,11 +28,9 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, surf->pack_buffer))
 		return false;
 
-	size  = surf->width * surf->bytes_per_pixel;
-	size  = (size+3) & 0xFFFFFFFC; /* align width to 4-byte boundry */
-	size *= surf->height;
+	size = (GLsizeiptr)surf->row_bytes * surf->height;
 
-	glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
 	if (!gl_success("glBufferData"))
 		success = false;
 
@@ -42,29 +40,6 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	return success;
 }
 
-static bool gl_init_stage_surface(struct gs_stage_surface *surf)
-{
-	bool success = true;
-
-	if (!gl_gen_textures(1, &surf->texture))
-		return false;
-	if (!gl_bind_texture(GL_TEXTURE_2D, surf->texture))
-		return false;
-
-	if (!gl_init_face(GL_TEXTURE_2D, surf->gl_type, 1, surf->gl_format,
-			surf->gl_internal_format, false,
-			surf->width, surf->height, 0, NULL))
-		success = false;
-
-	if (!gl_bind_texture(GL_TEXTURE_2D, 0))
-		success = false;
-
-	if (success)
-		success = create_pixel_pack_buffer(surf);
-
-	return success;
-}
-
 stagesurf_t device_create_stagesurface(device_t device, uint32_t width,
 		uint32_t height, enum gs_color_format color_format)
 {
@@ -80,7 +55,11 @@ stagesurf_t device_create_stagesurface(device_t device, uint32_t width,
 	surf->gl_type            = get_gl_format_type(color_format);
 	surf->bytes_per_pixel    = gs_get_format_bpp(color_format)/8;
 
-	if (!gl_init_stage_surface(surf)) {
+	/* rows are packed with the default GL_PACK_ALIGNMENT of 4 */
+	surf->row_bytes = (surf->width * surf->bytes_per_pixel + 3) &
+		0xFFFFFFFC;
+
+	if (!create_pixel_pack_buffer(surf)) {
 		blog(LOG_ERROR, "device_create_stagesurface (GL) failed");
 		stagesurface_destroy(surf);
 		return NULL;
@@ -95,9 +74,6 @@ void stagesurface_destroy(stagesurf_t stagesurf)
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
-		if (stagesurf->texture)
-			gl_delete_textures(1, &stagesurf->texture);
-
 		bfree(stagesurf);
 	}
 }
@@ -133,18 +109,16 @@ static bool can_stage(struct gs_stage_surface *dst, struct gs_texture_2d *src)
 	return true;
 }
 
+/* reads the texture straight into the pack buffer.  with a pack buffer
+ * bound, glGetTexImage only queues the transfer, so it does not wait on the
+ * GPU until the surface is mapped. */
 void device_stage_texture(device_t device, stagesurf_t dst, texture_t src)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d*)src;
 	if (!can_stage(dst, tex2d))
 		goto failed;
 
-	if (!gl_copy_texture(device, dst->texture, GL_TEXTURE_2D,
-				tex2d->base.texture, GL_TEXTURE_2D,
-				dst->width, dst->height))
-		goto failed;
-
-	if (!gl_bind_buffer(GL_TEXTURE_2D, dst->texture))
+	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
 		goto failed;
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, dst->pack_buffer))
 		goto failed;
@@ -190,7 +164,7 @@ bool stagesurface_map(stagesurf_t stagesurf, const void **data,
 
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 
-	*row_bytes = stagesurf->bytes_per_pixel * stagesurf->width;
+	*row_bytes = stagesurf->row_bytes;
 	return true;
 
 fail:
@@ -1002,6 +1002,20 @@ void device_blendfunction(device_t device, enum gs_blend_type src,
 		blog(LOG_ERROR, "device_blendfunction (GL) failed");
 }
 
+void device_blendfunction_separate(device_t device,
+		enum gs_blend_type src_c, enum gs_blend_type dest_c,
+		enum gs_blend_type src_a, enum gs_blend_type dest_a)
+{
+	GLenum gl_src_c = convert_gs_blend_type(src_c);
+	GLenum gl_dst_c = convert_gs_blend_type(dest_c);
+	GLenum gl_src_a = convert_gs_blend_type(src_a);
+	GLenum gl_dst_a = convert_gs_blend_type(dest_a);
+
+	glBlendFuncSeparate(gl_src_c, gl_dst_c, gl_src_a, gl_dst_a);
+	if (!gl_success("glBlendFuncSeparate"))
+		blog(LOG_ERROR, "device_blendfunction_separate (GL) failed");
+}
+
 void device_depthfunction(device_t device, enum gs_depth_test test)
 {
 	GLenum gl_test = convert_gs_depth_test(test);
@@ -409,10 +409,10 @@ struct gs_stage_surface {
 	uint32_t             height;
 
 	uint32_t             bytes_per_pixel;
+	uint32_t             row_bytes;
 	GLenum               gl_format;
 	GLint                gl_internal_format;
 	GLenum               gl_type;
-	GLuint               texture;
 	GLuint               pack_buffer;
 };
 
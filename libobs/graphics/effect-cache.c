@@ -0,0 +1,441 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+
+#include "../util/platform.h"
+#include "../util/dstr.h"
+#include "graphics-internal.h"
+#include "effect-parser.h"
+#include "effect-cache.h"
+#include "effect.h"
+
+#define EFFECT_CACHE_MAGIC   0x4345424F /* "OBEC" */
+#define EFFECT_CACHE_VERSION 1
+
+struct effect_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t payload_size;
+	uint64_t checksum;
+};
+
+static uint64_t effect_cache_key(effect_t effect, const char *effect_string)
+{
+	const char *module = effect->graphics->module_name;
+	uint32_t version = EFFECT_CACHE_VERSION;
+	uint64_t hash = GS_CACHE_HASH_INIT;
+
+	hash = gs_cache_hash(hash, &version, sizeof(version));
+	if (module)
+		hash = gs_cache_hash(hash, module, strlen(module) + 1);
+	return gs_cache_hash(hash, effect_string, strlen(effect_string));
+}
+
+static bool get_cache_file(struct dstr *path, effect_t effect, uint64_t key)
+{
+	const char *cache_path = effect->graphics->cache_path;
+	if (!cache_path)
+		return false;
+
+	dstr_printf(path, "%s/%016llx.effect-cache", cache_path,
+			(unsigned long long)key);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* saving */
+
+static inline void write_data(struct darray *buf, const void *data,
+		size_t size)
+{
+	if (size)
+		darray_push_back_array(1, buf, data, size);
+}
+
+static inline void write_u32(struct darray *buf, uint32_t val)
+{
+	write_data(buf, &val, sizeof(uint32_t));
+}
+
+static inline void write_str(struct darray *buf, const char *str)
+{
+	size_t len = str ? strlen(str) : 0;
+
+	write_u32(buf, (uint32_t)len);
+	write_data(buf, str ? str : "", len + 1);
+}
+
+static void write_pass_shader(struct darray *buf, const char *shader_text,
+		struct darray *pass_params)
+{
+	struct pass_shaderparam *params = pass_params->array;
+	size_t i;
+
+	write_str(buf, shader_text);
+	write_u32(buf, (uint32_t)pass_params->num);
+
+	for (i = 0; i < pass_params->num; i++)
+		write_str(buf, params[i].eparam->name);
+}
+
+static bool write_payload(struct darray *buf, effect_t effect,
+		const struct effect_parser *ep)
+{
+	size_t shader_idx = 0;
+	size_t i, j;
+
+	write_u32(buf, (uint32_t)effect->params.num);
+
+	for (i = 0; i < effect->params.num; i++) {
+		struct effect_param *param = effect->params.array+i;
+
+		write_str(buf, param->name);
+		write_u32(buf, (uint32_t)param->type);
+		write_u32(buf, (uint32_t)param->default_val.num);
+		write_data(buf, param->default_val.array,
+				param->default_val.num);
+	}
+
+	write_u32(buf, (uint32_t)effect->techniques.num);
+
+	for (i = 0; i < effect->techniques.num; i++) {
+		struct effect_technique *tech = effect->techniques.array+i;
+
+		write_str(buf, tech->name);
+		write_u32(buf, (uint32_t)tech->passes.num);
+
+		for (j = 0; j < tech->passes.num; j++) {
+			struct effect_pass *pass = tech->passes.array+j;
+
+			if (shader_idx + 2 > ep->shaders.num)
+				return false;
+
+			write_str(buf, pass->name);
+			write_pass_shader(buf, ep->shaders.array[shader_idx++],
+					&pass->vertshader_params.da);
+			write_pass_shader(buf, ep->shaders.array[shader_idx++],
+					&pass->pixelshader_params.da);
+		}
+	}
+
+	return shader_idx == ep->shaders.num;
+}
+
+void effect_cache_save(effect_t effect, const char *effect_string,
+		const struct effect_parser *ep)
+{
+	struct effect_cache_header header;
+	struct darray payload;
+	struct dstr path = {0};
+	FILE *file;
+	bool success;
+
+	header.key = effect_cache_key(effect, effect_string);
+	if (!ep->keep_shaders || ep->cfp.pp.dependencies.num ||
+	    !get_cache_file(&path, effect, header.key))
+		return;
+
+	darray_init(&payload);
+	if (!write_payload(&payload, effect, ep)) {
+		blog(LOG_WARNING, "effect_cache_save: shader count mismatch");
+		goto exit;
+	}
+
+	header.magic        = EFFECT_CACHE_MAGIC;
+	header.version      = EFFECT_CACHE_VERSION;
+	header.payload_size = payload.num;
+	header.checksum     = gs_cache_hash(GS_CACHE_HASH_INIT,
+			payload.array, payload.num);
+
+	file = os_fopen(path.array, "wb");
+	if (!file) {
+		blog(LOG_WARNING, "effect_cache_save: could not open '%s'",
+				path.array);
+		goto exit;
+	}
+
+	success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	          fwrite(payload.array, 1, payload.num, file) == payload.num;
+	fclose(file);
+
+	if (!success)
+		blog(LOG_WARNING, "effect_cache_save: could not write '%s'",
+				path.array);
+
+exit:
+	darray_free(&payload);
+	dstr_free(&path);
+}
+
+/* ------------------------------------------------------------------------- */
+/* loading */
+
+struct cache_reader {
+	const uint8_t *data;
+	size_t        size;
+	size_t        pos;
+	bool          error;
+};
+
+static const void *read_data(struct cache_reader *r, size_t size)
+{
+	const void *data;
+
+	if (r->error || size > r->size - r->pos) {
+		r->error = true;
+		return NULL;
+	}
+
+	data = r->data + r->pos;
+	r->pos += size;
+	return data;
+}
+
+static uint32_t read_u32(struct cache_reader *r)
+{
+	const void *data = read_data(r, sizeof(uint32_t));
+	uint32_t val = 0;
+
+	if (data)
+		memcpy(&val, data, sizeof(uint32_t));
+	return val;
+}
+
+/* counts are checked against the remaining data before anything is
+ * allocated for them */
+static inline uint32_t read_count(struct cache_reader *r)
+{
+	uint32_t count = read_u32(r);
+
+	if (count > r->size - r->pos) {
+		r->error = true;
+		return 0;
+	}
+
+	return count;
+}
+
+static const char *read_str(struct cache_reader *r)
+{
+	uint32_t len = read_u32(r);
+	const char *str = read_data(r, (size_t)len + 1);
+
+	if (!str || str[len] != 0) {
+		r->error = true;
+		return "";
+	}
+
+	return str;
+}
+
+static bool read_pass_shader(struct cache_reader *r, effect_t effect,
+		struct effect_technique *tech, struct effect_pass *pass,
+		size_t pass_idx, enum shader_type type, const char *file)
+{
+	const char *shader_text = read_str(r);
+	uint32_t num_params = read_count(r);
+	struct darray *pass_params;
+	struct dstr location = {0};
+	shader_t shader;
+	size_t i;
+
+	if (r->error)
+		return false;
+
+	effect_shader_location(&location, file, type, tech->name, pass_idx);
+
+	if (type == SHADER_VERTEX) {
+		pass->vertshader = gs_create_vertexshader(shader_text,
+				location.array, NULL);
+		shader = pass->vertshader;
+		pass_params = &pass->vertshader_params.da;
+	} else {
+		pass->pixelshader = gs_create_pixelshader(shader_text,
+				location.array, NULL);
+		shader = pass->pixelshader;
+		pass_params = &pass->pixelshader_params.da;
+	}
+
+	dstr_free(&location);
+
+	if (!shader)
+		return false;
+
+	darray_resize(sizeof(struct pass_shaderparam), pass_params,
+			num_params);
+
+	for (i = 0; i < num_params; i++) {
+		struct pass_shaderparam *param = darray_item(
+				sizeof(struct pass_shaderparam), pass_params, i);
+		const char *name = read_str(r);
+
+		if (r->error || !effect_pass_map_param(effect, param, shader,
+					name))
+			return false;
+	}
+
+	return true;
+}
+
+static bool read_payload(struct cache_reader *r, effect_t effect,
+		const char *file)
+{
+	uint32_t num_params, num_techs;
+	size_t i, j;
+
+	num_params = read_count(r);
+	da_resize(effect->params, num_params);
+
+	for (i = 0; i < num_params; i++) {
+		struct effect_param *param = effect->params.array+i;
+		uint32_t default_size;
+		const void *default_val;
+
+		param->name    = bstrdup(read_str(r));
+		param->section = EFFECT_PARAM;
+		param->effect  = effect;
+		param->type    = (enum shader_param_type)read_u32(r);
+
+		default_size = read_u32(r);
+		default_val  = read_data(r, default_size);
+		if (r->error || !param->name)
+			return false;
+
+		if (default_size)
+			da_copy_array(param->default_val, default_val,
+					default_size);
+
+		effect_param_setup(param);
+	}
+
+	num_techs = read_count(r);
+	da_resize(effect->techniques, num_techs);
+
+	for (i = 0; i < num_techs; i++) {
+		struct effect_technique *tech = effect->techniques.array+i;
+		uint32_t num_passes;
+
+		tech->name    = bstrdup(read_str(r));
+		tech->section = EFFECT_TECHNIQUE;
+		tech->effect  = effect;
+
+		num_passes = read_count(r);
+		if (r->error || !tech->name)
+			return false;
+
+		da_resize(tech->passes, num_passes);
+
+		for (j = 0; j < num_passes; j++) {
+			struct effect_pass *pass = tech->passes.array+j;
+
+			pass->name    = bstrdup(read_str(r));
+			pass->section = EFFECT_PASS;
+
+			if (!read_pass_shader(r, effect, tech, pass, j,
+						SHADER_VERTEX, file) ||
+			    !read_pass_shader(r, effect, tech, pass, j,
+						SHADER_PIXEL, file))
+				return false;
+		}
+	}
+
+	effect_build_name_tables(effect);
+	return !r->error && r->pos == r->size;
+}
+
+static uint8_t *read_cache_file(const char *path, size_t *size)
+{
+	FILE *file = os_fopen(path, "rb");
+	uint8_t *data = NULL;
+	off_t file_size;
+
+	if (!file)
+		return NULL;
+
+	file_size = os_fgetsize(file);
+	if (file_size > 0) {
+		data = bmalloc((size_t)file_size);
+		if (fread(data, 1, (size_t)file_size, file) !=
+				(size_t)file_size) {
+			bfree(data);
+			data = NULL;
+		}
+	}
+
+	fclose(file);
+	*size = (size_t)file_size;
+	return data;
+}
+
+static bool valid_cache_data(const uint8_t *data, size_t size, uint64_t key)
+{
+	struct effect_cache_header header;
+	const uint8_t *payload = data + sizeof(header);
+
+	if (size < sizeof(header))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+
+	return header.magic        == EFFECT_CACHE_MAGIC   &&
+	       header.version      == EFFECT_CACHE_VERSION &&
+	       header.key          == key                  &&
+	       header.payload_size == size - sizeof(header) &&
+	       header.checksum     == gs_cache_hash(GS_CACHE_HASH_INIT,
+			       payload, (size_t)header.payload_size);
+}
+
+bool effect_cache_load(effect_t effect, const char *effect_string,
+		const char *file)
+{
+	uint64_t key = effect_cache_key(effect, effect_string);
+	struct cache_reader reader = {0};
+	struct dstr path = {0};
+	graphics_t graphics;
+	uint8_t *data = NULL;
+	size_t size = 0;
+	bool success = false;
+
+	if (!get_cache_file(&path, effect, key))
+		return false;
+
+	data = read_cache_file(path.array, &size);
+	if (!data || !valid_cache_data(data, size, key))
+		goto exit;
+
+	reader.data = data + sizeof(struct effect_cache_header);
+	reader.size = size - sizeof(struct effect_cache_header);
+
+	success = read_payload(&reader, effect, file);
+	if (success) {
+		blog(LOG_DEBUG, "Loaded effect '%s' from the cache", file);
+	} else {
+		blog(LOG_WARNING, "Could not load effect '%s' from the "
+		                  "cache, compiling it instead", file);
+
+		graphics = effect->graphics;
+		effect_free(effect);
+		effect_init(effect);
+		effect->graphics = graphics;
+	}
+
+exit:
+	bfree(data);
+	dstr_free(&path);
+	return success;
+}
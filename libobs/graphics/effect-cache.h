@@ -0,0 +1,52 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "graphics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct effect_parser;
+
+/*
+ * Compiled effect cache
+ *
+ *   When a cache path is set, compiled effects are saved as their parameters,
+ * techniques and the generated text of each pass shader, in a file named
+ * after a hash of the effect text and the graphics module.  Loading an
+ * effect from the cache skips the lexer, preprocessor and effect parser.
+ * The pass shaders are still created by the graphics module, which can keep
+ * a cache of its own.
+ *
+ *   Effects that include other files aren't cached, since the hash only
+ * covers the effect's own text.
+ */
+
+/* returns false if the effect isn't cached, leaving the effect empty */
+extern bool effect_cache_load(effect_t effect, const char *effect_string,
+		const char *file);
+
+/* the parser must have been set to keep its shader text */
+extern void effect_cache_save(effect_t effect, const char *effect_string,
+		const struct effect_parser *ep);
+
+#ifdef __cplusplus
+}
+#endif
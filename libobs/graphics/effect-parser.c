@@ -32,6 +32,8 @@ void ep_free(struct effect_parser *ep)
 		ep_sampler_free(ep->samplers.array+i);
 	for (i = 0; i < ep->techniques.num; i++)
 		ep_technique_free(ep->techniques.array+i);
+	for (i = 0; i < ep->shaders.num; i++)
+		bfree(ep->shaders.array[i]);
 
 	ep->cur_pass = NULL;
 	cf_parser_free(&ep->cfp);
@@ -40,6 +42,7 @@ void ep_free(struct effect_parser *ep)
 	da_free(ep->funcs);
 	da_free(ep->samplers);
 	da_free(ep->techniques);
+	da_free(ep->shaders);
 }
 
 static inline struct ep_func *ep_getfunc(struct effect_parser *ep,
@@ -1294,10 +1297,7 @@ static void ep_compile_param(struct effect_parser *ep, size_t idx)
 	else if (param_in->is_texture)
 		param->type = SHADER_PARAM_TEXTURE;
 
-	if (strcmp(param_in->name, "ViewProj") == 0)
-		ep->effect->view_proj = param;
-	else if (strcmp(param_in->name, "World") == 0)
-		ep->effect->world = param;
+	effect_param_setup(param);
 }
 
 static bool ep_compile_pass_shaderparams(struct effect_parser *ep,
@@ -1316,15 +1316,9 @@ static bool ep_compile_pass_shaderparams(struct effect_parser *ep,
 		param = darray_item(sizeof(struct pass_shaderparam),
 				pass_params, i);
 
-		param->eparam = effect_getparambyname(ep->effect,
-				param_name->array);
-		param->sparam = shader_getparambyname(shader,
-				param_name->array);
-
-		if (!param->sparam) {
-			blog(LOG_ERROR, "Effect shader parameter not found");
+		if (!effect_pass_map_param(ep->effect, param, shader,
+					param_name->array))
 			return false;
-		}
 	}
 
 	return true;
@@ -1346,15 +1340,7 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 	darray_init(&used_params);
 	dstr_init(&location);
 
-	dstr_copy(&location, ep->cfp.lex.file);
-	if (type == SHADER_VERTEX)
-		dstr_cat(&location, " (Vertex ");
-	else if (type == SHADER_PIXEL)
-		dstr_cat(&location, " (Pixel ");
-	/*else if (type == SHADER_GEOMETRY)
-		dstr_cat(&location, " (Geometry ");*/
-
-	dstr_catf(&location, "shader, technique %s, pass %u)", tech->name,
+	effect_shader_location(&location, ep->cfp.lex.file, type, tech->name,
 			pass_idx);
 
 	if (type == SHADER_VERTEX) {
@@ -1383,6 +1369,11 @@ static inline bool ep_compile_pass_shader(struct effect_parser *ep,
 	blog(LOG_DEBUG, "%s", shader_str.array);
 	blog(LOG_DEBUG, "+++++++++++++++++++++++++++++++++++");
 
+	if (ep->keep_shaders) {
+		char *shader_copy = bstrdup(shader_str.array);
+		da_push_back(ep->shaders, &shader_copy);
+	}
+
 	if (shader)
 		success = ep_compile_pass_shaderparams(ep, pass_params,
 				&used_params, shader);
@@ -1464,5 +1455,6 @@ static bool ep_compile(struct effect_parser *ep)
 			success = false;
 	}
 
+	effect_build_name_tables(ep->effect);
 	return success;
 }
@@ -256,6 +256,11 @@ struct effect_parser {
 	DARRAY(struct cf_token) tokens;
 	struct effect_pass *cur_pass;
 
+	/* if set, the text of each pass shader is kept in compile order (vertex
+	 * then pixel for each pass of each technique), for the effect cache */
+	bool keep_shaders;
+	DARRAY(char*) shaders;
+
 	struct cf_parser cfp;
 };
 
@@ -268,8 +273,10 @@ static inline void ep_init(struct effect_parser *ep)
 	da_init(ep->techniques);
 	da_init(ep->files);
 	da_init(ep->tokens);
+	da_init(ep->shaders);
 
-	ep->cur_pass = NULL;
+	ep->cur_pass     = NULL;
+	ep->keep_shaders = false;
 	cf_parser_init(&ep->cfp);
 }
 
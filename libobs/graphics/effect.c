@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "../util/dstr.h"
 #include "effect.h"
 #include "graphics-internal.h"
 #include "vec2.h"
@@ -24,34 +25,224 @@
 void effect_destroy(effect_t effect)
 {
 	if (effect) {
+		if (effect->graphics->sprite_batch.effect == effect)
+			sprite_batch_flush(effect->graphics);
+
 		effect_free(effect);
 		bfree(effect);
 	}
 }
 
-technique_t effect_gettechnique(effect_t effect, const char *name)
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/* params and techniques both start with their name */
+static inline const char *item_name(const void *array, size_t element_size,
+		size_t idx)
+{
+	return *(char* const*)((const uint8_t*)array + element_size * idx);
+}
+
+static void name_table_build(struct effect_name_table *table,
+		const void *array, size_t num, size_t element_size)
 {
+	size_t capacity = 4;
 	size_t i;
-	struct effect_technique *array = effect->techniques.array;
 
-	for (i = 0; i < effect->techniques.num; i++) {
-		struct effect_technique *tech = array+i;
-		if (strcmp(tech->name, name) == 0)
-			return tech;
+	while (capacity < num * 2)
+		capacity <<= 1;
+
+	effect_name_table_free(table);
+	table->slots = bmalloc(sizeof(uint32_t) * capacity);
+	table->mask  = capacity - 1;
+	memset(table->slots, 0, sizeof(uint32_t) * capacity);
+
+	for (i = 0; i < num; i++) {
+		const char *name = item_name(array, element_size, i);
+		size_t slot = hash_name(name) & table->mask;
+
+		while (table->slots[slot])
+			slot = (slot + 1) & table->mask;
+
+		table->slots[slot] = (uint32_t)i + 1;
 	}
+}
 
-	return NULL;
+/* returns the index of the named item, or 'num' if not found.  falls back to
+ * a linear search while the effect is still being built */
+static size_t name_table_find(const struct effect_name_table *table,
+		const void *array, size_t num, size_t element_size,
+		const char *name)
+{
+	size_t i;
+
+	if (!table->slots) {
+		for (i = 0; i < num; i++) {
+			if (strcmp(item_name(array, element_size, i), name) == 0)
+				return i;
+		}
+
+		return num;
+	}
+
+	i = hash_name(name) & table->mask;
+
+	while (table->slots[i]) {
+		size_t idx = table->slots[i] - 1;
+
+		if (strcmp(item_name(array, element_size, idx), name) == 0)
+			return idx;
+
+		i = (i + 1) & table->mask;
+	}
+
+	return num;
+}
+
+static inline size_t get_param_size(enum shader_param_type type)
+{
+	switch (type) {
+	case SHADER_PARAM_BOOL:      return sizeof(long);
+	case SHADER_PARAM_FLOAT:     return sizeof(float);
+	case SHADER_PARAM_INT:       return sizeof(long);
+	case SHADER_PARAM_VEC2:      return sizeof(float) * 2;
+	case SHADER_PARAM_VEC3:      return sizeof(float) * 3;
+	case SHADER_PARAM_VEC4:      return sizeof(float) * 4;
+	case SHADER_PARAM_MATRIX4X4: return sizeof(float) * 16;
+	case SHADER_PARAM_TEXTURE:   return sizeof(texture_t);
+	case SHADER_PARAM_STRING:
+	case SHADER_PARAM_UNKNOWN:   break;
+	}
+
+	return 0;
+}
+
+void effect_param_setup(struct effect_param *param)
+{
+	effect_t effect = param->effect;
+
+	/* the value storage is allocated once, setting the value later on
+	 * only reallocates if it's set with a larger size than its type */
+	da_reserve(param->cur_val, get_param_size(param->type));
+	if (param->default_val.num)
+		da_copy(param->cur_val, param->default_val);
+	param->generation = 1;
+
+	if (strcmp(param->name, "ViewProj") == 0)
+		effect->view_proj = param;
+	else if (strcmp(param->name, "World") == 0)
+		effect->world = param;
+}
+
+bool effect_pass_map_param(effect_t effect, struct pass_shaderparam *param,
+		shader_t shader, const char *name)
+{
+	param->eparam   = effect_getparambyname(effect, name);
+	param->sparam   = shader_getparambyname(shader, name);
+	param->uploaded = 0;
+
+	if (!param->eparam || !param->sparam) {
+		blog(LOG_ERROR, "Effect shader parameter not found");
+		return false;
+	}
+
+	return true;
+}
+
+void effect_shader_location(struct dstr *location, const char *file,
+		enum shader_type type, const char *tech_name, size_t pass_idx)
+{
+	dstr_copy(location, file);
+	if (type == SHADER_VERTEX)
+		dstr_cat(location, " (Vertex ");
+	else if (type == SHADER_PIXEL)
+		dstr_cat(location, " (Pixel ");
+	/*else if (type == SHADER_GEOMETRY)
+		dstr_cat(location, " (Geometry ");*/
+
+	dstr_catf(location, "shader, technique %s, pass %u)", tech_name,
+			(unsigned int)pass_idx);
+}
+
+void effect_build_name_tables(effect_t effect)
+{
+	name_table_build(&effect->param_names, effect->params.array,
+			effect->params.num, sizeof(struct effect_param));
+	name_table_build(&effect->technique_names, effect->techniques.array,
+			effect->techniques.num, sizeof(struct effect_technique));
+}
+
+technique_t effect_gettechnique(effect_t effect, const char *name)
+{
+	size_t idx = name_table_find(&effect->technique_names,
+			effect->techniques.array, effect->techniques.num,
+			sizeof(struct effect_technique), name);
+
+	return idx < effect->techniques.num ?
+		effect->techniques.array+idx : NULL;
+}
+
+static inline struct sprite_batch *get_batch(struct gs_effect *effect)
+{
+	return &effect->graphics->sprite_batch;
+}
+
+/* true if sprites drawn with this effect are queued and the batch is still
+ * open, so ending its technique/pass can be put off */
+static inline bool can_defer_end(struct gs_effect *effect)
+{
+	struct sprite_batch *batch = get_batch(effect);
+	return batch->depth && batch->num_verts && batch->effect == effect;
 }
 
 size_t technique_begin(technique_t tech)
 {
+	struct sprite_batch *batch = get_batch(tech->effect);
+
+	if (batch->pending_end == tech)
+		batch->pending_end = NULL;
+	else if (batch->num_verts)
+		sprite_batch_flush(tech->effect->graphics);
+
 	tech->effect->cur_technique = tech;
 	tech->effect->graphics->cur_effect = tech->effect;
 
 	return tech->passes.num;
 }
 
-void technique_end(technique_t tech)
+static void set_param_val(struct effect_param *param, const void *data,
+		size_t size)
+{
+	if (param->cur_val.num == size && (!size ||
+	    memcmp(param->cur_val.array, data, size) == 0))
+		return;
+
+	/* only the size changes, the storage itself is kept */
+	if (size) {
+		da_resize(param->cur_val, size);
+		memcpy(param->cur_val.array, data, size);
+	} else {
+		param->cur_val.num = 0;
+	}
+
+	param->generation++;
+}
+
+static inline void reset_param_val(struct effect_param *param)
+{
+	set_param_val(param, param->default_val.array, param->default_val.num);
+}
+
+static void technique_end_internal(technique_t tech)
 {
 	struct gs_effect *effect = tech->effect;
 	struct effect_param *params = effect->params.array;
@@ -66,22 +257,41 @@ void technique_end(technique_t tech)
 	for (i = 0; i < effect->params.num; i++) {
 		struct effect_param *param = params+i;
 
-		da_free(param->cur_val);
-		param->changed = false;
+		reset_param_val(param);
+		param->batch_stale = false;
 	}
 }
 
-static inline void reset_params(struct darray *shaderparams)
+/*
+ * While sprites are queued, the end is put off in case the next sprite uses
+ * the same technique again.  The parameters are marked stale rather than
+ * cleared, since their values are still needed by the queued sprites.
+ */
+void technique_end(technique_t tech)
 {
-	struct pass_shaderparam *params = shaderparams->array;
+	struct gs_effect *effect = tech->effect;
+	struct sprite_batch *batch = get_batch(effect);
 	size_t i;
 
-	for (i = 0; i < shaderparams->num; i++)
-		params[i].eparam->changed = false;
+	if (!can_defer_end(effect) || batch->pending_end) {
+		technique_end_internal(tech);
+		return;
+	}
+
+	for (i = 0; i < effect->params.num; i++)
+		effect->params.array[i].batch_stale = true;
+
+	batch->pending_end = tech;
+	effect->cur_technique = NULL;
+	effect->graphics->cur_effect = NULL;
 }
 
-static void upload_shader_params(shader_t shader, struct darray *pass_params,
-		bool changed_only)
+/*
+ * Shaders keep their values between passes and frames, so a value is only
+ * uploaded if it changed since it was last uploaded to that shader.
+ */
+static void upload_shader_params(struct gs_effect *effect, shader_t shader,
+		struct darray *pass_params)
 {
 	struct pass_shaderparam *params = pass_params->array;
 	size_t i;
@@ -91,23 +301,17 @@ static void upload_shader_params(shader_t shader, struct darray *pass_params,
 		struct effect_param *eparam = param->eparam;
 		sparam_t sparam = param->sparam;
 
-		if (changed_only && !eparam->changed)
+		if (!eparam->cur_val.num || param->uploaded == eparam->generation)
 			continue;
 
-		if (!eparam->cur_val.num) {
-			if (eparam->default_val.num)
-				da_copy(eparam->cur_val, eparam->default_val);
-			else
-				continue;
-		}
-
 		shader_setval(shader, sparam, eparam->cur_val.array,
 				eparam->cur_val.num);
+		param->uploaded = eparam->generation;
+		effect->graphics->uniform_uploads++;
 	}
 }
 
-static inline void upload_parameters(struct gs_effect *effect,
-		bool changed_only)
+static inline void upload_parameters(struct gs_effect *effect)
 {
 	struct darray *vshader_params, *pshader_params;
 
@@ -117,21 +321,20 @@ static inline void upload_parameters(struct gs_effect *effect,
 	vshader_params = &effect->cur_pass->vertshader_params.da;
 	pshader_params = &effect->cur_pass->pixelshader_params.da;
 
-	upload_shader_params(effect->cur_pass->vertshader, vshader_params,
-			changed_only);
-	upload_shader_params(effect->cur_pass->pixelshader, pshader_params,
-			changed_only);
-	reset_params(vshader_params);
-	reset_params(pshader_params);
+	upload_shader_params(effect, effect->cur_pass->vertshader,
+			vshader_params);
+	upload_shader_params(effect, effect->cur_pass->pixelshader,
+			pshader_params);
 }
 
 void effect_updateparams(effect_t effect)	
 {
-	upload_parameters(effect, true);
+	upload_parameters(effect);
 }
 
 bool technique_beginpass(technique_t tech, size_t idx)
 {
+	struct sprite_batch *batch = get_batch(tech->effect);
 	struct effect_pass *passes;
 	struct effect_pass *cur_pass;
 
@@ -141,10 +344,20 @@ bool technique_beginpass(technique_t tech, size_t idx)
 	passes = tech->passes.array;
 	cur_pass = passes+idx;
 
+	/* the pass is still loaded if its end was put off */
+	if (batch->pending_endpass == tech && !batch->pending_end &&
+	    tech->effect->cur_pass == cur_pass) {
+		batch->pending_endpass = NULL;
+		return true;
+	}
+
+	if (batch->num_verts)
+		sprite_batch_flush(tech->effect->graphics);
+
 	tech->effect->cur_pass = cur_pass;
 	gs_load_vertexshader(cur_pass->vertshader);
 	gs_load_pixelshader(cur_pass->pixelshader);
-	upload_parameters(tech->effect, false);
+	upload_parameters(tech->effect);
 
 	return true;
 }
@@ -171,15 +384,15 @@ static inline void clear_tex_params(shader_t shader, struct darray *in_params)
 
 	for (i = 0; i < in_params->num; i++) {
 		struct pass_shaderparam *param = params+i;
-		struct shader_param_info info;
 
-		shader_getparaminfo(shader, param->sparam, &info);
-		if (info.type == SHADER_PARAM_TEXTURE)
+		if (param->eparam->type == SHADER_PARAM_TEXTURE) {
 			shader_settexture(shader, param->sparam, NULL);
+			param->uploaded = 0;
+		}
 	}
 }
 
-void technique_endpass(technique_t tech)
+static void technique_endpass_internal(technique_t tech)
 {
 	struct effect_pass *pass = tech->effect->cur_pass;
 	if (!pass)
@@ -190,6 +403,81 @@ void technique_endpass(technique_t tech)
 	tech->effect->cur_pass = NULL;
 }
 
+void technique_endpass(technique_t tech)
+{
+	struct sprite_batch *batch = get_batch(tech->effect);
+
+	if (tech->effect->cur_pass && can_defer_end(tech->effect) &&
+	    !batch->pending_endpass)
+		batch->pending_endpass = tech;
+	else
+		technique_endpass_internal(tech);
+}
+
+static inline bool param_equals_default(struct effect_param *param)
+{
+	if (!param->default_val.num)
+		return true;
+
+	return param->cur_val.num == param->default_val.num &&
+		memcmp(param->cur_val.array, param->default_val.array,
+				param->cur_val.num) == 0;
+}
+
+/*
+ * Called before a sprite is added to the batch.  Stale parameters that the
+ * new sprite didn't set would be back to their defaults after a real
+ * technique end, so if any of them differ from their defaults the queued
+ * sprites have to be drawn first.  Parameters without defaults keep their
+ * loaded values either way.
+ */
+bool effect_batch_defaults_changed(effect_t effect)
+{
+	size_t i;
+
+	for (i = 0; i < effect->params.num; i++) {
+		struct effect_param *param = effect->params.array+i;
+
+		if (param->batch_stale && !param_equals_default(param))
+			return true;
+	}
+
+	for (i = 0; i < effect->params.num; i++)
+		effect->params.array[i].batch_stale = false;
+
+	return false;
+}
+
+/* finishes the technique ends that were put off, and resets the stale
+ * parameters of a resumed technique to their defaults */
+void effect_batch_flushed(struct sprite_batch *batch)
+{
+	struct gs_effect *effect = batch->effect;
+	size_t i;
+
+	if (batch->pending_endpass) {
+		technique_endpass_internal(batch->pending_endpass);
+		batch->pending_endpass = NULL;
+	}
+
+	if (batch->pending_end) {
+		technique_end_internal(batch->pending_end);
+		batch->pending_end = NULL;
+	}
+
+	if (!effect)
+		return;
+
+	for (i = 0; i < effect->params.num; i++) {
+		struct effect_param *param = effect->params.array+i;
+
+		if (param->batch_stale) {
+			reset_param_val(param);
+			param->batch_stale = false;
+		}
+	}
+}
+
 size_t effect_numparams(effect_t effect)
 {
 	return effect->params.num;
@@ -207,17 +495,11 @@ eparam_t effect_getparambyidx(effect_t effect, size_t param)
 
 eparam_t effect_getparambyname(effect_t effect, const char *name)
 {
-	struct effect_param *params = effect->params.array;
-	size_t i;
+	size_t idx = name_table_find(&effect->param_names,
+			effect->params.array, effect->params.num,
+			sizeof(struct effect_param), name);
 
-	for (i = 0; i < effect->params.num; i++) {
-		struct effect_param *param = params+i;
-
-		if (strcmp(param->name, name) == 0)
-			return param;
-	}
-
-	return NULL;
+	return idx < effect->params.num ? effect->params.array+idx : NULL;
 }
 
 static inline bool matching_effect(effect_t effect, eparam_t param)
@@ -253,18 +535,23 @@ eparam_t effect_getworldmatrix(effect_t effect)
 static inline void effect_setval_inline(effect_t effect, eparam_t param,
 		const void *data, size_t size)
 {
-	bool size_changed = param->cur_val.num != size;
+	struct sprite_batch *batch = get_batch(effect);
 
 	if (!matching_effect(effect, param))
 		return;
 
-	if (size_changed)
-		da_resize(param->cur_val, size);
+	/* queued sprites need the old value, unless it's the same */
+	if (batch->num_verts && batch->effect == effect) {
+		if (param->cur_val.num == size && (!size ||
+		    memcmp(param->cur_val.array, data, size) == 0)) {
+			param->batch_stale = false;
+			return;
+		}
 
-	if (size_changed || memcmp(param->cur_val.array, data, size) != 0) {
-		memcpy(param->cur_val.array, data, size);
-		param->changed = true;
+		sprite_batch_flush(effect->graphics);
 	}
+
+	set_param_val(param, data, size);
 }
 
 void effect_setbool(effect_t effect, eparam_t param, bool val)
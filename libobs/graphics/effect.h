@@ -52,9 +52,17 @@ struct effect_param {
 
 	enum shader_param_type type;
 
-	bool changed;
+	/* the value storage is reserved for the parsed type when the effect is
+	 * built and kept until the effect is destroyed.  the generation is
+	 * incremented whenever the value changes */
 	DARRAY(uint8_t) cur_val;
 	DARRAY(uint8_t) default_val;
+	uint32_t generation;
+
+	/* set when the technique was ended while sprites were still queued:
+	 * the value is logically back to its default, but the old value is
+	 * what's still loaded */
+	bool batch_stale;
 
 	effect_t effect;
 
@@ -83,6 +91,9 @@ EXPORT void effect_param_parse_property(eparam_t param,
 struct pass_shaderparam {
 	struct effect_param *eparam;
 	sparam_t sparam;
+
+	/* generation of the value last uploaded to the shader, 0 if none */
+	uint32_t uploaded;
 };
 
 struct effect_pass {
@@ -135,6 +146,22 @@ static inline void effect_technique_free(struct effect_technique *t)
 
 /* ------------------------------------------------------------------------- */
 
+/*
+ * Open addressing hash table of names to array indices, built once the
+ * effect is compiled.  Each slot holds an index plus one, 0 if it's empty.
+ */
+struct effect_name_table {
+	uint32_t *slots;
+	size_t   mask;
+};
+
+static inline void effect_name_table_free(struct effect_name_table *table)
+{
+	bfree(table->slots);
+	table->slots = NULL;
+	table->mask  = 0;
+}
+
 struct gs_effect {
 	bool processing;
 	char *effect_path, *effect_dir;
@@ -142,6 +169,9 @@ struct gs_effect {
 	DARRAY(struct effect_param) params;
 	DARRAY(struct effect_technique) techniques;
 
+	struct effect_name_table param_names;
+	struct effect_name_table technique_names;
+
 	struct effect_technique *cur_technique;
 	struct effect_pass *cur_pass;
 
@@ -164,6 +194,8 @@ static inline void effect_free(effect_t effect)
 
 	da_free(effect->params);
 	da_free(effect->techniques);
+	effect_name_table_free(&effect->param_names);
+	effect_name_table_free(&effect->technique_names);
 
 	bfree(effect->effect_path);
 	bfree(effect->effect_dir);
@@ -175,6 +207,25 @@ EXPORT void effect_upload_params(effect_t effect, bool changed_only);
 EXPORT void effect_upload_shader_params(effect_t effect, shader_t shader,
 		struct darray *pass_params, bool changed_only);
 
+/* builds the name lookup tables, called once the effect is compiled */
+extern void effect_build_name_tables(effect_t effect);
+
+/* helpers shared by the effect parser and the effect cache for building an
+ * effect: setting up a parameter once its name, type and default value are
+ * known, mapping a pass parameter to its shader parameter, and naming pass
+ * shaders in logs */
+extern void effect_param_setup(struct effect_param *param);
+extern bool effect_pass_map_param(effect_t effect,
+		struct pass_shaderparam *param, shader_t shader,
+		const char *name);
+extern void effect_shader_location(struct dstr *location, const char *file,
+		enum shader_type type, const char *tech_name, size_t pass_idx);
+
+/* sprite batching, see graphics-internal.h */
+struct sprite_batch;
+extern bool effect_batch_defaults_changed(effect_t effect);
+extern void effect_batch_flushed(struct sprite_batch *batch);
+
 #ifdef __cplusplus
 }
 #endif
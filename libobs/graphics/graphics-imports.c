@@ -89,6 +89,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_enable_stencilwrite);
 	GRAPHICS_IMPORT(device_enable_color);
 	GRAPHICS_IMPORT(device_blendfunction);
+	GRAPHICS_IMPORT(device_blendfunction_separate);
 	GRAPHICS_IMPORT(device_depthfunction);
 	GRAPHICS_IMPORT(device_stencilfunction);
 	GRAPHICS_IMPORT(device_stencilop);
@@ -106,6 +106,9 @@ struct gs_exports {
 			bool blue, bool alpha);
 	void (*device_blendfunction)(device_t device, enum gs_blend_type src,
 			enum gs_blend_type dest);
+	void (*device_blendfunction_separate)(device_t device,
+			enum gs_blend_type src_c, enum gs_blend_type dest_c,
+			enum gs_blend_type src_a, enum gs_blend_type dest_a);
 	void (*device_depthfunction)(device_t device, enum gs_depth_test test);
 	void (*device_stencilfunction)(device_t device,
 			enum gs_stencil_side side, enum gs_depth_test test);
@@ -207,13 +210,45 @@ struct gs_exports {
 	bool (*texture_rebind_iosurface)(texture_t texture, void *iosurf);
 };
 
+#define SPRITE_BATCH_VERTS (256 * 6)
+
+struct sprite_batch {
+	int                     depth;
+	vertbuffer_t            buffer;
+	uint32_t                num_verts;
+
+	/* effect bound when the queued sprites were added, and the technique
+	 * pass/technique ends that were put off to keep the batch going */
+	struct gs_effect        *effect;
+	struct effect_technique *pending_endpass;
+	struct effect_technique *pending_end;
+};
+
+/* blend state as last set through gs, so it can be pushed and popped.
+ * 'separate' is false when it was set with gs_blendfunction, which leaves
+ * the alpha factors up to the device */
+struct blend_state {
+	bool                   enabled;
+	bool                   separate;
+	enum gs_blend_type     src_c;
+	enum gs_blend_type     dest_c;
+	enum gs_blend_type     src_a;
+	enum gs_blend_type     dest_a;
+};
+
 struct graphics_subsystem {
 	void                   *module;
+	char                   *module_name;
 	device_t               device;
 	struct gs_exports      exports;
 
+	char                   *cache_path;
+
 	DARRAY(struct gs_rect) viewport_stack;
 
+	struct blend_state     cur_blend_state;
+	DARRAY(struct blend_state) blend_state_stack;
+
 	DARRAY(struct matrix3) matrix_stack;
 	size_t                 cur_matrix;
 
@@ -221,6 +256,12 @@ struct graphics_subsystem {
 	struct gs_effect       *cur_effect;
 
 	vertbuffer_t           sprite_buffer;
+	struct sprite_batch    sprite_batch;
+
+	uint32_t               draw_calls;
+	uint32_t               uniform_uploads;
+	uint32_t               frame_draw_calls;
+	uint32_t               frame_uniform_uploads;
 
 	bool                   using_immediate;
 	struct vb_data         *vbd;
@@ -233,3 +274,6 @@ struct graphics_subsystem {
 	pthread_mutex_t        mutex;
 	volatile int           ref;
 };
+
+/* draws any queued sprites */
+extern void sprite_batch_flush(struct graphics_subsystem *graphics);
@@ -26,6 +26,7 @@
 #include "quat.h"
 #include "axisang.h"
 #include "effect-parser.h"
+#include "effect-cache.h"
 #include "effect.h"
 
 #ifdef _MSC_VER
@@ -45,14 +46,18 @@ static bool graphics_init_immediate_vb(struct graphics_subsystem *graphics)
 
 	vbd = vbdata_create();
 	vbd->num     = IMMEDIATE_COUNT;
-	vbd->points  = bmalloc(sizeof(struct vec3)*IMMEDIATE_COUNT);
-	vbd->normals = bmalloc(sizeof(struct vec3)*IMMEDIATE_COUNT);
-	vbd->colors  = bmalloc(sizeof(uint32_t)   *IMMEDIATE_COUNT);
+	vbd->points  = bmalloc_tagged(sizeof(struct vec3)*IMMEDIATE_COUNT,
+			BMEM_TAG_GRAPHICS);
+	vbd->normals = bmalloc_tagged(sizeof(struct vec3)*IMMEDIATE_COUNT,
+			BMEM_TAG_GRAPHICS);
+	vbd->colors  = bmalloc_tagged(sizeof(uint32_t)   *IMMEDIATE_COUNT,
+			BMEM_TAG_GRAPHICS);
 	vbd->num_tex = 1;
 	vbd->tvarray = bmalloc(sizeof(struct tvertarray));
 	vbd->tvarray[0].width = 2;
 	vbd->tvarray[0].array =
-		bmalloc(sizeof(struct vec2) * IMMEDIATE_COUNT);
+		bmalloc_tagged(sizeof(struct vec2) * IMMEDIATE_COUNT,
+				BMEM_TAG_GRAPHICS);
 
 	graphics->immediate_vertbuffer = graphics->exports.
 		device_create_vertexbuffer(graphics->device, vbd, GS_DYNAMIC);
@@ -85,6 +90,31 @@ static bool graphics_init_sprite_vb(struct graphics_subsystem *graphics)
 	return true;
 }
 
+static bool graphics_init_sprite_batch(struct graphics_subsystem *graphics)
+{
+	struct vb_data *vbd;
+
+	vbd = vbdata_create();
+	vbd->num     = SPRITE_BATCH_VERTS;
+	vbd->points  = bmalloc(sizeof(struct vec3) * SPRITE_BATCH_VERTS);
+	vbd->num_tex = 1;
+	vbd->tvarray = bmalloc(sizeof(struct tvertarray));
+	vbd->tvarray[0].width = 2;
+	vbd->tvarray[0].array =
+		bmalloc(sizeof(struct vec2) * SPRITE_BATCH_VERTS);
+
+	memset(vbd->points, 0, sizeof(struct vec3) * SPRITE_BATCH_VERTS);
+	memset(vbd->tvarray[0].array, 0,
+			sizeof(struct vec2) * SPRITE_BATCH_VERTS);
+
+	graphics->sprite_batch.buffer = graphics->exports.
+		device_create_vertexbuffer(graphics->device, vbd, GS_DYNAMIC);
+	if (!graphics->sprite_batch.buffer)
+		return false;
+
+	return true;
+}
+
 static bool graphics_init(struct graphics_subsystem *graphics)
 {
 	struct matrix3 top_mat;
@@ -98,9 +128,19 @@ static bool graphics_init(struct graphics_subsystem *graphics)
 		return false;
 	if (!graphics_init_sprite_vb(graphics))
 		return false;
+	if (!graphics_init_sprite_batch(graphics))
+		return false;
 	if (pthread_mutex_init(&graphics->mutex, NULL) != 0)
 		return false;
 
+	/* devices don't agree on the initial blend state, so set it */
+	graphics->cur_blend_state.enabled = true;
+	graphics->cur_blend_state.src_c   = GS_BLEND_SRCALPHA;
+	graphics->cur_blend_state.dest_c  = GS_BLEND_INVSRCALPHA;
+	graphics->exports.device_enable_blending(graphics->device, true);
+	graphics->exports.device_blendfunction(graphics->device,
+			GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA);
+
 	graphics->exports.device_leavecontext(graphics->device);
 
 	return true;
@@ -115,6 +155,7 @@ int gs_create(graphics_t *pgraphics, const char *module,
 	memset(graphics, 0, sizeof(struct graphics_subsystem));
 	pthread_mutex_init_value(&graphics->mutex);
 
+	graphics->module_name = bstrdup(module);
 	graphics->module = os_dlopen(module);
 	if (!graphics->module) {
 		errcode = GS_ERROR_MODULENOTFOUND;
@@ -151,6 +192,8 @@ void gs_destroy(graphics_t graphics)
 	if (graphics->device) {
 		graphics->exports.device_entercontext(graphics->device);
 		graphics->exports.vertexbuffer_destroy(graphics->sprite_buffer);
+		graphics->exports.vertexbuffer_destroy(
+				graphics->sprite_batch.buffer);
 		graphics->exports.vertexbuffer_destroy(
 				graphics->immediate_vertbuffer);
 		graphics->exports.device_destroy(graphics->device);
@@ -159,8 +202,11 @@ void gs_destroy(graphics_t graphics)
 	pthread_mutex_destroy(&graphics->mutex);
 	da_free(graphics->matrix_stack);
 	da_free(graphics->viewport_stack);
+	da_free(graphics->blend_state_stack);
 	if (graphics->module)
 		os_dlclose(graphics->module);
+	bfree(graphics->module_name);
+	bfree(graphics->cache_path);
 	bfree(graphics);
 }
 
@@ -199,6 +245,12 @@ graphics_t gs_getcontext(void)
 	return thread_graphics;
 }
 
+static inline void flush_sprite_batch(graphics_t graphics)
+{
+	if (graphics->sprite_batch.num_verts)
+		sprite_batch_flush(graphics);
+}
+
 static inline struct matrix3 *top_matrix(graphics_t graphics)
 {
 	return graphics->matrix_stack.array + graphics->cur_matrix;
@@ -323,6 +375,8 @@ void gs_renderstart(bool b_new)
 {
 	graphics_t graphics = thread_graphics;
 
+	flush_sprite_batch(graphics);
+
 	graphics->using_immediate = !b_new;
 	reset_immediate_arrays(graphics);
 
@@ -551,6 +605,32 @@ effect_t gs_geteffect(void)
 	return thread_graphics->cur_effect;
 }
 
+void gs_set_cache_path(const char *path)
+{
+	graphics_t graphics = thread_graphics;
+
+	bfree(graphics->cache_path);
+	graphics->cache_path = bstrdup(path);
+}
+
+const char *gs_get_cache_path(void)
+{
+	return thread_graphics->cache_path;
+}
+
+uint64_t gs_cache_hash(uint64_t hash, const void *data, size_t size)
+{
+	const uint8_t *bytes = data;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
 effect_t gs_create_effect_from_file(const char *file, char **error_string)
 {
 	char *file_string;
@@ -571,20 +651,28 @@ effect_t gs_create_effect_from_file(const char *file, char **error_string)
 effect_t gs_create_effect(const char *effect_string, const char *filename,
 		char **error_string)
 {
-	struct gs_effect *effect = bmalloc(sizeof(struct gs_effect));
+	struct gs_effect *effect = bmalloc_tagged(sizeof(struct gs_effect),
+			BMEM_TAG_GRAPHICS);
 	struct effect_parser parser;
 	bool success;
 
 	memset(effect, 0, sizeof(struct gs_effect));
 	effect->graphics = thread_graphics;
 
+	if (effect_cache_load(effect, effect_string, filename))
+		return effect;
+
 	ep_init(&parser);
+	parser.keep_shaders = thread_graphics->cache_path != NULL;
+
 	success = ep_parse(&parser, effect, effect_string, filename);
 	if (!success) {
 		*error_string = error_data_buildstring(
 				&parser.cfp.error_list);
 		effect_destroy(effect);
 		effect = NULL;
+	} else {
+		effect_cache_save(effect, effect_string, &parser);
 	}
 
 	ep_free(&parser);
@@ -708,6 +796,108 @@ static inline void build_sprite_rect(struct vb_data *data, texture_t tex,
 	build_sprite(data, fcx, fcy, start_u, end_u, start_v, end_v, flip);
 }
 
+void sprite_batch_flush(struct graphics_subsystem *graphics)
+{
+	struct sprite_batch *batch = &graphics->sprite_batch;
+	struct vb_data *data = vertexbuffer_getdata(batch->buffer);
+	uint32_t num_verts = batch->num_verts;
+
+	/* cleared first, the calls below would otherwise flush again */
+	batch->num_verts = 0;
+
+	if (num_verts) {
+		data->num = num_verts;
+		vertexbuffer_flush(batch->buffer, false);
+		data->num = SPRITE_BATCH_VERTS;
+
+		if (batch->effect)
+			effect_updateparams(batch->effect);
+
+		gs_load_vertexbuffer(batch->buffer);
+		gs_load_indexbuffer(NULL);
+
+		/* the vertices are already transformed */
+		gs_matrix_push();
+		gs_matrix_identity();
+		gs_draw(GS_TRIS, 0, num_verts);
+		gs_matrix_pop();
+	}
+
+	effect_batch_flushed(batch);
+	batch->effect = NULL;
+}
+
+static inline void transform_sprite_point(struct vec3 *dst,
+		const struct vec3 *v, const struct matrix3 *m)
+{
+	struct vec3 temp;
+
+	vec3_mulf(&temp, &m->x, v->x);
+	vec3_mulf(dst, &m->y, v->y);
+	vec3_add(&temp, &temp, dst);
+	vec3_mulf(dst, &m->z, v->z);
+	vec3_add(&temp, &temp, dst);
+	vec3_add(dst, &temp, &m->t);
+}
+
+static inline bool sprite_batch_needs_flush(graphics_t graphics)
+{
+	struct sprite_batch *batch = &graphics->sprite_batch;
+
+	if (!batch->num_verts)
+		return false;
+
+	return batch->num_verts + 6 > SPRITE_BATCH_VERTS ||
+	       batch->effect != graphics->cur_effect ||
+	       effect_batch_defaults_changed(batch->effect);
+}
+
+/* adds the sprite's two triangles to the batch, transformed by the current
+ * matrix */
+static void sprite_batch_add(graphics_t graphics, texture_t tex,
+		float fcx, float fcy, uint32_t flip)
+{
+	static const size_t order[6] = {0, 1, 2, 2, 1, 3};
+
+	struct sprite_batch *batch = &graphics->sprite_batch;
+	struct vb_data *batch_data = vertexbuffer_getdata(batch->buffer);
+	struct vec3  points[4];
+	struct vec2  uvs[4];
+	struct tvertarray tvarray = {2, uvs};
+	struct vb_data sprite;
+	struct matrix3 *matrix;
+	struct vec3 *out_points;
+	struct vec2 *out_uvs;
+	size_t i;
+
+	if (sprite_batch_needs_flush(graphics))
+		sprite_batch_flush(graphics);
+
+	memset(&sprite, 0, sizeof(sprite));
+	sprite.num     = 4;
+	sprite.points  = points;
+	sprite.num_tex = 1;
+	sprite.tvarray = &tvarray;
+
+	if (texture_isrect(tex))
+		build_sprite_rect(&sprite, tex, fcx, fcy, flip);
+	else
+		build_sprite_norm(&sprite, fcx, fcy, flip);
+
+	matrix     = top_matrix(graphics);
+	out_points = batch_data->points + batch->num_verts;
+	out_uvs    = (struct vec2*)batch_data->tvarray[0].array +
+		batch->num_verts;
+
+	for (i = 0; i < 6; i++) {
+		transform_sprite_point(out_points+i, points+order[i], matrix);
+		vec2_copy(out_uvs+i, uvs+order[i]);
+	}
+
+	batch->effect     = graphics->cur_effect;
+	batch->num_verts += 6;
+}
+
 void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 		uint32_t height)
 {
@@ -725,6 +915,11 @@ void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 	fcx = width  ? (float)width  : (float)texture_getwidth(tex);
 	fcy = height ? (float)height : (float)texture_getheight(tex);
 
+	if (graphics->sprite_batch.depth && graphics->cur_effect) {
+		sprite_batch_add(graphics, tex, fcx, fcy, flip);
+		return;
+	}
+
 	data = vertexbuffer_getdata(graphics->sprite_buffer);
 	if (texture_isrect(tex))
 		build_sprite_rect(data, tex, fcx, fcy, flip);
@@ -738,6 +933,24 @@ void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 	gs_draw(GS_TRISTRIP, 0, 0);
 }
 
+void gs_sprite_batch_begin(void)
+{
+	thread_graphics->sprite_batch.depth++;
+}
+
+void gs_sprite_batch_end(void)
+{
+	graphics_t graphics = thread_graphics;
+
+	if (graphics->sprite_batch.depth && --graphics->sprite_batch.depth == 0)
+		sprite_batch_flush(graphics);
+}
+
+void gs_sprite_batch_flush(void)
+{
+	sprite_batch_flush(thread_graphics);
+}
+
 void gs_draw_cube_backdrop(texture_t cubetex, const struct quat *rot,
 		float left, float right, float top, float bottom, float znear)
 {
@@ -1006,6 +1219,8 @@ enum gs_texture_type gs_gettexturetype(texture_t texture)
 void gs_load_vertexbuffer(vertbuffer_t vertbuffer)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_vertexbuffer(graphics->device,
 			vertbuffer);
 }
@@ -1013,6 +1228,8 @@ void gs_load_vertexbuffer(vertbuffer_t vertbuffer)
 void gs_load_indexbuffer(indexbuffer_t indexbuffer)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_indexbuffer(graphics->device,
 			indexbuffer);
 }
@@ -1020,12 +1237,16 @@ void gs_load_indexbuffer(indexbuffer_t indexbuffer)
 void gs_load_texture(texture_t tex, int unit)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_texture(graphics->device, tex, unit);
 }
 
 void gs_load_samplerstate(samplerstate_t samplerstate, int unit)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_samplerstate(graphics->device,
 			samplerstate, unit);
 }
@@ -1033,6 +1254,8 @@ void gs_load_samplerstate(samplerstate_t samplerstate, int unit)
 void gs_load_vertexshader(shader_t vertshader)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_vertexshader(graphics->device,
 			vertshader);
 }
@@ -1040,6 +1263,8 @@ void gs_load_vertexshader(shader_t vertshader)
 void gs_load_pixelshader(shader_t pixelshader)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_pixelshader(graphics->device,
 			pixelshader);
 }
@@ -1047,6 +1272,8 @@ void gs_load_pixelshader(shader_t pixelshader)
 void gs_load_defaultsamplerstate(bool b_3d, int unit)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_defaultsamplerstate(graphics->device,
 			b_3d, unit);
 }
@@ -1078,6 +1305,8 @@ zstencil_t gs_getzstenciltarget(void)
 void gs_setrendertarget(texture_t tex, zstencil_t zstencil)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_setrendertarget(graphics->device, tex,
 			zstencil);
 }
@@ -1085,6 +1314,8 @@ void gs_setrendertarget(texture_t tex, zstencil_t zstencil)
 void gs_setcuberendertarget(texture_t cubetex, int side, zstencil_t zstencil)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_setcuberendertarget(graphics->device, cubetex,
 			side, zstencil);
 }
@@ -1092,12 +1323,16 @@ void gs_setcuberendertarget(texture_t cubetex, int side, zstencil_t zstencil)
 void gs_copy_texture(texture_t dst, texture_t src)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_copy_texture(graphics->device, dst, src);
 }
 
 void gs_stage_texture(stagesurf_t dst, texture_t src)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_stage_texture(graphics->device, dst, src);
 }
 
@@ -1111,6 +1346,9 @@ void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 		uint32_t num_verts)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
+	graphics->draw_calls++;
 	graphics->exports.device_draw(graphics->device, draw_mode,
 			start_vert, num_verts);
 }
@@ -1118,12 +1356,43 @@ void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 void gs_endscene(void)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_endscene(graphics->device);
 }
 
+void gs_beginframe(void)
+{
+	graphics_t graphics = thread_graphics;
+
+	graphics->draw_calls      = 0;
+	graphics->uniform_uploads = 0;
+}
+
+void gs_endframe(void)
+{
+	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
+	graphics->frame_draw_calls      = graphics->draw_calls;
+	graphics->frame_uniform_uploads = graphics->uniform_uploads;
+}
+
+uint32_t gs_get_draw_calls(void)
+{
+	return thread_graphics->frame_draw_calls;
+}
+
+uint32_t gs_get_uniform_uploads(void)
+{
+	return thread_graphics->frame_uniform_uploads;
+}
+
 void gs_load_swapchain(swapchain_t swapchain)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_load_swapchain(graphics->device, swapchain);
 }
 
@@ -1131,6 +1400,8 @@ void gs_clear(uint32_t clear_flags, struct vec4 *color, float depth,
 		uint8_t stencil)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_clear(graphics->device, clear_flags, color,
 			depth, stencil);
 }
@@ -1138,12 +1409,16 @@ void gs_clear(uint32_t clear_flags, struct vec4 *color, float depth,
 void gs_present(void)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_present(graphics->device);
 }
 
 void gs_setcullmode(enum gs_cull_mode mode)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_setcullmode(graphics->device, mode);
 }
 
@@ -1156,30 +1431,41 @@ enum gs_cull_mode gs_getcullmode(void)
 void gs_enable_blending(bool enable)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
+	graphics->cur_blend_state.enabled = enable;
 	graphics->exports.device_enable_blending(graphics->device, enable);
 }
 
 void gs_enable_depthtest(bool enable)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_enable_depthtest(graphics->device, enable);
 }
 
 void gs_enable_stenciltest(bool enable)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_enable_stenciltest(graphics->device, enable);
 }
 
 void gs_enable_stencilwrite(bool enable)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_enable_stencilwrite(graphics->device, enable);
 }
 
 void gs_enable_color(bool red, bool green, bool blue, bool alpha)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_enable_color(graphics->device, red, green,
 			blue, alpha);
 }
@@ -1187,18 +1473,69 @@ void gs_enable_color(bool red, bool green, bool blue, bool alpha)
 void gs_blendfunction(enum gs_blend_type src, enum gs_blend_type dest)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
+	graphics->cur_blend_state.separate = false;
+	graphics->cur_blend_state.src_c    = src;
+	graphics->cur_blend_state.dest_c   = dest;
 	graphics->exports.device_blendfunction(graphics->device, src, dest);
 }
 
+void gs_blendfunction_separate(enum gs_blend_type src_c,
+		enum gs_blend_type dest_c, enum gs_blend_type src_a,
+		enum gs_blend_type dest_a)
+{
+	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
+	graphics->cur_blend_state.separate = true;
+	graphics->cur_blend_state.src_c    = src_c;
+	graphics->cur_blend_state.dest_c   = dest_c;
+	graphics->cur_blend_state.src_a    = src_a;
+	graphics->cur_blend_state.dest_a   = dest_a;
+	graphics->exports.device_blendfunction_separate(graphics->device,
+			src_c, dest_c, src_a, dest_a);
+}
+
+void gs_blend_state_push(void)
+{
+	graphics_t graphics = thread_graphics;
+	da_push_back(graphics->blend_state_stack, &graphics->cur_blend_state);
+}
+
+void gs_blend_state_pop(void)
+{
+	graphics_t graphics = thread_graphics;
+	struct blend_state *state;
+
+	if (!graphics->blend_state_stack.num)
+		return;
+
+	state = da_end(graphics->blend_state_stack);
+
+	gs_enable_blending(state->enabled);
+	if (state->separate)
+		gs_blendfunction_separate(state->src_c, state->dest_c,
+				state->src_a, state->dest_a);
+	else
+		gs_blendfunction(state->src_c, state->dest_c);
+
+	da_pop_back(graphics->blend_state_stack);
+}
+
 void gs_depthfunction(enum gs_depth_test test)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_depthfunction(graphics->device, test);
 }
 
 void gs_stencilfunction(enum gs_stencil_side side, enum gs_depth_test test)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_stencilfunction(graphics->device, side, test);
 }
 
@@ -1206,6 +1543,8 @@ void gs_stencilop(enum gs_stencil_side side, enum gs_stencil_op fail,
 		enum gs_stencil_op zfail, enum gs_stencil_op zpass)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_stencilop(graphics->device, side, fail, zfail,
 			zpass);
 }
@@ -1244,6 +1583,8 @@ void gs_setcolorramp(float gamma, float brightness, float contrast)
 void gs_setviewport(int x, int y, int width, int height)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_setviewport(graphics->device, x, y, width,
 			height);
 }
@@ -1257,6 +1598,8 @@ void gs_getviewport(struct gs_rect *rect)
 void gs_setscissorrect(struct gs_rect *rect)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_setscissorrect(graphics->device, rect);
 }
 
@@ -1264,6 +1607,8 @@ void gs_ortho(float left, float right, float top, float bottom, float znear,
 		float zfar)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_ortho(graphics->device, left, right, top,
 			bottom, znear, zfar);
 }
@@ -1272,6 +1617,8 @@ void gs_frustum(float left, float right, float top, float bottom, float znear,
 		float zfar)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_frustum(graphics->device, left, right, top,
 			bottom, znear, zfar);
 }
@@ -1279,12 +1626,16 @@ void gs_frustum(float left, float right, float top, float bottom, float znear,
 void gs_projection_push(void)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_projection_push(graphics->device);
 }
 
 void gs_projection_pop(void)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.device_projection_pop(graphics->device);
 }
 
@@ -1340,18 +1691,24 @@ sparam_t shader_getworldmatrix(shader_t shader)
 void shader_setbool(shader_t shader, sparam_t param, bool val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setbool(shader, param, val);
 }
 
 void shader_setfloat(shader_t shader, sparam_t param, float val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setfloat(shader, param, val);
 }
 
 void shader_setint(shader_t shader, sparam_t param, int val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setint(shader, param, val);
 }
 
@@ -1359,6 +1716,8 @@ void shader_setmatrix3(shader_t shader, sparam_t param,
 		const struct matrix3 *val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setmatrix3(shader, param, val);
 }
 
@@ -1366,6 +1725,8 @@ void shader_setmatrix4(shader_t shader, sparam_t param,
 		const struct matrix4 *val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setmatrix4(shader, param, val);
 }
 
@@ -1373,6 +1734,8 @@ void shader_setvec2(shader_t shader, sparam_t param,
 		const struct vec2 *val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setvec2(shader, param, val);
 }
 
@@ -1380,6 +1743,8 @@ void shader_setvec3(shader_t shader, sparam_t param,
 		const struct vec3 *val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setvec3(shader, param, val);
 }
 
@@ -1387,12 +1752,16 @@ void shader_setvec4(shader_t shader, sparam_t param,
 		const struct vec4 *val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setvec4(shader, param, val);
 }
 
 void shader_settexture(shader_t shader, sparam_t param, texture_t val)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_settexture(shader, param, val);
 }
 
@@ -1400,18 +1769,24 @@ void shader_setval(shader_t shader, sparam_t param, const void *val,
 		size_t size)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setval(shader, param, val, size);
 }
 
 void shader_setdefault(shader_t shader, sparam_t param)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.shader_setdefault(shader, param);
 }
 
 void texture_destroy(texture_t tex)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	graphics->exports.texture_destroy(tex);
 }
 
@@ -1436,6 +1811,8 @@ enum gs_color_format texture_getcolorformat(texture_t tex)
 bool texture_map(texture_t tex, void **ptr, uint32_t *row_bytes)
 {
 	graphics_t graphics = thread_graphics;
+
+	flush_sprite_batch(graphics);
 	return graphics->exports.texture_map(tex, ptr, row_bytes);
 }
 
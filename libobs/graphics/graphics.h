@@ -470,6 +470,21 @@ EXPORT void gs_texcoord2v(const struct vec2 *v, int unit);
 EXPORT input_t gs_getinput(void);
 EXPORT effect_t gs_geteffect(void);
 
+/**
+ * Sets the directory for cached compiled effects and shader programs, or
+ * NULL (the default) to disable caching.  Cache files are named after a hash
+ * of whatever they were compiled from, so stale files are simply never used
+ * again.
+ */
+EXPORT void gs_set_cache_path(const char *path);
+EXPORT const char *gs_get_cache_path(void);
+
+#define GS_CACHE_HASH_INIT 14695981039346656037ULL
+
+/** hashes data for cache file names (64-bit FNV-1a), start with
+ * GS_CACHE_HASH_INIT */
+EXPORT uint64_t gs_cache_hash(uint64_t hash, const void *data, size_t size);
+
 EXPORT effect_t gs_create_effect_from_file(const char *file,
 		char **error_string);
 EXPORT effect_t gs_create_effect(const char *effect_string,
@@ -500,6 +515,22 @@ EXPORT texture_t gs_create_volumetexture_from_file(const char *flie,
 EXPORT void gs_draw_sprite(texture_t tex, uint32_t flip, uint32_t width,
 		uint32_t height);
 
+/**
+ * Batches sprites
+ *
+ *   Between gs_sprite_batch_begin and gs_sprite_batch_end, gs_draw_sprite
+ * transforms the sprite by the current matrix and queues it instead of
+ * drawing it right away.  Queued sprites are drawn together when something
+ * they depend on changes (effect parameters, techniques, shaders, textures,
+ * render states or targets), when gs_draw is called, or when the batch ends.
+ * Ending and beginning the same technique pass between sprites doesn't break
+ * the batch, so sprites drawn one after another with the same effect state
+ * share a single draw.  Batches can be nested.
+ */
+EXPORT void gs_sprite_batch_begin(void);
+EXPORT void gs_sprite_batch_end(void);
+EXPORT void gs_sprite_batch_flush(void);
+
 EXPORT void gs_draw_cube_backdrop(texture_t cubetex, const struct quat *rot,
 		float left, float right, float top, float bottom, float znear);
 
@@ -588,6 +619,18 @@ EXPORT void gs_draw(enum gs_draw_mode draw_mode, uint32_t start_vert,
 		uint32_t num_verts);
 EXPORT void gs_endscene(void);
 
+/** marks a whole frame (which may consist of several scenes) for the draw
+ * call and uniform upload counters */
+EXPORT void gs_beginframe(void);
+EXPORT void gs_endframe(void);
+
+/** returns the number of draw calls made by the last finished frame */
+EXPORT uint32_t gs_get_draw_calls(void);
+
+/** returns the number of effect parameter values uploaded to shaders by the
+ * last finished frame */
+EXPORT uint32_t gs_get_uniform_uploads(void);
+
 #define GS_CLEAR_COLOR   (1<<0)
 #define GS_CLEAR_DEPTH   (1<<1)
 #define GS_CLEAR_STENCIL (1<<2)
@@ -607,6 +650,13 @@ EXPORT void gs_enable_stencilwrite(bool enable);
 EXPORT void gs_enable_color(bool red, bool green, bool blue, bool alpha);
 
 EXPORT void gs_blendfunction(enum gs_blend_type src, enum gs_blend_type dest);
+EXPORT void gs_blendfunction_separate(enum gs_blend_type src_c,
+		enum gs_blend_type dest_c, enum gs_blend_type src_a,
+		enum gs_blend_type dest_a);
+
+/** saves/restores blending and the blend function */
+EXPORT void gs_blend_state_push(void);
+EXPORT void gs_blend_state_pop(void);
 EXPORT void gs_depthfunction(enum gs_depth_test test);
 
 EXPORT void gs_stencilfunction(enum gs_stencil_side side,
@@ -39,7 +39,8 @@ texrender_t texrender_create(enum gs_color_format format,
 		enum gs_zstencil_format zsformat)
 {
 	struct gs_texture_render *texrender;
-	texrender = bmalloc(sizeof(struct gs_texture_render));
+	texrender = bmalloc_tagged(sizeof(struct gs_texture_render),
+			BMEM_TAG_GRAPHICS);
 	memset(texrender, 0, sizeof(struct gs_texture_render));
 
 	texrender->format   = format;
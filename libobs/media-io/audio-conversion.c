@@ -0,0 +1,405 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "../util/bmem.h"
+#include "../util/darray.h"
+#include "audio-conversion.h"
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+struct audio_converter {
+	struct resample_info src;
+	struct resample_info dst;
+	size_t               src_channels;
+	size_t               dst_channels;
+
+	/* float scratch buffers for the steps that can't write to the
+	 * output directly */
+	DARRAY(float)        interleaved;
+	DARRAY(float)        src_planes;
+	DARRAY(float)        dst_planes;
+};
+
+static inline float clamp_float(float val)
+{
+	if (val > 1.0f)       return 1.0f;
+	else if (val < -1.0f) return -1.0f;
+	return val;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sample kernels */
+
+static inline void u8bit_to_float(float *out, const uint8_t *in,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = ((float)in[i] - 128.0f) / 128.0f;
+}
+
+static inline void s16_to_float(float *out, const int16_t *in, size_t count)
+{
+	__m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i val = _mm_loadu_si128((const __m128i*)(in+i));
+		__m128i lo  = _mm_srai_epi32(_mm_unpacklo_epi16(val, val), 16);
+		__m128i hi  = _mm_srai_epi32(_mm_unpackhi_epi16(val, val), 16);
+
+		_mm_storeu_ps(out+i,   _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+		_mm_storeu_ps(out+i+4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+	}
+
+	for (; i < count; i++)
+		out[i] = (float)in[i] / 32768.0f;
+}
+
+static inline void s32_to_float(float *out, const int32_t *in, size_t count)
+{
+	__m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i val = _mm_loadu_si128((const __m128i*)(in+i));
+		_mm_storeu_ps(out+i, _mm_mul_ps(_mm_cvtepi32_ps(val), scale));
+	}
+
+	for (; i < count; i++)
+		out[i] = (float)((double)in[i] / 2147483648.0);
+}
+
+static inline void float_to_u8bit(uint8_t *out, const float *in,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = (uint8_t)(clamp_float(in[i]) * 127.0f + 128.0f);
+}
+
+static inline void float_to_s16(int16_t *out, const float *in, size_t count)
+{
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+	__m128 scale   = _mm_set1_ps(32767.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128 val1 = _mm_loadu_ps(in+i);
+		__m128 val2 = _mm_loadu_ps(in+i+4);
+		__m128i ival1, ival2;
+
+		val1 = _mm_min_ps(_mm_max_ps(val1, min_val), max_val);
+		val2 = _mm_min_ps(_mm_max_ps(val2, min_val), max_val);
+		ival1 = _mm_cvtps_epi32(_mm_mul_ps(val1, scale));
+		ival2 = _mm_cvtps_epi32(_mm_mul_ps(val2, scale));
+
+		_mm_storeu_si128((__m128i*)(out+i),
+				_mm_packs_epi32(ival1, ival2));
+	}
+
+	for (; i < count; i++)
+		out[i] = (int16_t)(clamp_float(in[i]) * 32767.0f);
+}
+
+static inline void float_to_s32(int32_t *out, const float *in, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = (int32_t)((double)clamp_float(in[i]) * 2147483647.0);
+}
+
+void audio_samples_to_float(float *out, enum audio_format format,
+		const void *in, size_t count)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		u8bit_to_float(out, in, count);
+		break;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		s16_to_float(out, in, count);
+		break;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		s32_to_float(out, in, count);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		memcpy(out, in, count * sizeof(float));
+		break;
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+}
+
+void audio_float_to_samples(void *out, enum audio_format format,
+		const float *in, size_t count)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		float_to_u8bit(out, in, count);
+		break;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		float_to_s16(out, in, count);
+		break;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		float_to_s32(out, in, count);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		memcpy(out, in, count * sizeof(float));
+		break;
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+}
+
+void audio_interleave_float(float *out, const float *const in[],
+		size_t channels, size_t frames)
+{
+	size_t i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128 l = _mm_loadu_ps(in[0]+i);
+			__m128 r = _mm_loadu_ps(in[1]+i);
+			_mm_storeu_ps(out + i*2,     _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + i*2 + 4, _mm_unpackhi_ps(l, r));
+		}
+	}
+
+	for (; i < frames; i++) {
+		for (size_t ch = 0; ch < channels; ch++)
+			out[i*channels + ch] = in[ch][i];
+	}
+}
+
+void audio_deinterleave_float(float *const out[], const float *in,
+		size_t channels, size_t frames)
+{
+	size_t i = 0;
+
+	if (channels == 2) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128 a = _mm_loadu_ps(in + i*2);
+			__m128 b = _mm_loadu_ps(in + i*2 + 4);
+			_mm_storeu_ps(out[0]+i,
+					_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0)));
+			_mm_storeu_ps(out[1]+i,
+					_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1)));
+		}
+	}
+
+	for (; i < frames; i++) {
+		for (size_t ch = 0; ch < channels; ch++)
+			out[ch][i] = in[i*channels + ch];
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* speaker layouts */
+
+static inline bool layout_supported(enum speaker_layout dst,
+		enum speaker_layout src)
+{
+	if (dst == src)
+		return true;
+
+	return (src == SPEAKERS_MONO   && dst == SPEAKERS_STEREO) ||
+	       (src == SPEAKERS_STEREO && dst == SPEAKERS_MONO);
+}
+
+static void remix(float *const out[], const float *const in[],
+		enum speaker_layout dst, size_t frames)
+{
+	__m128 half = _mm_set1_ps(0.5f);
+	size_t i = 0;
+
+	if (dst == SPEAKERS_STEREO) {
+		memcpy(out[0], in[0], frames * sizeof(float));
+		memcpy(out[1], in[0], frames * sizeof(float));
+		return;
+	}
+
+	/* stereo to mono */
+	for (; i + 4 <= frames; i += 4) {
+		__m128 l = _mm_loadu_ps(in[0]+i);
+		__m128 r = _mm_loadu_ps(in[1]+i);
+		_mm_storeu_ps(out[0]+i, _mm_mul_ps(_mm_add_ps(l, r), half));
+	}
+
+	for (; i < frames; i++)
+		out[0][i] = (in[0][i] + in[1][i]) * 0.5f;
+}
+
+/* ------------------------------------------------------------------------- */
+
+audio_converter_t audio_converter_create(const struct resample_info *dst,
+		const struct resample_info *src)
+{
+	struct audio_converter *conv;
+
+	if (dst->samples_per_sec != src->samples_per_sec)
+		return NULL;
+	if (!dst->format || !src->format)
+		return NULL;
+	if (!layout_supported(dst->speakers, src->speakers))
+		return NULL;
+	if (get_audio_channels(dst->speakers) > MAX_AUDIO_CHANNELS)
+		return NULL;
+
+	conv = bmalloc(sizeof(struct audio_converter));
+	memset(conv, 0, sizeof(struct audio_converter));
+
+	conv->src          = *src;
+	conv->dst          = *dst;
+	conv->src_channels = get_audio_channels(src->speakers);
+	conv->dst_channels = get_audio_channels(dst->speakers);
+	return conv;
+}
+
+void audio_converter_destroy(audio_converter_t conv)
+{
+	if (conv) {
+		da_free(conv->interleaved);
+		da_free(conv->src_planes);
+		da_free(conv->dst_planes);
+		bfree(conv);
+	}
+}
+
+static inline void get_scratch_planes(float *planes[], size_t channels,
+		float *buffer, size_t frames)
+{
+	for (size_t i = 0; i < channels; i++)
+		planes[i] = buffer + frames * i;
+}
+
+/* converts the input to planar float in the source layout */
+static void decode_planes(struct audio_converter *conv, float *const out[],
+		const uint8_t *const in[], size_t frames)
+{
+	enum audio_format format = conv->src.format;
+	size_t channels = conv->src_channels;
+
+	if (is_audio_planar(format)) {
+		for (size_t i = 0; i < channels; i++)
+			audio_samples_to_float(out[i], format, in[i], frames);
+
+	} else if (format == AUDIO_FORMAT_FLOAT) {
+		audio_deinterleave_float(out, (const float*)in[0], channels,
+				frames);
+
+	} else {
+		da_resize(conv->interleaved, frames * channels);
+		audio_samples_to_float(conv->interleaved.array, format, in[0],
+				frames * channels);
+		audio_deinterleave_float(out, conv->interleaved.array,
+				channels, frames);
+	}
+}
+
+/* converts planar float in the destination layout to the output format */
+static void encode_planes(struct audio_converter *conv, uint8_t *const out[],
+		const float *const in[], size_t frames)
+{
+	enum audio_format format = conv->dst.format;
+	size_t channels = conv->dst_channels;
+
+	if (is_audio_planar(format)) {
+		for (size_t i = 0; i < channels; i++)
+			if ((const void*)out[i] != (const void*)in[i])
+				audio_float_to_samples(out[i], format, in[i],
+						frames);
+
+	} else if (format == AUDIO_FORMAT_FLOAT) {
+		audio_interleave_float((float*)out[0], in, channels, frames);
+
+	} else {
+		da_resize(conv->interleaved, frames * channels);
+		audio_interleave_float(conv->interleaved.array, in, channels,
+				frames);
+		audio_float_to_samples(out[0], format,
+				conv->interleaved.array, frames * channels);
+	}
+}
+
+/*
+ * Data goes through up to three steps: decode to planar float, remix, and
+ * encode to the output format.  Each step writes to the output directly
+ * when the output is planar float, so the common case of converting source
+ * audio to the mixer's format is a single pass.
+ */
+void audio_converter_convert(audio_converter_t conv,
+		uint8_t *const output[], const uint8_t *const input[],
+		uint32_t frames)
+{
+	bool same_layout  = conv->src.speakers == conv->dst.speakers;
+	bool float_planar = conv->dst.format == AUDIO_FORMAT_FLOAT_PLANAR;
+	const float *src[MAX_AUDIO_CHANNELS];
+	const float *mixed[MAX_AUDIO_CHANNELS];
+	float *planes[MAX_AUDIO_CHANNELS];
+	size_t i;
+
+	if (conv->src.format == AUDIO_FORMAT_FLOAT_PLANAR) {
+		for (i = 0; i < conv->src_channels; i++)
+			src[i] = (const float*)input[i];
+
+	} else {
+		if (float_planar && same_layout) {
+			for (i = 0; i < conv->src_channels; i++)
+				planes[i] = (float*)output[i];
+		} else {
+			da_resize(conv->src_planes,
+					frames * conv->src_channels);
+			get_scratch_planes(planes, conv->src_channels,
+					conv->src_planes.array, frames);
+		}
+
+		decode_planes(conv, planes, input, frames);
+
+		for (i = 0; i < conv->src_channels; i++)
+			src[i] = planes[i];
+	}
+
+	if (same_layout) {
+		for (i = 0; i < conv->dst_channels; i++)
+			mixed[i] = src[i];
+
+	} else {
+		if (float_planar) {
+			for (i = 0; i < conv->dst_channels; i++)
+				planes[i] = (float*)output[i];
+		} else {
+			da_resize(conv->dst_planes,
+					frames * conv->dst_channels);
+			get_scratch_planes(planes, conv->dst_channels,
+					conv->dst_planes.array, frames);
+		}
+
+		remix(planes, src, conv->dst.speakers, frames);
+
+		for (i = 0; i < conv->dst_channels; i++)
+			mixed[i] = planes[i];
+	}
+
+	encode_planes(conv, output, mixed, frames);
+}
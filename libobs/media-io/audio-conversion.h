@@ -0,0 +1,63 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-resampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Same-rate sample format and speaker layout conversion.  Any format can be
+ * converted to any other, but only identical layouts and mono <-> stereo
+ * are supported; audio_converter_create returns NULL for anything else, or
+ * when the sample rates differ, and a full resampler has to be used.
+ */
+
+struct audio_converter;
+typedef struct audio_converter *audio_converter_t;
+
+EXPORT audio_converter_t audio_converter_create(
+		const struct resample_info *dst,
+		const struct resample_info *src);
+EXPORT void audio_converter_destroy(audio_converter_t converter);
+
+/* output must hold at least 'frames' frames in the destination format */
+EXPORT void audio_converter_convert(audio_converter_t converter,
+		uint8_t *const output[], const uint8_t *const input[],
+		uint32_t frames);
+
+/* single plane conversion to and from float.  the planar and interleaved
+ * variants of a format are treated the same, and count is the total
+ * number of samples.  floats are clamped to [-1.0, 1.0] when converted
+ * to integer formats */
+EXPORT void audio_samples_to_float(float *out, enum audio_format format,
+		const void *in, size_t count);
+EXPORT void audio_float_to_samples(void *out, enum audio_format format,
+		const float *in, size_t count);
+
+EXPORT void audio_interleave_float(float *out, const float *const in[],
+		size_t channels, size_t frames);
+EXPORT void audio_deinterleave_float(float *const out[], const float *in,
+		size_t channels, size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -17,10 +17,17 @@
 
 #include "../util/threading.h"
 #include "../util/darray.h"
-#include "../util/circlebuf.h"
+#include "../util/spsc-circlebuf.h"
 #include "../util/platform.h"
 
 #include "audio-io.h"
+#include "audio-conversion.h"
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#define AUDIO_FORMAT_COUNT (AUDIO_FORMAT_FLOAT_PLANAR + 1)
+#define LINE_MAX_SEGMENTS  32
 
 struct audio_input {
 	struct audio_convert_info conversion;
@@ -28,19 +35,48 @@ struct audio_input {
 	void *param;
 };
 
+/* the mix converted to one of the output formats, shared by all inputs that
+ * want that format and reset every block */
+struct audio_mix_output {
+	bool                       converted;
+	DARRAY(uint8_t)            buffer;
+	const uint8_t              *data[MAX_AUDIO_CHANNELS];
+};
+
+/* marks the start of a run of contiguous audio in a line's buffers */
+struct line_segment {
+	uint64_t                   pos;
+	uint64_t                   timestamp;
+};
+
+/*
+ * The thread outputting to a line is the only writer of its buffers and the
+ * audio thread is the only reader, so neither side locks.  Buffer positions
+ * are counted in frames since the line was created, and a segment marker is
+ * queued whenever the data stops being contiguous in time.
+ */
 struct audio_line {
 	char                       *name;
 
 	struct audio_output        *audio;
-	struct circlebuf           buffer;
-	pthread_mutex_t            mutex;
-	DARRAY(uint8_t)            volume_buffer;
-	uint64_t                   base_timestamp;
-	uint64_t                   last_timestamp;
+	struct spsc_circlebuf      buffers[MAX_AUDIO_CHANNELS];
+	struct spsc_circlebuf      segments;
+
+	/* writer state */
+	bool                       writing;
+	struct line_segment        write_segment;
+	uint64_t                   write_pos;
+
+	/* audio thread state */
+	bool                       has_read_segment;
+	bool                       has_next_segment;
+	struct line_segment        read_segment;
+	struct line_segment        next_segment;
+	uint64_t                   read_pos;
 
 	/* states whether this line is still being used.  if not, then when the
-	 * buffer is depleted, it's destroyed */
-	bool                       alive;
+	 * buffer is depleted, it's destroyed by the audio thread */
+	volatile long              alive;
 
 	struct audio_line          **prev_next;
 	struct audio_line          *next;
@@ -48,9 +84,10 @@ struct audio_line {
 
 static inline void audio_line_destroy_data(struct audio_line *line)
 {
-	circlebuf_free(&line->buffer);
-	da_free(line->volume_buffer);
-	pthread_mutex_destroy(&line->mutex);
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++)
+		spsc_circlebuf_free(&line->buffers[i]);
+
+	spsc_circlebuf_free(&line->segments);
 	bfree(line->name);
 	bfree(line);
 }
@@ -59,33 +96,73 @@ struct audio_output {
 	struct audio_output_info   info;
 	size_t                     block_size;
 	size_t                     channels;
+	uint32_t                   block_frames;
 
 	pthread_t                  thread;
 	event_t                    stop_event;
 
 	DARRAY(uint8_t)            pending_bytes;
 
-	DARRAY(uint8_t)            mix_buffer;
+	/* line buffers and the mix are planar float, one plane per channel.
+	 * the mix is only converted to the formats the inputs want once all
+	 * lines are mixed */
+	DARRAY(float)              mix_buffers[MAX_AUDIO_CHANNELS];
+	DARRAY(float)              interleave_buffer;
+	struct audio_mix_output    mix_outputs[AUDIO_FORMAT_COUNT];
 
 	bool                       initialized;
 
+	/* line_mutex only guards the line list itself.  the audio thread mixes
+	 * from a snapshot of the list, and is the only thread that unlinks and
+	 * frees lines, which it does once it's done with the snapshot */
 	pthread_mutex_t            line_mutex;
 	struct audio_line          *first_line;
+	DARRAY(struct audio_line*) mix_lines;
+	DARRAY(struct audio_line*) dead_lines;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct audio_input) inputs;
+
+	uint64_t                   latency[AUDIO_LATENCY_BUCKETS];
 };
 
-static inline void audio_output_removeline(struct audio_output *audio,
-		struct audio_line *line)
+static inline void unlink_line(struct audio_line *line)
 {
-	pthread_mutex_lock(&audio->line_mutex);
 	*line->prev_next = line->next;
 	if (line->next)
 		line->next->prev_next = line->prev_next;
+}
+
+static void snapshot_lines(struct audio_output *audio)
+{
+	struct audio_line *line;
+
+	da_resize(audio->mix_lines, 0);
+
+	pthread_mutex_lock(&audio->line_mutex);
+	for (line = audio->first_line; line; line = line->next)
+		da_push_back(audio->mix_lines, &line);
 	pthread_mutex_unlock(&audio->line_mutex);
+}
+
+/* called by the audio thread after the mix, when nothing references the
+ * dead lines any more */
+static void reclaim_dead_lines(struct audio_output *audio)
+{
+	size_t i;
 
-	audio_line_destroy_data(line);
+	if (!audio->dead_lines.num)
+		return;
+
+	pthread_mutex_lock(&audio->line_mutex);
+	for (i = 0; i < audio->dead_lines.num; i++)
+		unlink_line(audio->dead_lines.array[i]);
+	pthread_mutex_unlock(&audio->line_mutex);
+
+	for (i = 0; i < audio->dead_lines.num; i++)
+		audio_line_destroy_data(audio->dead_lines.array[i]);
+
+	da_resize(audio->dead_lines, 0);
 }
 
 static inline uint32_t time_to_frames(audio_t audio, uint64_t offset)
@@ -97,120 +174,341 @@ static inline uint32_t time_to_frames(audio_t audio, uint64_t offset)
 	return (uint32_t)audio_offset_d;
 }
 
-static inline size_t time_to_bytes(audio_t audio, uint64_t offset)
+/* val * mul / div without overflowing as long as (div - 1) * mul fits */
+static inline uint64_t mul_div64(uint64_t val, uint64_t mul, uint64_t div)
 {
-	return time_to_frames(audio, offset) * audio->block_size;
+	return (val / div) * mul + (val % div) * mul / div;
 }
 
-/* ------------------------------------------------------------------------- */
+/* timestamp of the given line buffer position within a segment */
+static inline uint64_t segment_time(audio_t audio,
+		const struct line_segment *segment, uint64_t pos)
+{
+	return segment->timestamp + mul_div64(pos - segment->pos,
+			1000000000ULL, audio->info.samples_per_sec);
+}
+
+static inline size_t min_size(size_t a, size_t b)
+{
+	return a < b ? a : b;
+}
+
+static inline float clamp_float(float val)
+{
+	if (val > 1.0f)       return 1.0f;
+	else if (val < -1.0f) return -1.0f;
+	return val;
+}
 
-static inline void clear_excess_audio_data(struct audio_line *line,
-		uint64_t size)
+/* mix += vals */
+static inline void mix_float(float *mix, const float *vals, size_t count)
 {
-	if (size > line->buffer.size)
-		size = line->buffer.size;
+	size_t i = 0;
 
-	blog(LOG_WARNING, "Excess audio data for audio line '%s', somehow "
-	                  "audio data went back in time by %llu bytes",
-	                  line->name, size);
+	for (; i + 4 <= count; i += 4) {
+		__m128 in  = _mm_loadu_ps(vals+i);
+		__m128 out = _mm_loadu_ps(mix+i);
+		_mm_storeu_ps(mix+i, _mm_add_ps(out, in));
+	}
 
-	circlebuf_pop_front(&line->buffer, NULL, (size_t)size);
+	for (; i < count; i++)
+		mix[i] += vals[i];
 }
 
-static inline uint64_t min_uint64(uint64_t a, uint64_t b)
+/* mixes one channel directly from the line's circular buffer, then
+ * discards the data.  returns false if the data isn't there */
+static inline bool mix_line_data(struct spsc_circlebuf *buf, float *mix,
+		size_t frames)
 {
-	return a < b ? a : b;
+	void   *data1, *data2;
+	size_t size1, size2;
+	size_t size = frames * sizeof(float);
+
+	if (!spsc_circlebuf_peek_front(buf, size, &data1, &size1,
+				&data2, &size2))
+		return false;
+
+	mix_float(mix, data1, size1 / sizeof(float));
+	if (size2)
+		mix_float(mix + size1 / sizeof(float), data2,
+				size2 / sizeof(float));
+
+	spsc_circlebuf_pop_front(buf, NULL, size);
+	return true;
 }
 
-static inline void mix_audio_line(struct audio_output *audio,
-		struct audio_line *line, size_t size, uint64_t timestamp)
+/*
+ * Returns the number of frames that can be read from the line's current
+ * segment, moving on to the next segment when the read position reaches it.
+ * The data is checked before the markers: markers are queued before the data
+ * they describe, so any data seen here has its marker already visible.
+ */
+static size_t line_available_frames(struct audio_line *line)
 {
-	/* TODO: this just overwrites, handle actual mixing */
-	if (!line->buffer.size) {
-		if (!line->alive)
-			audio_output_removeline(audio, line);
-		return;
+	struct spsc_circlebuf *last = line->buffers + line->audio->channels - 1;
+	size_t frames = spsc_circlebuf_available(last) / sizeof(float);
+
+	for (;;) {
+		if (!line->has_next_segment)
+			line->has_next_segment = spsc_circlebuf_pop_front(
+					&line->segments, &line->next_segment,
+					sizeof(struct line_segment));
+
+		if (!line->has_next_segment ||
+		    line->next_segment.pos != line->read_pos)
+			break;
+
+		line->read_segment     = line->next_segment;
+		line->has_read_segment = true;
+		line->has_next_segment = false;
 	}
 
-	size_t time_offset = time_to_bytes(audio,
-			line->base_timestamp - timestamp);
-	if (time_offset > size)
-		return;
+	if (!line->has_read_segment)
+		return 0;
 
-	size -= time_offset;
+	if (line->has_next_segment)
+		frames = min_size(frames,
+				(size_t)(line->next_segment.pos - line->read_pos));
 
-	size_t pop_size = (size_t)min_uint64(size, line->buffer.size);
-	circlebuf_pop_front(&line->buffer,
-			audio->mix_buffer.array + time_offset,
-			pop_size);
+	return frames;
+}
+
+static void line_skip_frames(struct audio_line *line, size_t frames)
+{
+	for (size_t i = 0; i < line->audio->channels; i++)
+		spsc_circlebuf_pop_front(&line->buffers[i], NULL,
+				frames * sizeof(float));
+
+	line->read_pos += frames;
+}
+
+static void mix_audio_line(struct audio_output *audio,
+		struct audio_line *line, size_t frames, uint64_t timestamp)
+{
+	for (;;) {
+		size_t   available = line_available_frames(line);
+		uint64_t line_time;
+		size_t   offset, count;
+
+		if (!available)
+			return;
+
+		line_time = segment_time(audio, &line->read_segment,
+				line->read_pos);
+
+		if (line_time < timestamp) {
+			size_t excess = time_to_frames(audio,
+					timestamp - line_time);
+
+			if (excess) {
+				excess = min_size(excess, available);
+
+				blog(LOG_WARNING, "Excess audio data for audio "
+				                  "line '%s', somehow audio data "
+				                  "went back in time by %llu "
+				                  "frames", line->name,
+				                  (unsigned long long)excess);
+
+				line_skip_frames(line, excess);
+				continue;
+			}
+
+			line_time = timestamp;
+		}
+
+		offset = time_to_frames(audio, line_time - timestamp);
+		if (offset >= frames)
+			return;
+
+		count = min_size(frames - offset, available);
+
+		for (size_t i = 0; i < audio->channels; i++) {
+			if (!mix_line_data(&line->buffers[i],
+					audio->mix_buffers[i].array + offset,
+					count)) {
+				blog(LOG_ERROR, "mix_audio_line: audio line "
+				                "'%s' is missing data for "
+				                "channel %u", line->name,
+				                (unsigned int)i);
+				return;
+			}
+		}
+
+		line->read_pos += count;
+	}
+}
+
+static inline void clamp_mix(float *mix, size_t count)
+{
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_loadu_ps(mix+i);
+		val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+		_mm_storeu_ps(mix+i, val);
+	}
+
+	for (; i < count; i++)
+		mix[i] = clamp_float(mix[i]);
+}
+
+/* converts the clamped mix to the given format once per block, no matter
+ * how many inputs want it */
+static const struct audio_mix_output *get_mix_output(
+		struct audio_output *audio, enum audio_format format,
+		uint32_t frames)
+{
+	struct audio_mix_output *out = audio->mix_outputs + format;
+	size_t bytes = get_audio_bytes_per_channel(format);
+	size_t i;
+
+	if (out->converted)
+		return out;
+
+	memset(out->data, 0, sizeof(out->data));
+	out->converted = true;
+
+	if (format == AUDIO_FORMAT_FLOAT_PLANAR) {
+		for (i = 0; i < audio->channels; i++)
+			out->data[i] = (uint8_t*)audio->mix_buffers[i].array;
+
+	} else if (is_audio_planar(format)) {
+		da_resize(out->buffer, frames * audio->channels * bytes);
+
+		for (i = 0; i < audio->channels; i++) {
+			uint8_t *plane = out->buffer.array + frames * bytes * i;
+			audio_float_to_samples(plane, format,
+					audio->mix_buffers[i].array, frames);
+			out->data[i] = plane;
+		}
+
+	} else {
+		size_t count = frames * audio->channels;
+		const float *planes[MAX_AUDIO_CHANNELS];
+
+		for (i = 0; i < audio->channels; i++)
+			planes[i] = audio->mix_buffers[i].array;
+
+		da_resize(audio->interleave_buffer, count);
+		audio_interleave_float(audio->interleave_buffer.array, planes,
+				audio->channels, frames);
+
+		if (format == AUDIO_FORMAT_FLOAT) {
+			out->data[0] = (uint8_t*)audio->interleave_buffer.array;
+		} else {
+			da_resize(out->buffer, count * bytes);
+			audio_float_to_samples(out->buffer.array, format,
+					audio->interleave_buffer.array, count);
+			out->data[0] = out->buffer.array;
+		}
+	}
+
+	return out;
 }
 
 static inline void do_audio_output(struct audio_output *audio,
 		uint64_t timestamp, uint32_t frames)
 {
 	struct audio_data data;
-	data.data = audio->mix_buffer.array;
+	size_t i;
+
+	for (i = 0; i < AUDIO_FORMAT_COUNT; i++)
+		audio->mix_outputs[i].converted = false;
+
 	data.frames = frames;
 	data.timestamp = timestamp;
 	data.volume = 1.0f;
 
-	/* TODO: conversion */
+	/* TODO: sample rate and speaker layout conversion */
 	pthread_mutex_lock(&audio->input_mutex);
-	for (size_t i = 0; i < audio->inputs.num; i++) {
+	for (i = 0; i < audio->inputs.num; i++) {
 		struct audio_input *input = audio->inputs.array+i;
+		const struct audio_mix_output *output = get_mix_output(audio,
+				input->conversion.format, frames);
+
+		memcpy(data.data, output->data, sizeof(data.data));
 		input->callback(input->param, &data);
 	}
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static void mix_and_output(struct audio_output *audio, uint64_t audio_time,
-		uint64_t prev_time)
+static void mix_and_output(struct audio_output *audio, uint64_t prev_time)
 {
-	struct audio_line *line = audio->first_line;
-	uint64_t time_offset = audio_time - prev_time;
-	uint32_t frames = time_to_frames(audio, time_offset);
-	size_t bytes = frames * audio->block_size;
+	uint32_t frames = audio->block_frames;
+	size_t bytes = frames * sizeof(float);
+	size_t i;
 
-	da_resize(audio->mix_buffer, bytes);
-	memset(audio->mix_buffer.array, 0, bytes);
+	for (i = 0; i < audio->channels; i++) {
+		da_resize(audio->mix_buffers[i], frames);
+		memset(audio->mix_buffers[i].array, 0, bytes);
+	}
 
-	while (line) {
-		struct audio_line *next = line->next;
+	snapshot_lines(audio);
 
-		if (line->buffer.size && line->base_timestamp < prev_time) {
-			clear_excess_audio_data(line,
-					prev_time - line->base_timestamp);
-			line->base_timestamp = prev_time;
-		}
+	for (i = 0; i < audio->mix_lines.num; i++) {
+		struct audio_line *line = audio->mix_lines.array[i];
+		bool alive = os_atomic_load_long(&line->alive) != 0;
 
-		mix_audio_line(audio, line, bytes, prev_time);
-		line->base_timestamp = audio_time;
-		line = next;
+		mix_audio_line(audio, line, frames, prev_time);
+
+		/* lines are only removed once their data has been played */
+		if (!alive && !line_available_frames(line) &&
+		    !line->has_next_segment)
+			da_push_back(audio->dead_lines, &line);
 	}
 
+	for (i = 0; i < audio->channels; i++)
+		clamp_mix(audio->mix_buffers[i].array, frames);
+
 	do_audio_output(audio, prev_time, frames);
+
+	reclaim_dead_lines(audio);
+}
+
+/* time from the start of the clock to the start of the given block */
+static inline uint64_t block_offset(struct audio_output *audio,
+		uint64_t block)
+{
+	return mul_div64(block * audio->block_frames, 1000000000ULL,
+			audio->info.samples_per_sec);
 }
 
-/* sample audio 40 times a second */
-#define AUDIO_WAIT_TIME (1000/40)
+static inline void record_latency(struct audio_output *audio,
+		uint64_t latency)
+{
+	size_t i = 0;
 
+	while (i < AUDIO_LATENCY_BUCKETS - 1 &&
+	       latency >= (AUDIO_LATENCY_BUCKET_BASE << i))
+		i++;
+
+	audio->latency[i]++;
+}
+
+/*
+ * Blocks are always block_frames long and are mixed when their end time is
+ * reached, so encoders get constant-sized packets.  Deadlines are absolute,
+ * and blocks that are late are mixed back to back until caught up.
+ */
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = audio->info.buffer_ms * 1000000;
-	uint64_t prev_time = os_gettime_ns() - buffer_time;
-	uint64_t audio_time;
+	uint64_t start_time  = os_gettime_ns();
+	uint64_t block       = 0;
 
 	while (event_try(&audio->stop_event) == EAGAIN) {
-		os_sleep_ms(AUDIO_WAIT_TIME);
+		uint64_t prev_time = start_time + block_offset(audio, block);
+		uint64_t deadline  = start_time + block_offset(audio, block+1);
 
-		pthread_mutex_lock(&audio->line_mutex);
+		os_sleepto_ns(deadline);
+		record_latency(audio, os_gettime_ns() - deadline);
 
-		audio_time = os_gettime_ns() - buffer_time;
-		mix_and_output(audio, audio_time, prev_time);
-		prev_time = audio_time;
+		mix_and_output(audio, prev_time - buffer_time);
 
-		pthread_mutex_unlock(&audio->line_mutex);
+		block++;
 	}
 
 	return NULL;
@@ -238,12 +536,12 @@ void audio_output_connect(audio_t audio,
 {
 	pthread_mutex_lock(&audio->input_mutex);
 
-	if (audio_get_input_idx(audio, callback, param) != DARRAY_INVALID) {
+	if (audio_get_input_idx(audio, callback, param) == DARRAY_INVALID) {
 		struct audio_input input;
 		input.callback = callback;
 		input.param    = param;
 
-		/* TODO: conversion */
+		/* TODO: sample rate and speaker layout conversion */
 		if (conversion) {
 			input.conversion = *conversion;
 		} else {
@@ -253,6 +551,10 @@ void audio_output_connect(audio_t audio,
 				audio->info.samples_per_sec;
 		}
 
+		if (input.conversion.format == AUDIO_FORMAT_UNKNOWN ||
+		    input.conversion.format >= AUDIO_FORMAT_COUNT)
+			input.conversion.format = audio->info.format;
+
 		da_push_back(audio->inputs, &input);
 	}
 
@@ -274,14 +576,15 @@ void audio_output_disconnect(audio_t audio,
 
 static inline bool valid_audio_params(struct audio_output_info *info)
 {
-	return info->format && info->name && info->samples_per_sec > 0 &&
-	       info->speakers > 0;
+	return info->format && info->format < AUDIO_FORMAT_COUNT &&
+	       info->name && info->samples_per_sec > 0 &&
+	       info->speakers > 0 &&
+	       get_audio_channels(info->speakers) <= MAX_AUDIO_CHANNELS;
 }
 
 int audio_output_open(audio_t *audio, struct audio_output_info *info)
 {
 	struct audio_output *out;
-	pthread_mutexattr_t attr;
 
 	if (!valid_audio_params(info))
 		return AUDIO_OUTPUT_INVALIDPARAM;
@@ -294,12 +597,11 @@ int audio_output_open(audio_t *audio, struct audio_output_info *info)
 	out->channels = get_audio_channels(info->speakers);
 	out->block_size = out->channels *
 	                  get_audio_bytes_per_channel(info->format);
+	out->block_frames = info->frames_per_block ?
+		info->frames_per_block : AUDIO_OUTPUT_FRAMES;
+	out->info.frames_per_block = out->block_frames;
 
-	if (pthread_mutexattr_init(&attr) != 0)
-		goto fail;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		goto fail;
-	if (pthread_mutex_init(&out->line_mutex, &attr) != 0)
+	if (pthread_mutex_init(&out->line_mutex, NULL) != 0)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, NULL) != 0)
 		goto fail;
@@ -317,6 +619,33 @@ fail:
 	return AUDIO_OUTPUT_FAIL;
 }
 
+static void log_latency_histogram(struct audio_output *audio)
+{
+	uint64_t total = 0;
+	size_t i;
+
+	for (i = 0; i < AUDIO_LATENCY_BUCKETS; i++)
+		total += audio->latency[i];
+	if (!total)
+		return;
+
+	blog(LOG_INFO, "audio output '%s': %llu blocks of %u frames, "
+	               "mix latency:", audio->info.name,
+	               (unsigned long long)total, audio->block_frames);
+
+	for (i = 0; i < AUDIO_LATENCY_BUCKETS; i++) {
+		double limit = (double)(AUDIO_LATENCY_BUCKET_BASE << i) /
+			1000000.0;
+
+		if (i < AUDIO_LATENCY_BUCKETS - 1)
+			blog(LOG_INFO, "\t< %6.2f ms: %llu", limit,
+					(unsigned long long)audio->latency[i]);
+		else
+			blog(LOG_INFO, "\t>= %5.2f ms: %llu", limit / 2.0,
+					(unsigned long long)audio->latency[i]);
+	}
+}
+
 void audio_output_close(audio_t audio)
 {
 	void *thread_ret;
@@ -337,26 +666,42 @@ void audio_output_close(audio_t audio)
 		line = next;
 	}
 
-	da_free(audio->mix_buffer);
+	log_latency_histogram(audio);
+
+	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++)
+		da_free(audio->mix_buffers[i]);
+	for (size_t i = 0; i < AUDIO_FORMAT_COUNT; i++)
+		da_free(audio->mix_outputs[i].buffer);
+
+	da_free(audio->mix_lines);
+	da_free(audio->dead_lines);
+	da_free(audio->interleave_buffer);
 	da_free(audio->pending_bytes);
+	da_free(audio->inputs);
 	event_destroy(&audio->stop_event);
 	pthread_mutex_destroy(&audio->line_mutex);
+	pthread_mutex_destroy(&audio->input_mutex);
 	bfree(audio);
 }
 
 audio_line_t audio_output_createline(audio_t audio, const char *name)
 {
 	struct audio_line *line = bmalloc(sizeof(struct audio_line));
+	size_t line_frames = (size_t)audio->info.samples_per_sec *
+		(audio->info.buffer_ms + 1000) / 1000;
+
 	memset(line, 0, sizeof(struct audio_line));
-	line->alive = true;
+	line->alive = 1;
 	line->audio = audio;
 
-	if (pthread_mutex_init(&line->mutex, NULL) != 0) {
-		blog(LOG_ERROR, "audio_output_createline: Failed to create "
-		                "mutex");
-		bfree(line);
-		return NULL;
-	}
+	for (size_t i = 0; i < audio->channels; i++)
+		spsc_circlebuf_init_tagged(&line->buffers[i],
+				line_frames * sizeof(float), BMEM_TAG_AUDIO);
+
+	spsc_circlebuf_init(&line->segments,
+			LINE_MAX_SEGMENTS * sizeof(struct line_segment));
+
+	line->name = bstrdup(name ? name : "(unnamed audio line)");
 
 	pthread_mutex_lock(&audio->line_mutex);
 
@@ -369,8 +714,6 @@ audio_line_t audio_output_createline(audio_t audio, const char *name)
 	audio->first_line = line;
 
 	pthread_mutex_unlock(&audio->line_mutex);
-
-	line->name = bstrdup(name ? name : "(unnamed audio line)");
 	return line;
 }
 
@@ -379,14 +722,12 @@ const struct audio_output_info *audio_output_getinfo(audio_t audio)
 	return &audio->info;
 }
 
+/* the line is freed by the audio thread once its remaining data has been
+ * mixed, so this never blocks on the mix */
 void audio_line_destroy(struct audio_line *line)
 {
-	if (line) {
-		if (!line->buffer.size)
-			audio_output_removeline(line->audio, line);
-		else
-			line->alive = false;
-	}
+	if (line)
+		os_atomic_set_long(&line->alive, 0);
 }
 
 size_t audio_output_blocksize(audio_t audio)
@@ -394,140 +735,145 @@ size_t audio_output_blocksize(audio_t audio)
 	return audio->block_size;
 }
 
-static inline void mul_vol_u8bit(struct audio_line *line, float volume,
-		size_t total_num)
+uint32_t audio_output_block_frames(audio_t audio)
 {
-	uint8_t *vals = line->volume_buffer.array;
-	int16_t vol = (int16_t)(volume * 127.0f);
-
-	for (size_t i = 0; i < total_num; i++) {
-		int16_t val = (int16_t)(vals[i] ^ 0x80) << 8;
-		vals[i] = (uint8_t)((val * vol / 127) + 128);
-	}
+	return audio->block_frames;
 }
 
-static inline void mul_vol_16bit(struct audio_line *line, float volume,
-		size_t total_num)
+void audio_output_get_latency_histogram(audio_t audio,
+		uint64_t buckets[AUDIO_LATENCY_BUCKETS])
 {
-	uint16_t *vals = (uint16_t*)line->volume_buffer.array;
-	int32_t vol = (int32_t)(volume * 32767.0f);
-
-	for (size_t i = 0; i < total_num; i++)
-		vals[i] = (int32_t)((int32_t)vals[i] * vol / 32767);
+	memcpy(buckets, audio->latency,
+			sizeof(uint64_t) * AUDIO_LATENCY_BUCKETS);
 }
 
-static inline float conv_24bit_to_float(uint8_t *vals)
+/* dst = src * vol */
+static inline void scale_float(float *dst, const float *src, size_t count,
+		float vol)
 {
-	int32_t val = ((int32_t)vals[0]) |
-	              ((int32_t)vals[1] << 8) |
-	              ((int32_t)vals[2] << 16);
+	__m128 vol_val = _mm_set1_ps(vol);
+	size_t i = 0;
+
+	if (vol == 1.0f) {
+		memcpy(dst, src, count * sizeof(float));
+		return;
+	}
 
-	if ((val & 0x800000) != 0)
-		val |= 0xFF000000;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst+i, _mm_mul_ps(_mm_loadu_ps(src+i), vol_val));
 
-	return (float)val / 8388607.0f;
+	for (; i < count; i++)
+		dst[i] = src[i] * vol;
 }
 
-static inline void conv_float_to_24bit(float fval, uint8_t *vals)
+/* fills one span of reserved buffer space: silence while there's padding
+ * left, then the source data with volume applied */
+static inline void write_line_span(float *dst, size_t count, size_t *pad,
+		const float **src, float vol)
 {
-	int32_t val = (int32_t)(fval * 8388607.0f);
-	vals[0] = (val)       & 0xFF;
-	vals[1] = (val >> 8)  & 0xFF;
-	vals[2] = (val >> 16) & 0xFF;
-}
+	size_t zeros = min_size(*pad, count);
 
-static inline void mul_vol_24bit(struct audio_line *line, float volume,
-		size_t total_num)
-{
-	uint8_t *vals = line->volume_buffer.array;
+	memset(dst, 0, zeros * sizeof(float));
+	scale_float(dst + zeros, *src, count - zeros, vol);
 
-	for (size_t i = 0; i < total_num; i++) {
-		float val = conv_24bit_to_float(vals) * volume;
-		conv_float_to_24bit(val, vals);
-		vals += 3;
-	}
+	*pad -= zeros;
+	*src += count - zeros;
 }
 
-static inline void mul_vol_32bit(struct audio_line *line, float volume,
-		size_t total_num)
+static bool write_line_data(struct spsc_circlebuf *buf, size_t pad,
+		const float *src, size_t frames, float vol)
 {
-	int32_t *vals = (int32_t*)line->volume_buffer.array;
+	void   *data1, *data2;
+	size_t size1, size2;
+	size_t size = (pad + frames) * sizeof(float);
 
-	for (size_t i = 0; i < total_num; i++) {
-		float val = (float)vals[i] / 2147483647.0f;
-		vals[i] = (int32_t)(val * volume / 2147483647.0f);
-	}
-}
+	if (!spsc_circlebuf_reserve_back(buf, size, &data1, &size1,
+				&data2, &size2))
+		return false;
 
-static inline void mul_vol_float(struct audio_line *line, float volume,
-		size_t total_num)
-{
-	float *vals = (float*)line->volume_buffer.array;
+	write_line_span(data1, size1 / sizeof(float), &pad, &src, vol);
+	if (size2)
+		write_line_span(data2, size2 / sizeof(float), &pad, &src, vol);
 
-	for (size_t i = 0; i < total_num; i++)
-		vals[i] *= volume;
+	spsc_circlebuf_commit_back(buf, size);
+	return true;
 }
 
-static void audio_line_place_data_pos(struct audio_line *line,
-		const struct audio_data *data, size_t position)
+/*
+ * Data that continues the current segment is placed right after it, with
+ * small gaps filled with silence and overlaps trimmed.  When the line is
+ * empty or the timestamps jump by more than the buffering time, a new segment
+ * is started instead.  Channels are committed in order and the audio thread
+ * reads them in order, so only the last channel has to be checked for space.
+ */
+void audio_line_output(audio_line_t line, const struct audio_data *data)
 {
-	size_t total_num  = data->frames * line->audio->channels;
-	size_t total_size = data->frames * line->audio->block_size;
-
-	da_copy_array(line->volume_buffer, data->data, total_size);
-
-	switch (line->audio->info.format) {
-	case AUDIO_FORMAT_U8BIT:
-		mul_vol_u8bit(line, data->volume, total_num);
-		break;
-	case AUDIO_FORMAT_16BIT:
-		mul_vol_16bit(line, data->volume, total_num);
-		break;
-	case AUDIO_FORMAT_32BIT:
-		mul_vol_32bit(line, data->volume, total_num);
-		break;
-	case AUDIO_FORMAT_FLOAT:
-		mul_vol_float(line, data->volume, total_num);
-		break;
-	case AUDIO_FORMAT_UNKNOWN:
-		break;
+	struct audio_output   *audio = line->audio;
+	struct spsc_circlebuf *last  = line->buffers + audio->channels - 1;
+	uint64_t buffer_time = audio->info.buffer_ms * 1000000ULL;
+	size_t   free_frames = spsc_circlebuf_free_space(last) / sizeof(float);
+	bool     new_segment = !line->writing || free_frames == last->capacity /
+	                       sizeof(float);
+	size_t   pad = 0, skip = 0, frames;
+
+	if (!new_segment) {
+		uint64_t next_ts = segment_time(audio, &line->write_segment,
+				line->write_pos);
+
+		if (data->timestamp >= next_ts &&
+		    data->timestamp - next_ts <= buffer_time)
+			pad = time_to_frames(audio, data->timestamp - next_ts);
+		else if (data->timestamp < next_ts &&
+		         next_ts - data->timestamp <= buffer_time)
+			skip = time_to_frames(audio, next_ts - data->timestamp);
+		else
+			new_segment = true;
 	}
 
-	circlebuf_place(&line->buffer, position, line->volume_buffer.array,
-			total_size);
-}
-
-static inline void audio_line_place_data(struct audio_line *line,
-		const struct audio_data *data)
-{
-	uint64_t time_offset = data->timestamp - line->base_timestamp;
-	size_t pos = time_to_bytes(line->audio, time_offset);
+	if (skip >= data->frames) {
+		blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
+		                "data->timestamp: %llu, already have data "
+		                "up to %llu frames after it.  This can "
+		                "sometimes happen when there's a pause in "
+		                "the threads.", line->name,
+		                (unsigned long long)data->timestamp,
+		                (unsigned long long)skip);
+		return;
+	}
 
-	audio_line_place_data_pos(line, data, pos);
-}
+	frames = data->frames - skip;
 
-void audio_line_output(audio_line_t line, const struct audio_data *data)
-{
-	/* TODO: prevent insertation of data too far away from expected
-	 * audio timing */
+	if (pad + frames > free_frames) {
+		blog(LOG_DEBUG, "Audio line '%s' is full, dropping %u frames",
+				line->name, data->frames);
+		return;
+	}
 
-	pthread_mutex_lock(&line->mutex);
+	if (new_segment) {
+		struct line_segment segment = {line->write_pos, data->timestamp};
 
-	if (!line->buffer.size) {
-		line->base_timestamp = data->timestamp;
-		audio_line_place_data_pos(line, data, 0);
+		if (!spsc_circlebuf_push_back(&line->segments, &segment,
+					sizeof(struct line_segment))) {
+			blog(LOG_DEBUG, "Audio line '%s' has too many "
+			                "pending segments, dropping %u frames",
+			                line->name, data->frames);
+			return;
+		}
 
-	} else if (line->base_timestamp <= data->timestamp) {
-		audio_line_place_data(line, data);
+		line->write_segment = segment;
+		line->writing       = true;
+	}
 
-	} else {
-		blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
-		                "data->timestamp: %llu, "
-		                "line->base_timestamp: %llu.  This can "
-		                "sometimes happen when there's a pause in "
-		                "the threads.", line->name, data->timestamp,
-		                line->base_timestamp);
+	for (size_t i = 0; i < audio->channels; i++) {
+		if (!write_line_data(&line->buffers[i], pad,
+				(const float*)data->data[i] + skip, frames,
+				data->volume)) {
+			blog(LOG_ERROR, "audio_line_output: no space in "
+			                "channel %u of audio line '%s'",
+			                (unsigned int)i, line->name);
+			return;
+		}
 	}
 
-	pthread_mutex_unlock(&line->mutex);
+	line->write_pos += pad + frames;
 }
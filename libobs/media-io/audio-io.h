@@ -33,12 +33,20 @@ struct audio_line;
 typedef struct audio_output *audio_t;
 typedef struct audio_line   *audio_line_t;
 
+#define MAX_AUDIO_CHANNELS 8
+
 enum audio_format {
 	AUDIO_FORMAT_UNKNOWN,
+
 	AUDIO_FORMAT_U8BIT,
 	AUDIO_FORMAT_16BIT,
 	AUDIO_FORMAT_32BIT,
 	AUDIO_FORMAT_FLOAT,
+
+	AUDIO_FORMAT_U8BIT_PLANAR,
+	AUDIO_FORMAT_16BIT_PLANAR,
+	AUDIO_FORMAT_32BIT_PLANAR,
+	AUDIO_FORMAT_FLOAT_PLANAR,
 };
 
 enum speaker_layout {
@@ -55,8 +63,15 @@ enum speaker_layout {
 	SPEAKERS_SURROUND,
 };
 
+/*
+ * Planar formats store each channel in its own plane, data[0] through
+ * data[channels-1].  Interleaved formats only use data[0].
+ *
+ * Audio lines and the mix are always AUDIO_FORMAT_FLOAT_PLANAR, so data
+ * passed to audio_line_output must be in that format.
+ */
 struct audio_data {
-	const void          *data;
+	const uint8_t       *data[MAX_AUDIO_CHANNELS];
 	uint32_t            frames;
 	uint64_t            timestamp;
 	float               volume;
@@ -66,9 +81,12 @@ struct audio_output_info {
 	const char          *name;
 
 	uint32_t            samples_per_sec;
-	enum audio_format   format;
+	enum audio_format   format; /* default format sent to outputs */
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/* frames mixed and output per block, 0 for AUDIO_OUTPUT_FRAMES */
+	uint32_t            frames_per_block;
 };
 
 struct audio_convert_info {
@@ -99,16 +117,56 @@ static inline uint32_t get_audio_channels(enum speaker_layout speakers)
 static inline size_t get_audio_bytes_per_channel(enum audio_format type)
 {
 	switch (type) {
-	case AUDIO_FORMAT_U8BIT:   return 1;
-	case AUDIO_FORMAT_16BIT:   return 2;
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		return 1;
+
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		return 2;
+
 	case AUDIO_FORMAT_FLOAT:
-	case AUDIO_FORMAT_32BIT:   return 4;
-	case AUDIO_FORMAT_UNKNOWN: return 0;
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return 4;
+
+	case AUDIO_FORMAT_UNKNOWN:
+		return 0;
 	}
 
 	return 0;
 }
 
+static inline bool is_audio_planar(enum audio_format type)
+{
+	switch (type) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_FLOAT:
+		return false;
+
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return true;
+
+	case AUDIO_FORMAT_UNKNOWN:
+		return false;
+	}
+
+	return false;
+}
+
+static inline size_t get_audio_planes(enum audio_format type,
+		enum speaker_layout speakers)
+{
+	return (is_audio_planar(type) ? get_audio_channels(speakers) : 1);
+}
+
+/* total size of the audio data for all planes */
 static inline size_t get_audio_size(enum audio_format type,
 		enum speaker_layout speakers, uint32_t frames)
 {
@@ -117,6 +175,23 @@ static inline size_t get_audio_size(enum audio_format type,
 	       frames;
 }
 
+/* size of each plane of the audio data */
+static inline size_t get_audio_plane_size(enum audio_format type,
+		enum speaker_layout speakers, uint32_t frames)
+{
+	size_t planes = get_audio_planes(type, speakers);
+	return planes ? get_audio_size(type, speakers, frames) / planes : 0;
+}
+
+/* default number of frames per output block */
+#define AUDIO_OUTPUT_FRAMES 1024
+
+/* the audio thread's wake-up latency is tracked in a histogram.  bucket i
+ * counts blocks mixed less than (250us << i) after their deadline, and the
+ * last bucket counts everything later than that */
+#define AUDIO_LATENCY_BUCKETS       8
+#define AUDIO_LATENCY_BUCKET_BASE   250000ULL
+
 #define AUDIO_OUTPUT_SUCCESS       0
 #define AUDIO_OUTPUT_INVALIDPARAM -1
 #define AUDIO_OUTPUT_FAIL         -2
@@ -124,6 +199,8 @@ static inline size_t get_audio_size(enum audio_format type,
 EXPORT int audio_output_open(audio_t *audio, struct audio_output_info *info);
 EXPORT void audio_output_close(audio_t audio);
 
+/* conversion->format selects the format the callback receives the mix in.
+ * sample rate and speaker layout conversion are not yet supported */
 EXPORT void audio_output_connect(audio_t video,
 		struct audio_convert_info *conversion,
 		void (*callback)(void *param, const struct audio_data *data),
@@ -133,8 +210,16 @@ EXPORT void audio_output_disconnect(audio_t video,
 		void *param);
 
 EXPORT size_t audio_output_blocksize(audio_t audio);
+EXPORT uint32_t audio_output_block_frames(audio_t audio);
+EXPORT void audio_output_get_latency_histogram(audio_t audio,
+		uint64_t buckets[AUDIO_LATENCY_BUCKETS]);
 EXPORT const struct audio_output_info *audio_output_getinfo(audio_t audio);
 
+/*
+ * Lines are lock-free: one thread at a time may output to a line while the
+ * audio thread mixes it.  Data that doesn't fit in the line's buffer (about
+ * a second past buffer_ms) is dropped rather than blocking the caller.
+ */
 EXPORT audio_line_t audio_output_createline(audio_t audio, const char *name);
 EXPORT void audio_line_destroy(audio_line_t line);
 EXPORT void audio_line_output(audio_line_t line, const struct audio_data *data);
@@ -17,11 +17,15 @@
 
 #include "../util/bmem.h"
 #include "audio-resampler.h"
+#include "audio-conversion.h"
 #include <libavutil/opt.h>
 #include <libavutil/channel_layout.h>
 #include <libswresample/swresample.h>
 
 struct audio_resampler {
+	/* same-rate conversions don't need swresample */
+	audio_converter_t   converter;
+
 	struct SwrContext   *context;
 	bool                opened;
 
@@ -29,12 +33,13 @@ struct audio_resampler {
 	uint64_t            input_layout;
 	enum AVSampleFormat input_format;
 
-	uint8_t             *output_buffer;
+	uint8_t             *output_buffer[MAX_AUDIO_CHANNELS];
 	uint64_t            output_layout;
 	enum AVSampleFormat output_format;
 	int                 output_size;
 	uint32_t            output_ch;
 	uint32_t            output_freq;
+	uint32_t            output_planes;
 };
 
 static inline enum AVSampleFormat convert_audio_format(enum audio_format format)
@@ -45,6 +50,11 @@ static inline enum AVSampleFormat convert_audio_format(enum audio_format format)
 	case AUDIO_FORMAT_16BIT:   return AV_SAMPLE_FMT_S16;
 	case AUDIO_FORMAT_32BIT:   return AV_SAMPLE_FMT_S32;
 	case AUDIO_FORMAT_FLOAT:   return AV_SAMPLE_FMT_FLT;
+
+	case AUDIO_FORMAT_U8BIT_PLANAR: return AV_SAMPLE_FMT_U8P;
+	case AUDIO_FORMAT_16BIT_PLANAR: return AV_SAMPLE_FMT_S16P;
+	case AUDIO_FORMAT_32BIT_PLANAR: return AV_SAMPLE_FMT_S32P;
+	case AUDIO_FORMAT_FLOAT_PLANAR: return AV_SAMPLE_FMT_FLTP;
 	}
 
 	/* shouldn't get here */
@@ -77,16 +87,23 @@ audio_resampler_t audio_resampler_create(struct resample_info *dst,
 	struct audio_resampler *rs = bmalloc(sizeof(struct audio_resampler));
 	int errcode;
 
+	memset(rs->output_buffer, 0, sizeof(rs->output_buffer));
+
+	rs->converter     = audio_converter_create(dst, src);
+	rs->context       = NULL;
 	rs->opened        = false;
 	rs->input_freq    = src->samples_per_sec;
 	rs->input_layout  = convert_speaker_layout(src->speakers);
 	rs->input_format  = convert_audio_format(src->format);
-	rs->output_buffer = NULL;
 	rs->output_size   = 0;
 	rs->output_ch     = get_audio_channels(dst->speakers);
 	rs->output_freq   = dst->samples_per_sec;
 	rs->output_layout = convert_speaker_layout(dst->speakers);
 	rs->output_format = convert_audio_format(dst->format);
+	rs->output_planes = is_audio_planar(dst->format) ? rs->output_ch : 1;
+
+	if (rs->converter)
+		return rs;
 
 	rs->context = swr_alloc_set_opts(NULL,
 		rs->output_layout, rs->output_format, dst->samples_per_sec,
@@ -113,50 +130,91 @@ audio_resampler_t audio_resampler_create(struct resample_info *dst,
 void audio_resampler_destroy(audio_resampler_t rs)
 {
 	if (rs) {
+		audio_converter_destroy(rs->converter);
 		if (rs->context)
 			swr_free(&rs->context);
-		if (rs->output_buffer)
-			av_freep(&rs->output_buffer);
+		if (rs->output_buffer[0])
+			av_freep(&rs->output_buffer[0]);
 
 		bfree(rs);
 	}
 }
 
-bool audio_resampler_resample(audio_resampler_t rs,
-		 void **output, uint32_t *out_frames,
-		 const void *input, uint32_t in_frames,
-		 uint64_t *timestamp_offset)
+uint32_t audio_resampler_max_output(audio_resampler_t rs, uint32_t in_frames)
 {
-	struct SwrContext *context = rs->context;
-	int ret;
-	int64_t delay = swr_get_delay(context, rs->input_freq);
-	int estimated = (int)av_rescale_rnd(
-			delay + (int64_t)in_frames,
+	if (rs->converter)
+		return in_frames;
+
+#if LIBSWRESAMPLE_VERSION_INT >= AV_VERSION_INT(1, 2, 0)
+	int out = swr_get_out_samples(rs->context, (int)in_frames);
+	return out > 0 ? (uint32_t)out : 0;
+#else
+	int64_t delay = swr_get_delay(rs->context, rs->input_freq);
+	return (uint32_t)av_rescale_rnd(delay + (int64_t)in_frames,
 			(int64_t)rs->output_freq, (int64_t)rs->input_freq,
 			AV_ROUND_UP);
+#endif
+}
 
-	*timestamp_offset = (uint64_t)swr_get_delay(context, 1000000000);
+bool audio_resampler_resample_to(audio_resampler_t rs,
+		 uint8_t *const output[], uint32_t max_frames,
+		 uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
+		 uint64_t *timestamp_offset)
+{
+	int ret;
 
-	/* resize the buffer if bigger */
-	if (estimated > rs->output_size) {
-		if (rs->output_buffer)
-			av_freep(&rs->output_buffer);
-		av_samples_alloc(&rs->output_buffer, NULL, rs->output_ch,
-				estimated, rs->output_format, 0);
+	if (rs->converter) {
+		if (max_frames < in_frames)
+			return false;
 
-		rs->output_size = estimated;
+		audio_converter_convert(rs->converter, output, input,
+				in_frames);
+		*out_frames       = in_frames;
+		*timestamp_offset = 0;
+		return true;
 	}
 
-	ret = swr_convert(context,
-			&rs->output_buffer, rs->output_size,
-			(const uint8_t**)&input, in_frames);
+	*timestamp_offset = (uint64_t)swr_get_delay(rs->context, 1000000000);
+
+	ret = swr_convert(rs->context,
+			(uint8_t**)output, (int)max_frames,
+			(const uint8_t**)input, (int)in_frames);
 
 	if (ret < 0) {
 		blog(LOG_ERROR, "swr_convert failed: %d", ret);
 		return false;
 	}
 
-	*output     = rs->output_buffer;
 	*out_frames = (uint32_t)ret;
 	return true;
 }
+
+bool audio_resampler_resample(audio_resampler_t rs,
+		 uint8_t *output[], uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
+		 uint64_t *timestamp_offset)
+{
+	int estimated = (int)audio_resampler_max_output(rs, in_frames);
+	uint32_t i;
+
+	/* resize the buffer if bigger */
+	if (estimated > rs->output_size) {
+		if (rs->output_buffer[0])
+			av_freep(&rs->output_buffer[0]);
+		av_samples_alloc(rs->output_buffer, NULL, rs->output_ch,
+				estimated, rs->output_format, 0);
+
+		rs->output_size = estimated;
+	}
+
+	if (!audio_resampler_resample_to(rs, rs->output_buffer,
+				(uint32_t)rs->output_size, out_frames,
+				input, in_frames, timestamp_offset))
+		return false;
+
+	for (i = 0; i < rs->output_planes; i++)
+		output[i] = rs->output_buffer[i];
+
+	return true;
+}
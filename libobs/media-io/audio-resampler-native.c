@@ -0,0 +1,100 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Resampler used when libobs is built without libswresample.  Only same-rate
+ * format and speaker layout conversions are supported.
+ */
+
+#include "../util/bmem.h"
+#include "../util/darray.h"
+#include "audio-resampler.h"
+#include "audio-conversion.h"
+
+struct audio_resampler {
+	audio_converter_t    converter;
+	struct resample_info dst;
+	DARRAY(uint8_t)      output_buffer;
+};
+
+audio_resampler_t audio_resampler_create(struct resample_info *dst,
+		struct resample_info *src)
+{
+	struct audio_resampler *rs;
+	audio_converter_t converter = audio_converter_create(dst, src);
+
+	if (!converter) {
+		blog(LOG_ERROR, "audio_resampler_create: libobs was built "
+		                "without libswresample, and can't convert "
+		                "%u Hz audio to %u Hz",
+		                src->samples_per_sec, dst->samples_per_sec);
+		return NULL;
+	}
+
+	rs = bmalloc(sizeof(struct audio_resampler));
+	memset(rs, 0, sizeof(struct audio_resampler));
+	rs->converter = converter;
+	rs->dst       = *dst;
+	return rs;
+}
+
+void audio_resampler_destroy(audio_resampler_t rs)
+{
+	if (rs) {
+		audio_converter_destroy(rs->converter);
+		da_free(rs->output_buffer);
+		bfree(rs);
+	}
+}
+
+uint32_t audio_resampler_max_output(audio_resampler_t rs, uint32_t in_frames)
+{
+	return in_frames;
+}
+
+bool audio_resampler_resample_to(audio_resampler_t rs,
+		 uint8_t *const output[], uint32_t max_frames,
+		 uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
+		 uint64_t *timestamp_offset)
+{
+	if (max_frames < in_frames)
+		return false;
+
+	audio_converter_convert(rs->converter, output, input, in_frames);
+	*out_frames       = in_frames;
+	*timestamp_offset = 0;
+	return true;
+}
+
+bool audio_resampler_resample(audio_resampler_t rs,
+		 uint8_t *output[], uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
+		 uint64_t *timestamp_offset)
+{
+	size_t planes = get_audio_planes(rs->dst.format, rs->dst.speakers);
+	size_t plane_size = get_audio_plane_size(rs->dst.format,
+			rs->dst.speakers, in_frames);
+
+	da_resize(rs->output_buffer, plane_size * planes);
+
+	for (size_t i = 0; i < planes; i++)
+		output[i] = rs->output_buffer.array + plane_size * i;
+
+	return audio_resampler_resample_to(rs, output, in_frames, out_frames,
+			input, in_frames, timestamp_offset);
+}
@@ -37,9 +37,25 @@ EXPORT audio_resampler_t audio_resampler_create(struct resample_info *dst,
 		struct resample_info *src);
 EXPORT void audio_resampler_destroy(audio_resampler_t resampler);
 
+/* returns the most frames resampling in_frames can output, including data
+ * still buffered from previous calls */
+EXPORT uint32_t audio_resampler_max_output(audio_resampler_t resampler,
+		uint32_t in_frames);
+
+/* input and output are arrays of plane pointers.  interleaved formats only
+ * use the first plane.  output points to an internal buffer that's valid
+ * until the next call */
 EXPORT bool audio_resampler_resample(audio_resampler_t resampler,
-		 void **output, uint32_t *out_frames,
-		 const void *input, uint32_t in_frames,
+		 uint8_t *output[], uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
+		 uint64_t *timestamp_offset);
+
+/* resamples into the caller's planes, which must hold at least max_frames
+ * frames.  use audio_resampler_max_output to size them */
+EXPORT bool audio_resampler_resample_to(audio_resampler_t resampler,
+		 uint8_t *const output[], uint32_t max_frames,
+		 uint32_t *out_frames,
+		 const uint8_t *const input[], uint32_t in_frames,
 		 uint64_t *timestamp_offset);
 
 #ifdef __cplusplus
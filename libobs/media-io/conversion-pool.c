@@ -0,0 +1,181 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/threading.h"
+
+#include "conversion-pool.h"
+
+/* don't bother splitting up anything smaller than this */
+#define MIN_BAND_HEIGHT 32
+
+struct conversion_worker {
+	struct conversion_pool     *pool;
+	pthread_t                  thread;
+	event_t                    start_event;
+	event_t                    done_event;
+	uint32_t                   start_y;
+	uint32_t                   end_y;
+	bool                       initialized;
+};
+
+struct conversion_pool {
+	conversion_band_t          func;
+	void                       *param;
+	volatile bool              stop;
+
+	size_t                     num_workers;
+	struct conversion_worker   *workers;
+};
+
+static void *conversion_thread(void *data)
+{
+	struct conversion_worker *worker = data;
+	struct conversion_pool   *pool   = worker->pool;
+
+	for (;;) {
+		event_wait(&worker->start_event);
+		if (pool->stop)
+			break;
+
+		pool->func(pool->param, worker->start_y, worker->end_y);
+		event_signal(&worker->done_event);
+	}
+
+	return NULL;
+}
+
+static bool init_worker(struct conversion_pool *pool,
+		struct conversion_worker *worker)
+{
+	worker->pool = pool;
+
+	if (event_init(&worker->start_event, EVENT_TYPE_AUTO) != 0)
+		return false;
+	if (event_init(&worker->done_event, EVENT_TYPE_AUTO) != 0) {
+		event_destroy(&worker->start_event);
+		return false;
+	}
+	if (pthread_create(&worker->thread, NULL, conversion_thread,
+				worker) != 0) {
+		event_destroy(&worker->done_event);
+		event_destroy(&worker->start_event);
+		return false;
+	}
+
+	worker->initialized = true;
+	return true;
+}
+
+conversion_pool_t conversion_pool_create(uint32_t num_threads)
+{
+	struct conversion_pool *pool;
+
+	if (!num_threads)
+		num_threads = (uint32_t)os_get_logical_cores();
+
+	pool = bmalloc(sizeof(struct conversion_pool));
+	memset(pool, 0, sizeof(struct conversion_pool));
+
+	if (num_threads > 1) {
+		size_t size = sizeof(struct conversion_worker) *
+			(num_threads - 1);
+
+		pool->workers = bmalloc(size);
+		memset(pool->workers, 0, size);
+
+		for (size_t i = 0; i < num_threads - 1; i++) {
+			if (!init_worker(pool, pool->workers+i)) {
+				blog(LOG_WARNING, "conversion_pool_create: "
+				                  "Failed to create worker "
+				                  "thread");
+				break;
+			}
+
+			pool->num_workers++;
+		}
+	}
+
+	return pool;
+}
+
+void conversion_pool_destroy(conversion_pool_t pool)
+{
+	if (!pool)
+		return;
+
+	pool->stop = true;
+
+	for (size_t i = 0; i < pool->num_workers; i++) {
+		struct conversion_worker *worker = pool->workers+i;
+		void *thread_ret;
+
+		event_signal(&worker->start_event);
+		pthread_join(worker->thread, &thread_ret);
+		event_destroy(&worker->start_event);
+		event_destroy(&worker->done_event);
+	}
+
+	bfree(pool->workers);
+	bfree(pool);
+}
+
+void conversion_pool_run(conversion_pool_t pool,
+		conversion_band_t func, void *param,
+		uint32_t height, uint32_t row_align)
+{
+	uint64_t units;
+	size_t   num_bands;
+	uint32_t y = 0;
+	size_t   i;
+
+	if (!row_align)
+		row_align = 1;
+
+	units     = (height + row_align - 1) / row_align;
+	num_bands = pool ? pool->num_workers + 1 : 1;
+
+	if (num_bands > height / MIN_BAND_HEIGHT)
+		num_bands = height / MIN_BAND_HEIGHT;
+
+	if (num_bands <= 1) {
+		func(param, 0, height);
+		return;
+	}
+
+	pool->func  = func;
+	pool->param = param;
+
+	/* the calling thread handles the last band */
+	for (i = 0; i < num_bands - 1; i++) {
+		struct conversion_worker *worker = pool->workers+i;
+		uint32_t end_y = (uint32_t)(units * (i+1) / num_bands) *
+			row_align;
+
+		worker->start_y = y;
+		worker->end_y   = end_y;
+		y = end_y;
+
+		event_signal(&worker->start_event);
+	}
+
+	func(param, y, height);
+
+	for (i = 0; i < num_bands - 1; i++)
+		event_wait(&pool->workers[i].done_event);
+}
@@ -0,0 +1,62 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Conversion worker pool.  Splits a frame conversion into bands of rows and
+ * processes the bands on multiple threads.  All the format conversion
+ * functions take a start_y/end_y range, so they can be used directly with
+ * this.  A pool can only run one conversion at a time.
+ */
+
+struct conversion_pool;
+typedef struct conversion_pool *conversion_pool_t;
+
+typedef void (*conversion_band_t)(void *param, uint32_t start_y,
+		uint32_t end_y);
+
+/**
+ * Creates a conversion pool.
+ *
+ *   num_threads: Total number of threads to use for each conversion,
+ *                including the calling thread.  0 uses one per logical core.
+ */
+EXPORT conversion_pool_t conversion_pool_create(uint32_t num_threads);
+EXPORT void conversion_pool_destroy(conversion_pool_t pool);
+
+/**
+ * Runs a conversion split across the pool threads and returns once every
+ * band has been processed.
+ *
+ *   height:     Total number of rows.
+ *   row_align:  Band boundaries are kept at a multiple of this value (2 for
+ *               4:2:0 formats).
+ */
+EXPORT void conversion_pool_run(conversion_pool_t pool,
+		conversion_band_t func, void *param,
+		uint32_t height, uint32_t row_align);
+
+#ifdef __cplusplus
+}
+#endif
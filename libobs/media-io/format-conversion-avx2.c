@@ -0,0 +1,328 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "format-conversion-internal.h"
+
+#ifdef FORMAT_CONVERSION_X86
+
+#include <immintrin.h>
+
+/*
+ * AVX2 kernels, 16 pixels per iteration.  most AVX2 shuffles operate within
+ * each 128bit lane, so the results are put back in order with cross-lane
+ * permutes before being stored.  unaligned input/output is allowed, and the
+ * remainder of each line is handled by the scalar helpers.
+ */
+
+#define Z -1
+
+#define LANES(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+/* averages the U/V values of 2x2 pixel blocks from two lines of 16 UYVX
+ * pixels, returning 8 pairs of 16bit U and V values in order */
+static inline __m256i average_uv(const __m256i a0, const __m256i a1,
+		const __m256i b0, const __m256i b1, const __m256i uv_mask)
+{
+	__m256i sum0 = _mm256_add_epi16(
+			_mm256_and_si256(a0, uv_mask),
+			_mm256_and_si256(b0, uv_mask));
+	__m256i sum1 = _mm256_add_epi16(
+			_mm256_and_si256(a1, uv_mask),
+			_mm256_and_si256(b1, uv_mask));
+
+	sum0 = _mm256_add_epi16(sum0, _mm256_srli_epi64(sum0, 32));
+	sum1 = _mm256_add_epi16(sum1, _mm256_srli_epi64(sum1, 32));
+
+	/* lane 0 now has chroma values 0, 1, 4, 5, lane 1 has 2, 3, 6, 7 */
+	sum0 = _mm256_castps_si256(_mm256_shuffle_ps(
+			_mm256_castsi256_ps(sum0), _mm256_castsi256_ps(sum1),
+			_MM_SHUFFLE(2, 0, 2, 0)));
+	sum0 = _mm256_permute4x64_epi64(sum0, _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm256_srli_epi16(sum0, 2);
+}
+
+static inline void store_lum(uint8_t *lum, const __m256i a0, const __m256i a1,
+		const __m256i lum_shuf_lo, const __m256i lum_shuf_hi,
+		const __m256i lum_order)
+{
+	__m256i val = _mm256_or_si256(
+			_mm256_shuffle_epi8(a0, lum_shuf_lo),
+			_mm256_shuffle_epi8(a1, lum_shuf_hi));
+	val = _mm256_permutevar8x32_epi32(val, lum_order);
+	_mm_storeu_si128((__m128i*)lum, _mm256_castsi256_si128(val));
+}
+
+static void compress_uyvx_to_i420_avx2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t chroma_pitch = width >> 1;
+	uint32_t y;
+
+	const __m256i lum_shuf_lo = LANES(1, 5, 9, 13,
+			Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i lum_shuf_hi = LANES(Z, Z, Z, Z,
+			1, 5, 9, 13, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i uv_split    = LANES(0, 4, 8, 12,
+			2, 6, 10, 14, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i dword_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const __m256i uv_mask     = _mm256_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * row_bytes;
+		const uint8_t *line2 = line1 + row_bytes;
+		uint8_t       *lum1  = lum_plane + y * width;
+		uint8_t       *lum2  = lum1 + width;
+		uint8_t       *u_row = u_plane + (y>>1) * chroma_pitch;
+		uint8_t       *v_row = v_plane + (y>>1) * chroma_pitch;
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			const __m256i *img1 = (const __m256i*)(line1 + x*4);
+			const __m256i *img2 = (const __m256i*)(line2 + x*4);
+			__m256i a0 = _mm256_loadu_si256(img1);
+			__m256i a1 = _mm256_loadu_si256(img1 + 1);
+			__m256i b0 = _mm256_loadu_si256(img2);
+			__m256i b1 = _mm256_loadu_si256(img2 + 1);
+			__m256i uv;
+			__m128i uv128;
+
+			store_lum(lum1 + x, a0, a1,
+					lum_shuf_lo, lum_shuf_hi, dword_order);
+			store_lum(lum2 + x, b0, b1,
+					lum_shuf_lo, lum_shuf_hi, dword_order);
+
+			uv = average_uv(a0, a1, b0, b1, uv_mask);
+			uv = _mm256_shuffle_epi8(uv, uv_split);
+			uv = _mm256_permutevar8x32_epi32(uv, dword_order);
+
+			uv128 = _mm256_castsi256_si128(uv);
+			_mm_storel_epi64((__m128i*)(u_row + (x>>1)), uv128);
+			_mm_storel_epi64((__m128i*)(v_row + (x>>1)),
+					_mm_srli_si128(uv128, 8));
+		}
+
+		compress_uyvx_lines_c(line1, line2, lum1, lum2, u_row, v_row,
+				1, x, width);
+	}
+}
+
+static void compress_uyvx_to_nv12_avx2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
+		void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t y;
+
+	const __m256i lum_shuf_lo   = LANES(1, 5, 9, 13,
+			Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i lum_shuf_hi   = LANES(Z, Z, Z, Z,
+			1, 5, 9, 13, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i uv_interleave = LANES(0, 2, 4, 6,
+			8, 10, 12, 14, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m256i dword_order   = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	const __m256i uv_mask       = _mm256_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1  = input + y * row_bytes;
+		const uint8_t *line2  = line1 + row_bytes;
+		uint8_t       *lum1   = lum_plane + y * row_bytes_out;
+		uint8_t       *lum2   = lum1 + row_bytes_out;
+		uint8_t       *chroma = chroma_plane + (y>>1) * row_bytes_out;
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			const __m256i *img1 = (const __m256i*)(line1 + x*4);
+			const __m256i *img2 = (const __m256i*)(line2 + x*4);
+			__m256i a0 = _mm256_loadu_si256(img1);
+			__m256i a1 = _mm256_loadu_si256(img1 + 1);
+			__m256i b0 = _mm256_loadu_si256(img2);
+			__m256i b1 = _mm256_loadu_si256(img2 + 1);
+			__m256i uv;
+
+			store_lum(lum1 + x, a0, a1,
+					lum_shuf_lo, lum_shuf_hi, dword_order);
+			store_lum(lum2 + x, b0, b1,
+					lum_shuf_lo, lum_shuf_hi, dword_order);
+
+			uv = average_uv(a0, a1, b0, b1, uv_mask);
+			uv = _mm256_shuffle_epi8(uv, uv_interleave);
+			uv = _mm256_permute4x64_epi64(uv, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm_storeu_si128((__m128i*)(chroma + x),
+					_mm256_castsi256_si128(uv));
+		}
+
+		compress_uyvx_lines_c(line1, line2, lum1, lum2,
+				chroma, chroma + 1, 2, x, width);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* writes 8 pixels of Y, U, V, 0 from 8 lum values and 4 interleaved U/V
+ * pairs */
+static inline void store_yuv(uint32_t *output, const uint8_t *lum,
+		const __m128i uv)
+{
+	__m256i lum32 = _mm256_cvtepu8_epi32(
+			_mm_loadl_epi64((const __m128i*)lum));
+	__m256i uv32  = _mm256_cvtepu16_epi32(_mm_unpacklo_epi16(uv, uv));
+
+	_mm256_storeu_si256((__m256i*)output,
+			_mm256_or_si256(lum32, _mm256_slli_epi32(uv32, 8)));
+}
+
+static void decompress_420_avx2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v)
+{
+	uint8_t       *output = output_v;
+	const uint8_t *input  = input_v;
+	const uint8_t *input2 = input + width * height;
+	const uint8_t *input3 = input2 + width * height / 4;
+
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = width/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma0 = input2 + y * width_d2;
+		const uint8_t *chroma1 = input3 + y * width_d2;
+		const uint8_t *lum0    = input + y * 2*width;
+		const uint8_t *lum1    = lum0 + width;
+		uint32_t *output0 = (uint32_t*)(output + y * 2*row_bytes);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			__m128i u  = _mm_loadl_epi64(
+					(const __m128i*)(chroma0 + (x>>1)));
+			__m128i v  = _mm_loadl_epi64(
+					(const __m128i*)(chroma1 + (x>>1)));
+			__m128i uv_lo = _mm_unpacklo_epi8(u, v);
+			__m128i uv_hi = _mm_srli_si128(uv_lo, 8);
+
+			store_yuv(output0 + x,     lum0 + x,     uv_lo);
+			store_yuv(output0 + x + 8, lum0 + x + 8, uv_hi);
+			store_yuv(output1 + x,     lum1 + x,     uv_lo);
+			store_yuv(output1 + x + 8, lum1 + x + 8, uv_hi);
+		}
+
+		decompress_420_lines_c(lum0, lum1, chroma0, chroma1, 1,
+				output0, output1, x, width);
+	}
+}
+
+static void decompress_nv12_avx2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v)
+{
+	uint8_t       *output = output_v;
+	const uint8_t *input  = input_v;
+	const uint8_t *input2 = input + width * height;
+
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma = input2 + y * width;
+		const uint8_t *lum0   = input + y * 2*width;
+		const uint8_t *lum1   = lum0 + width;
+		uint32_t *output0 = (uint32_t*)(output + y * 2*row_bytes);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			__m128i uv_lo = _mm_loadu_si128(
+					(const __m128i*)(chroma + x));
+			__m128i uv_hi = _mm_srli_si128(uv_lo, 8);
+
+			store_yuv(output0 + x,     lum0 + x,     uv_lo);
+			store_yuv(output0 + x + 8, lum0 + x + 8, uv_hi);
+			store_yuv(output1 + x,     lum1 + x,     uv_lo);
+			store_yuv(output1 + x + 8, lum1 + x + 8, uv_hi);
+		}
+
+		decompress_420_lines_c(lum0, lum1, chroma, chroma + 1, 2,
+				output0, output1, x, width);
+	}
+}
+
+static void decompress_422_avx2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v,
+		bool leading_lum)
+{
+	const uint8_t *input  = input_v;
+	uint8_t       *output = output_v;
+
+	uint32_t line_size = width * 2;
+	uint32_t y;
+
+	/* each 128bit lane expands 2 of the 4 pairs in the source register, and
+	 * the second pixel of each pair has its lum value copied over the
+	 * first lum position */
+	const __m256i shuf = leading_lum ?
+		_mm256_setr_epi8(0,  1,  2,  3,   2,  1,  2,  3,
+		                 4,  5,  6,  7,   6,  5,  6,  7,
+		                 8,  9, 10, 11,  10,  9, 10, 11,
+		                12, 13, 14, 15,  14, 13, 14, 15) :
+		_mm256_setr_epi8(0,  1,  2,  3,   0,  3,  2,  3,
+		                 4,  5,  6,  7,   4,  7,  6,  7,
+		                 8,  9, 10, 11,   8, 11, 10, 11,
+		                12, 13, 14, 15,  12, 15, 14, 15);
+
+	for (y = start_y; y < end_y; y++) {
+		const uint8_t *line  = input + y*line_size;
+		uint32_t      *out32 = (uint32_t*)(output + y*row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			const __m128i *in  = (const __m128i*)(line + x*2);
+			__m256i       *out = (__m256i*)(out32 + x);
+			__m256i val0 = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128(in));
+			__m256i val1 = _mm256_broadcastsi128_si256(
+					_mm_loadu_si128(in + 1));
+
+			_mm256_storeu_si256(out,     _mm256_shuffle_epi8(val0, shuf));
+			_mm256_storeu_si256(out + 1, _mm256_shuffle_epi8(val1, shuf));
+		}
+
+		decompress_422_line_c(line, out32, x, width, leading_lum);
+	}
+}
+
+const struct format_conversion_funcs format_conversion_avx2 = {
+	compress_uyvx_to_i420_avx2,
+	compress_uyvx_to_nv12_avx2,
+	decompress_nv12_avx2,
+	decompress_420_avx2,
+	decompress_422_avx2
+};
+
+#endif
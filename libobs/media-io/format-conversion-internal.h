@@ -0,0 +1,138 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "format-conversion.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#define FORMAT_CONVERSION_X86 1
+#endif
+
+/*
+ * Per-instruction set implementations of the conversion functions.  The
+ * compress function always takes the output line size so that it can be
+ * used for both compress_uyvx_to_nv12 and compress_uyvx_to_nv12_aligned.
+ */
+
+struct format_conversion_funcs {
+	void (*compress_uyvx_to_i420)(const void *input,
+			uint32_t width, uint32_t height, uint32_t row_bytes,
+			uint32_t start_y, uint32_t end_y, void **output);
+
+	void (*compress_uyvx_to_nv12)(const void *input,
+			uint32_t width, uint32_t height, uint32_t row_bytes,
+			uint32_t start_y, uint32_t end_y,
+			uint32_t row_bytes_out, void **output);
+
+	void (*decompress_nv12)(const void *input,
+			uint32_t width, uint32_t height, uint32_t row_bytes,
+			uint32_t start_y, uint32_t end_y, void *output);
+
+	void (*decompress_420)(const void *input,
+			uint32_t width, uint32_t height, uint32_t row_bytes,
+			uint32_t start_y, uint32_t end_y, void *output);
+
+	void (*decompress_422)(const void *input,
+			uint32_t width, uint32_t height, uint32_t row_bytes,
+			uint32_t start_y, uint32_t end_y, void *output,
+			bool leading_lum);
+};
+
+extern const struct format_conversion_funcs format_conversion_c;
+
+extern void decompress_nv12_c(const void *input,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output);
+extern void decompress_420_c(const void *input,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output);
+extern void decompress_422_c(const void *input,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output,
+		bool leading_lum);
+
+#ifdef FORMAT_CONVERSION_X86
+extern const struct format_conversion_funcs format_conversion_sse2;
+extern const struct format_conversion_funcs format_conversion_ssse3;
+extern const struct format_conversion_funcs format_conversion_avx2;
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* scalar helpers, also used for the remainder of each line by the SIMD
+ * implementations */
+
+/* UYVX: each pixel is stored as U, Y, V, X */
+static inline void compress_uyvx_lines_c(const uint8_t *line1,
+		const uint8_t *line2, uint8_t *lum1, uint8_t *lum2,
+		uint8_t *u_row, uint8_t *v_row, uint32_t chroma_step,
+		uint32_t x, uint32_t width)
+{
+	for (; x < width; x += 2) {
+		const uint8_t *p1 = line1 + x*4;
+		const uint8_t *p2 = line2 + x*4;
+		uint32_t chroma_pos = (x>>1) * chroma_step;
+
+		lum1[x]   = p1[1];
+		lum1[x+1] = p1[5];
+		lum2[x]   = p2[1];
+		lum2[x+1] = p2[5];
+
+		u_row[chroma_pos] = (uint8_t)(
+				(p1[0] + p1[4] + p2[0] + p2[4]) >> 2);
+		v_row[chroma_pos] = (uint8_t)(
+				(p1[2] + p1[6] + p2[2] + p2[6]) >> 2);
+	}
+}
+
+static inline void decompress_420_lines_c(const uint8_t *lum0,
+		const uint8_t *lum1, const uint8_t *u_row, const uint8_t *v_row,
+		uint32_t chroma_step, uint32_t *output0, uint32_t *output1,
+		uint32_t x, uint32_t width)
+{
+	for (; x < width; x += 2) {
+		uint32_t chroma_pos = (x>>1) * chroma_step;
+		uint32_t out = ((uint32_t)u_row[chroma_pos] << 8) |
+		               ((uint32_t)v_row[chroma_pos] << 16);
+
+		output0[x]   = lum0[x]   | out;
+		output0[x+1] = lum0[x+1] | out;
+		output1[x]   = lum1[x]   | out;
+		output1[x+1] = lum1[x+1] | out;
+	}
+}
+
+static inline void decompress_422_line_c(const uint8_t *line,
+		uint32_t *output, uint32_t x, uint32_t width, bool leading_lum)
+{
+	const uint32_t *input32 = (const uint32_t*)line;
+
+	for (; x < width; x += 2) {
+		uint32_t dw = input32[x>>1];
+
+		output[x] = dw;
+		if (leading_lum) {
+			dw &= 0xFFFFFF00;
+			dw |= (uint8_t)(dw>>16);
+		} else {
+			dw &= 0xFFFF00FF;
+			dw |= (dw>>16) & 0xFF00;
+		}
+		output[x+1] = dw;
+	}
+}
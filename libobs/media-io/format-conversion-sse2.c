@@ -0,0 +1,175 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "format-conversion-internal.h"
+
+#ifdef FORMAT_CONVERSION_X86
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+/* requires 16 byte aligned input lines and a width that is a multiple of 4 */
+
+static inline uint32_t get_m128_32_0(const __m128i val)
+{
+	return *(uint32_t* const)&val;
+}
+
+static inline uint32_t get_m128_32_1(const __m128i val)
+{
+	return *(((uint32_t* const)&val)+1);
+}
+
+static inline void pack_lum(uint8_t *lum_plane,
+		uint32_t lum_pos0, uint32_t lum_pos1,
+		const __m128i line1, const __m128i line2,
+		const __m128i lum_mask)
+{
+	__m128i pack_val = _mm_packs_epi32(
+			_mm_srli_si128(_mm_and_si128(line1, lum_mask), 1),
+			_mm_srli_si128(_mm_and_si128(line2, lum_mask), 1));
+	pack_val = _mm_packus_epi16(pack_val, pack_val);
+
+	*(uint32_t*)(lum_plane+lum_pos0) = get_m128_32_0(pack_val);
+	*(uint32_t*)(lum_plane+lum_pos1) = get_m128_32_1(pack_val);
+}
+
+static inline void pack_chroma_1plane(uint8_t *uv_plane,
+		uint32_t chroma_pos,
+		const __m128i line1, const __m128i line2,
+		const __m128i uv_mask)
+{
+	__m128i add_val = _mm_add_epi64(
+			_mm_and_si128(line1, uv_mask),
+			_mm_and_si128(line2, uv_mask));
+	__m128i avg_val = _mm_add_epi64(
+			add_val,
+			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
+	avg_val = _mm_srai_epi16(avg_val, 2);
+	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
+	avg_val = _mm_packus_epi16(avg_val, avg_val);
+
+	*(uint32_t*)(uv_plane+chroma_pos) = get_m128_32_0(avg_val);
+}
+
+static inline void pack_chroma_2plane(uint8_t *u_plane, uint8_t *v_plane,
+		uint32_t chroma_pos,
+		const __m128i line1, const __m128i line2,
+		const __m128i uv_mask)
+{
+	uint32_t packed_vals;
+
+	__m128i add_val = _mm_add_epi64(
+			_mm_and_si128(line1, uv_mask),
+			_mm_and_si128(line2, uv_mask));
+	__m128i avg_val = _mm_add_epi64(
+			add_val,
+			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
+	avg_val = _mm_srai_epi16(avg_val, 2);
+	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
+	avg_val = _mm_shufflelo_epi16(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
+	avg_val = _mm_packus_epi16(avg_val, avg_val);
+
+	packed_vals = get_m128_32_0(avg_val);
+
+	*(uint16_t*)(u_plane+chroma_pos) = (uint16_t)(packed_vals);
+	*(uint16_t*)(v_plane+chroma_pos) = (uint16_t)(packed_vals>>16);
+}
+
+static void compress_uyvx_to_i420_sse2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t chroma_pitch = width >> 1;
+	uint32_t y;
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y * row_bytes;
+		uint32_t chroma_y_pos = (y>>1) * chroma_pitch;
+		uint32_t lum_y_pos    = y * width;
+		uint32_t x;
+
+		for (x = 0; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + width;
+
+			__m128i line1 = _mm_load_si128((const __m128i*)img);
+			__m128i line2 = _mm_load_si128(
+					(const __m128i*)(img + row_bytes));
+
+			pack_lum(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask);
+			pack_chroma_2plane(u_plane, v_plane,
+					chroma_y_pos + (x>>1),
+					line1, line2, uv_mask);
+		}
+	}
+}
+
+static void compress_uyvx_to_nv12_sse2(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t pitch,
+		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
+		void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t y;
+
+	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
+	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		uint32_t y_pos        = y * pitch;
+		uint32_t chroma_y_pos = (y>>1) * row_bytes_out;
+		uint32_t lum_y_pos    = y * row_bytes_out;
+		uint32_t x;
+
+		for (x = 0; x < width; x += 4) {
+			const uint8_t *img = input + y_pos + x*4;
+			uint32_t lum_pos0  = lum_y_pos + x;
+			uint32_t lum_pos1  = lum_pos0 + row_bytes_out;
+
+			__m128i line1 = _mm_load_si128((const __m128i*)img);
+			__m128i line2 = _mm_load_si128(
+					(const __m128i*)(img + pitch));
+
+			pack_lum(lum_plane, lum_pos0, lum_pos1,
+					line1, line2, lum_mask);
+			pack_chroma_1plane(chroma_plane, chroma_y_pos + x,
+					line1, line2, uv_mask);
+		}
+	}
+}
+
+const struct format_conversion_funcs format_conversion_sse2 = {
+	compress_uyvx_to_i420_sse2,
+	compress_uyvx_to_nv12_sse2,
+	decompress_nv12_c,
+	decompress_420_c,
+	decompress_422_c
+};
+
+#endif
@@ -0,0 +1,337 @@
+/******************************************************************************
+    Copyright (C) 2013 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include "format-conversion-internal.h"
+
+#ifdef FORMAT_CONVERSION_X86
+
+#include <tmmintrin.h>
+
+/*
+ * pshufb based kernels.  unaligned input/output is allowed, 8 pixels are
+ * compressed and 16 pixels are decompressed per iteration, and the remainder
+ * of each line is handled by the scalar helpers.
+ */
+
+#define Z -1
+
+/* averages the U/V values of 2x2 pixel blocks from two lines of 8 UYVX
+ * pixels, returning 4 pairs of 16bit U and V values */
+static inline __m128i average_uv(const __m128i a0, const __m128i a1,
+		const __m128i b0, const __m128i b1, const __m128i uv_mask)
+{
+	__m128i sum0 = _mm_add_epi16(
+			_mm_and_si128(a0, uv_mask),
+			_mm_and_si128(b0, uv_mask));
+	__m128i sum1 = _mm_add_epi16(
+			_mm_and_si128(a1, uv_mask),
+			_mm_and_si128(b1, uv_mask));
+
+	sum0 = _mm_add_epi16(sum0, _mm_srli_epi64(sum0, 32));
+	sum1 = _mm_add_epi16(sum1, _mm_srli_epi64(sum1, 32));
+	sum0 = _mm_castps_si128(_mm_shuffle_ps(
+			_mm_castsi128_ps(sum0), _mm_castsi128_ps(sum1),
+			_MM_SHUFFLE(2, 0, 2, 0)));
+
+	return _mm_srli_epi16(sum0, 2);
+}
+
+static inline void store_lum(uint8_t *lum, const __m128i a0, const __m128i a1,
+		const __m128i lum_shuf_lo, const __m128i lum_shuf_hi)
+{
+	__m128i val = _mm_or_si128(
+			_mm_shuffle_epi8(a0, lum_shuf_lo),
+			_mm_shuffle_epi8(a1, lum_shuf_hi));
+	_mm_storel_epi64((__m128i*)lum, val);
+}
+
+static void compress_uyvx_to_i420_ssse3(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t  *lum_plane   = output[0];
+	uint8_t  *u_plane     = output[1];
+	uint8_t  *v_plane     = output[2];
+	uint32_t chroma_pitch = width >> 1;
+	uint32_t y;
+
+	const __m128i lum_shuf_lo = _mm_setr_epi8(1, 5, 9, 13,
+			Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i lum_shuf_hi = _mm_setr_epi8(Z, Z, Z, Z,
+			1, 5, 9, 13, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i uv_split    = _mm_setr_epi8(0, 4, 8, 12,
+			2, 6, 10, 14, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i uv_mask     = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1 = input + y * row_bytes;
+		const uint8_t *line2 = line1 + row_bytes;
+		uint8_t       *lum1  = lum_plane + y * width;
+		uint8_t       *lum2  = lum1 + width;
+		uint8_t       *u_row = u_plane + (y>>1) * chroma_pitch;
+		uint8_t       *v_row = v_plane + (y>>1) * chroma_pitch;
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const __m128i *img1 = (const __m128i*)(line1 + x*4);
+			const __m128i *img2 = (const __m128i*)(line2 + x*4);
+			__m128i a0 = _mm_loadu_si128(img1);
+			__m128i a1 = _mm_loadu_si128(img1 + 1);
+			__m128i b0 = _mm_loadu_si128(img2);
+			__m128i b1 = _mm_loadu_si128(img2 + 1);
+			__m128i uv;
+
+			store_lum(lum1 + x, a0, a1, lum_shuf_lo, lum_shuf_hi);
+			store_lum(lum2 + x, b0, b1, lum_shuf_lo, lum_shuf_hi);
+
+			uv = average_uv(a0, a1, b0, b1, uv_mask);
+			uv = _mm_shuffle_epi8(uv, uv_split);
+
+			*(uint32_t*)(u_row + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(uv);
+			*(uint32_t*)(v_row + (x>>1)) =
+				(uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+		}
+
+		compress_uyvx_lines_c(line1, line2, lum1, lum2, u_row, v_row,
+				1, x, width);
+	}
+}
+
+static void compress_uyvx_to_nv12_ssse3(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
+		void **output)
+{
+	const uint8_t *input = input_v;
+	uint8_t *lum_plane    = output[0];
+	uint8_t *chroma_plane = output[1];
+	uint32_t y;
+
+	const __m128i lum_shuf_lo   = _mm_setr_epi8(1, 5, 9, 13,
+			Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i lum_shuf_hi   = _mm_setr_epi8(Z, Z, Z, Z,
+			1, 5, 9, 13, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i uv_interleave = _mm_setr_epi8(0, 2, 4, 6,
+			8, 10, 12, 14, Z, Z, Z, Z, Z, Z, Z, Z);
+	const __m128i uv_mask       = _mm_set1_epi16(0x00FF);
+
+	for (y = start_y; y < end_y; y += 2) {
+		const uint8_t *line1  = input + y * row_bytes;
+		const uint8_t *line2  = line1 + row_bytes;
+		uint8_t       *lum1   = lum_plane + y * row_bytes_out;
+		uint8_t       *lum2   = lum1 + row_bytes_out;
+		uint8_t       *chroma = chroma_plane + (y>>1) * row_bytes_out;
+		uint32_t x;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			const __m128i *img1 = (const __m128i*)(line1 + x*4);
+			const __m128i *img2 = (const __m128i*)(line2 + x*4);
+			__m128i a0 = _mm_loadu_si128(img1);
+			__m128i a1 = _mm_loadu_si128(img1 + 1);
+			__m128i b0 = _mm_loadu_si128(img2);
+			__m128i b1 = _mm_loadu_si128(img2 + 1);
+			__m128i uv;
+
+			store_lum(lum1 + x, a0, a1, lum_shuf_lo, lum_shuf_hi);
+			store_lum(lum2 + x, b0, b1, lum_shuf_lo, lum_shuf_hi);
+
+			uv = average_uv(a0, a1, b0, b1, uv_mask);
+			uv = _mm_shuffle_epi8(uv, uv_interleave);
+			_mm_storel_epi64((__m128i*)(chroma + x), uv);
+		}
+
+		compress_uyvx_lines_c(line1, line2, lum1, lum2,
+				chroma, chroma + 1, 2, x, width);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct yuv_shuffle {
+	__m128i lum[4];
+	__m128i uv[4];
+};
+
+static inline void init_yuv_shuffle(struct yuv_shuffle *shuf)
+{
+	shuf->lum[0] = _mm_setr_epi8( 0, Z, Z, Z,  1, Z, Z, Z,
+	                              2, Z, Z, Z,  3, Z, Z, Z);
+	shuf->lum[1] = _mm_setr_epi8( 4, Z, Z, Z,  5, Z, Z, Z,
+	                              6, Z, Z, Z,  7, Z, Z, Z);
+	shuf->lum[2] = _mm_setr_epi8( 8, Z, Z, Z,  9, Z, Z, Z,
+	                             10, Z, Z, Z, 11, Z, Z, Z);
+	shuf->lum[3] = _mm_setr_epi8(12, Z, Z, Z, 13, Z, Z, Z,
+	                             14, Z, Z, Z, 15, Z, Z, Z);
+
+	shuf->uv[0]  = _mm_setr_epi8(Z,  0,  1, Z, Z,  0,  1, Z,
+	                             Z,  2,  3, Z, Z,  2,  3, Z);
+	shuf->uv[1]  = _mm_setr_epi8(Z,  4,  5, Z, Z,  4,  5, Z,
+	                             Z,  6,  7, Z, Z,  6,  7, Z);
+	shuf->uv[2]  = _mm_setr_epi8(Z,  8,  9, Z, Z,  8,  9, Z,
+	                             Z, 10, 11, Z, Z, 10, 11, Z);
+	shuf->uv[3]  = _mm_setr_epi8(Z, 12, 13, Z, Z, 12, 13, Z,
+	                             Z, 14, 15, Z, Z, 14, 15, Z);
+}
+
+/* writes 16 pixels of Y, U, V, 0 from 16 lum values and 8 interleaved U/V
+ * pairs */
+static inline void store_yuv(uint32_t *output, const __m128i lum,
+		const __m128i uv, const struct yuv_shuffle *shuf)
+{
+	__m128i *out = (__m128i*)output;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		_mm_storeu_si128(out + i, _mm_or_si128(
+				_mm_shuffle_epi8(lum, shuf->lum[i]),
+				_mm_shuffle_epi8(uv,  shuf->uv[i])));
+}
+
+static void decompress_420_ssse3(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v)
+{
+	uint8_t       *output = output_v;
+	const uint8_t *input  = input_v;
+	const uint8_t *input2 = input + width * height;
+	const uint8_t *input3 = input2 + width * height / 4;
+
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t width_d2   = width/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	struct yuv_shuffle shuf;
+	init_yuv_shuffle(&shuf);
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma0 = input2 + y * width_d2;
+		const uint8_t *chroma1 = input3 + y * width_d2;
+		const uint8_t *lum0    = input + y * 2*width;
+		const uint8_t *lum1    = lum0 + width;
+		uint32_t *output0 = (uint32_t*)(output + y * 2*row_bytes);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			__m128i u  = _mm_loadl_epi64(
+					(const __m128i*)(chroma0 + (x>>1)));
+			__m128i v  = _mm_loadl_epi64(
+					(const __m128i*)(chroma1 + (x>>1)));
+			__m128i uv = _mm_unpacklo_epi8(u, v);
+
+			store_yuv(output0 + x, _mm_loadu_si128(
+					(const __m128i*)(lum0 + x)), uv, &shuf);
+			store_yuv(output1 + x, _mm_loadu_si128(
+					(const __m128i*)(lum1 + x)), uv, &shuf);
+		}
+
+		decompress_420_lines_c(lum0, lum1, chroma0, chroma1, 1,
+				output0, output1, x, width);
+	}
+}
+
+static void decompress_nv12_ssse3(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v)
+{
+	uint8_t       *output = output_v;
+	const uint8_t *input  = input_v;
+	const uint8_t *input2 = input + width * height;
+
+	uint32_t start_y_d2 = start_y/2;
+	uint32_t height_d2  = end_y/2;
+	uint32_t y;
+
+	struct yuv_shuffle shuf;
+	init_yuv_shuffle(&shuf);
+
+	for (y = start_y_d2; y < height_d2; y++) {
+		const uint8_t *chroma = input2 + y * width;
+		const uint8_t *lum0   = input + y * 2*width;
+		const uint8_t *lum1   = lum0 + width;
+		uint32_t *output0 = (uint32_t*)(output + y * 2*row_bytes);
+		uint32_t *output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			__m128i uv = _mm_loadu_si128(
+					(const __m128i*)(chroma + x));
+
+			store_yuv(output0 + x, _mm_loadu_si128(
+					(const __m128i*)(lum0 + x)), uv, &shuf);
+			store_yuv(output1 + x, _mm_loadu_si128(
+					(const __m128i*)(lum1 + x)), uv, &shuf);
+		}
+
+		decompress_420_lines_c(lum0, lum1, chroma, chroma + 1, 2,
+				output0, output1, x, width);
+	}
+}
+
+static void decompress_422_ssse3(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void *output_v,
+		bool leading_lum)
+{
+	const uint8_t *input  = input_v;
+	uint8_t       *output = output_v;
+
+	uint32_t line_size = width * 2;
+	uint32_t y;
+
+	/* each pair expands to two pixels, the second of which has its lum
+	 * value copied over the first lum position */
+	const __m128i shuf_lo = leading_lum ?
+		_mm_setr_epi8(0, 1, 2, 3,  2, 1, 2, 3,
+		              4, 5, 6, 7,  6, 5, 6, 7) :
+		_mm_setr_epi8(0, 1, 2, 3,  0, 3, 2, 3,
+		              4, 5, 6, 7,  4, 7, 6, 7);
+	const __m128i shuf_hi = _mm_add_epi8(shuf_lo, _mm_set1_epi8(8));
+
+	for (y = start_y; y < end_y; y++) {
+		const uint8_t *line  = input + y*line_size;
+		uint32_t      *out32 = (uint32_t*)(output + y*row_bytes);
+		uint32_t x;
+
+		for (x = 0; x + 16 <= width; x += 16) {
+			const __m128i *in  = (const __m128i*)(line + x*2);
+			__m128i       *out = (__m128i*)(out32 + x);
+			__m128i val0 = _mm_loadu_si128(in);
+			__m128i val1 = _mm_loadu_si128(in + 1);
+
+			_mm_storeu_si128(out,     _mm_shuffle_epi8(val0, shuf_lo));
+			_mm_storeu_si128(out + 1, _mm_shuffle_epi8(val0, shuf_hi));
+			_mm_storeu_si128(out + 2, _mm_shuffle_epi8(val1, shuf_lo));
+			_mm_storeu_si128(out + 3, _mm_shuffle_epi8(val1, shuf_hi));
+		}
+
+		decompress_422_line_c(line, out32, x, width, leading_lum);
+	}
+}
+
+const struct format_conversion_funcs format_conversion_ssse3 = {
+	compress_uyvx_to_i420_ssse3,
+	compress_uyvx_to_nv12_ssse3,
+	decompress_nv12_ssse3,
+	decompress_420_ssse3,
+	decompress_422_ssse3
+};
+
+#endif
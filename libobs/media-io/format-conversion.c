@@ -15,79 +15,20 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "format-conversion.h"
-#include <xmmintrin.h>
-#include <emmintrin.h>
-
-static inline uint32_t get_m128_32_0(const __m128i val)
-{
-	return *(uint32_t* const)&val;
-}
-
-static inline uint32_t get_m128_32_1(const __m128i val)
-{
-	return *(((uint32_t* const)&val)+1);
-}
-
-static inline void pack_lum(uint8_t *lum_plane,
-		uint32_t lum_pos0, uint32_t lum_pos1,
-		const __m128i line1, const __m128i line2,
-		const __m128i lum_mask)
-{
-	__m128i pack_val = _mm_packs_epi32(
-			_mm_srli_si128(_mm_and_si128(line1, lum_mask), 1),
-			_mm_srli_si128(_mm_and_si128(line2, lum_mask), 1));
-	pack_val = _mm_packus_epi16(pack_val, pack_val);
-
-	*(uint32_t*)(lum_plane+lum_pos0) = get_m128_32_0(pack_val);
-	*(uint32_t*)(lum_plane+lum_pos1) = get_m128_32_1(pack_val);
-}
-
-static inline void pack_chroma_1plane(uint8_t *uv_plane,
-		uint32_t chroma_pos,
-		const __m128i line1, const __m128i line2,
-		const __m128i uv_mask)
-{
-	__m128i add_val = _mm_add_epi64(
-			_mm_and_si128(line1, uv_mask),
-			_mm_and_si128(line2, uv_mask));
-	__m128i avg_val = _mm_add_epi64(
-			add_val,
-			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
-	avg_val = _mm_srai_epi16(avg_val, 2);
-	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
-	avg_val = _mm_packus_epi16(avg_val, avg_val);
-
-	*(uint32_t*)(uv_plane+chroma_pos) = get_m128_32_0(avg_val);
-}
-
-static inline void pack_chroma_2plane(uint8_t *u_plane, uint8_t *v_plane,
-		uint32_t chroma_pos,
-		const __m128i line1, const __m128i line2,
-		const __m128i uv_mask)
-{
-	uint32_t packed_vals;
-
-	__m128i add_val = _mm_add_epi64(
-			_mm_and_si128(line1, uv_mask),
-			_mm_and_si128(line2, uv_mask));
-	__m128i avg_val = _mm_add_epi64(
-			add_val,
-			_mm_shuffle_epi32(add_val, _MM_SHUFFLE(2, 3, 0, 1)));
-	avg_val = _mm_srai_epi16(avg_val, 2);
-	avg_val = _mm_shuffle_epi32(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
-	avg_val = _mm_shufflelo_epi16(avg_val, _MM_SHUFFLE(3, 1, 2, 0));
-	avg_val = _mm_packus_epi16(avg_val, avg_val);
-
-	packed_vals = get_m128_32_0(avg_val);
-
-	*(uint16_t*)(u_plane+chroma_pos) = (uint16_t)(packed_vals);
-	*(uint16_t*)(v_plane+chroma_pos) = (uint16_t)(packed_vals>>16);
-}
-
-void compress_uyvx_to_i420(const void *input_v, uint32_t width, uint32_t height,
-		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
-		void **output)
+#include <stddef.h>
+#include "format-conversion-internal.h"
+
+#ifdef FORMAT_CONVERSION_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+static void compress_uyvx_to_i420_c(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, void **output)
 {
 	const uint8_t *input = input_v;
 	uint8_t  *lum_plane   = output[0];
@@ -96,86 +37,40 @@ void compress_uyvx_to_i420(const void *input_v, uint32_t width, uint32_t height,
 	uint32_t chroma_pitch = width >> 1;
 	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
-
 	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos        = y * row_bytes;
+		const uint8_t *line1 = input + y * row_bytes;
+		uint8_t       *lum1  = lum_plane + y * width;
 		uint32_t chroma_y_pos = (y>>1) * chroma_pitch;
-		uint32_t lum_y_pos    = y * width;
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x*4;
-			uint32_t lum_pos0  = lum_y_pos + x;
-			uint32_t lum_pos1  = lum_pos0 + width;
-
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + row_bytes));
-
-			pack_lum(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask);
-			pack_chroma_2plane(u_plane, v_plane,
-					chroma_y_pos + (x>>1),
-					line1, line2, uv_mask);
-		}
+
+		compress_uyvx_lines_c(line1, line1 + row_bytes,
+				lum1, lum1 + width,
+				u_plane + chroma_y_pos, v_plane + chroma_y_pos,
+				1, 0, width);
 	}
 }
 
-static inline void _compress_uyvx_to_nv12(const uint8_t *input,
-		uint32_t width, uint32_t height, uint32_t pitch,
+static void compress_uyvx_to_nv12_c(const void *input_v,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
 		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
 		void **output)
 {
+	const uint8_t *input = input_v;
 	uint8_t *lum_plane    = output[0];
 	uint8_t *chroma_plane = output[1];
 	uint32_t y;
 
-	__m128i lum_mask = _mm_set1_epi32(0x0000FF00);
-	__m128i uv_mask  = _mm_set1_epi16(0x00FF);
-
 	for (y = start_y; y < end_y; y += 2) {
-		uint32_t y_pos        = y * pitch;
-		uint32_t chroma_y_pos = (y>>1) * row_bytes_out;
-		uint32_t lum_y_pos    = y * row_bytes_out;
-		uint32_t x;
-
-		for (x = 0; x < width; x += 4) {
-			const uint8_t *img = input + y_pos + x*4;
-			uint32_t lum_pos0  = lum_y_pos + x;
-			uint32_t lum_pos1  = lum_pos0 + row_bytes_out;
-
-			__m128i line1 = _mm_load_si128((const __m128i*)img);
-			__m128i line2 = _mm_load_si128(
-					(const __m128i*)(img + pitch));
-
-			pack_lum(lum_plane, lum_pos0, lum_pos1,
-					line1, line2, lum_mask);
-			pack_chroma_1plane(chroma_plane, chroma_y_pos + x,
-					line1, line2, uv_mask);
-		}
-	}
-}
+		const uint8_t *line1  = input + y * row_bytes;
+		uint8_t       *lum1   = lum_plane + y * row_bytes_out;
+		uint8_t       *chroma = chroma_plane + (y>>1) * row_bytes_out;
 
-void compress_uyvx_to_nv12(const void *input, uint32_t width, uint32_t height,
-		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
-		void **output)
-{
-	_compress_uyvx_to_nv12(input, width, height, row_bytes,
-			start_y, end_y, width, output);
-}
-
-void compress_uyvx_to_nv12_aligned(const void *input,
-		uint32_t width, uint32_t height, uint32_t row_bytes,
-		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
-		void **output)
-{
-	_compress_uyvx_to_nv12(input, width, height, row_bytes,
-			start_y, end_y, row_bytes_out, output);
+		compress_uyvx_lines_c(line1, line1 + row_bytes,
+				lum1, lum1 + row_bytes_out,
+				chroma, chroma + 1, 2, 0, width);
+	}
 }
 
-void decompress_420(const void *input_v, uint32_t width, uint32_t height,
+void decompress_420_c(const void *input_v, uint32_t width, uint32_t height,
 		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
 		void *output_v)
 {
@@ -190,31 +85,17 @@ void decompress_420(const void *input_v, uint32_t width, uint32_t height,
 	uint32_t y;
 
 	for (y = start_y_d2; y < height_d2; y++) {
-		const uint8_t *chroma0 = input2 + y * width_d2;
-		const uint8_t *chroma1 = input3 + y * width_d2;
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
-
-		lum0 = input + y * 2*width;
-		lum1 = lum0 + width;
-		output0 = (uint32_t*)(output + y * 2*row_bytes);
-		output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
-
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out;
-			out = (*(chroma0++) << 8) | (*(chroma1++) << 16);
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
+		const uint8_t *lum0    = input + y * 2*width;
+		uint32_t      *output0 = (uint32_t*)(output + y * 2*row_bytes);
+
+		decompress_420_lines_c(lum0, lum0 + width,
+				input2 + y * width_d2, input3 + y * width_d2, 1,
+				output0, (uint32_t*)((uint8_t*)output0 + row_bytes),
+				0, width);
 	}
 }
 
-void decompress_nv12(const void *input_v, uint32_t width, uint32_t height,
+void decompress_nv12_c(const void *input_v, uint32_t width, uint32_t height,
 		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
 		void *output_v)
 {
@@ -223,83 +104,238 @@ void decompress_nv12(const void *input_v, uint32_t width, uint32_t height,
 	const uint8_t *input2 = input + width * height;
 
 	uint32_t start_y_d2 = start_y/2;
-	uint32_t width_d2   = width/2;
 	uint32_t height_d2  = end_y/2;
 	uint32_t y;
 
 	for (y = start_y_d2; y < height_d2; y++) {
-		const uint16_t *chroma = (uint16_t*)(input2 + y * width);
-		register const uint8_t *lum0, *lum1;
-		register uint32_t *output0, *output1;
-		uint32_t x;
-
-		lum0 = input + y * 2*width;
-		lum1 = lum0 + width;
-		output0 = (uint32_t*)(output + y * 2*row_bytes);
-		output1 = (uint32_t*)((uint8_t*)output0 + row_bytes);
-
-		for (x = 0; x < width_d2; x++) {
-			uint32_t out = *(chroma++) << 8;
-
-			*(output0++) = *(lum0++) | out;
-			*(output0++) = *(lum0++) | out;
-
-			*(output1++) = *(lum1++) | out;
-			*(output1++) = *(lum1++) | out;
-		}
+		const uint8_t *chroma  = input2 + y * width;
+		const uint8_t *lum0    = input + y * 2*width;
+		uint32_t      *output0 = (uint32_t*)(output + y * 2*row_bytes);
+
+		decompress_420_lines_c(lum0, lum0 + width,
+				chroma, chroma + 1, 2,
+				output0, (uint32_t*)((uint8_t*)output0 + row_bytes),
+				0, width);
 	}
 }
 
-void decompress_422(const void *input_v, uint32_t width, uint32_t height,
+void decompress_422_c(const void *input_v, uint32_t width, uint32_t height,
 		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
 		void *output_v, bool leading_lum)
 {
 	const uint8_t *input  = input_v;
 	uint8_t       *output = output_v;
 
-	uint32_t width_d2  = width >> 1;
 	uint32_t line_size = width * 2;
 	uint32_t y;
 
-	register const uint32_t *input32;
-	register const uint32_t *input32_end;
-	register uint32_t       *output32;
-
-	if (leading_lum) {
-		for (y = start_y; y < end_y; y++) {
-			input32     = (uint32_t*)(input + y*line_size);
-			input32_end = input32 + width_d2;
-			output32    = (uint32_t*)(output + y*row_bytes);
-
-			while(input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFFFF00;
-				dw |= (uint8_t)(dw>>16);
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
-	} else {
-		for (y = start_y; y < end_y; y++) {
-			input32     = (uint32_t*)(input + y*line_size);
-			input32_end = input32 + width_d2;
-			output32    = (uint32_t*)(output + y*row_bytes);
-
-			while (input32 < input32_end) {
-				register uint32_t dw = *input32;
-
-				output32[0] = dw;
-				dw &= 0xFFFF00FF;
-				dw |= (dw>>16) & 0xFF00;
-				output32[1] = dw;
-
-				output32 += 2;
-				input32++;
-			}
-		}
+	for (y = start_y; y < end_y; y++)
+		decompress_422_line_c(input + y*line_size,
+				(uint32_t*)(output + y*row_bytes),
+				0, width, leading_lum);
+}
+
+const struct format_conversion_funcs format_conversion_c = {
+	compress_uyvx_to_i420_c,
+	compress_uyvx_to_nv12_c,
+	decompress_nv12_c,
+	decompress_420_c,
+	decompress_422_c
+};
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef FORMAT_CONVERSION_X86
+
+#ifdef _MSC_VER
+static inline void get_cpuid(int info[4], int leaf)
+{
+	__cpuidex(info, leaf, 0);
+}
+
+static inline uint64_t get_xcr0(void)
+{
+	return _xgetbv(0);
+}
+#else
+static inline void get_cpuid(int info[4], int leaf)
+{
+	unsigned int eax, ebx, ecx, edx;
+	__cpuid_count(leaf, 0, eax, ebx, ecx, edx);
+	info[0] = (int)eax;
+	info[1] = (int)ebx;
+	info[2] = (int)ecx;
+	info[3] = (int)edx;
+}
+
+static inline uint64_t get_xcr0(void)
+{
+	uint32_t eax, edx;
+	__asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t)edx << 32) | eax;
+}
+#endif
+
+static enum format_conversion_path detect_best_path(void)
+{
+	enum format_conversion_path path = FORMAT_CONVERSION_SCALAR;
+	int  info[4];
+	int  max_leaf;
+	bool os_avx;
+
+	get_cpuid(info, 0);
+	max_leaf = info[0];
+	if (max_leaf < 1)
+		return path;
+
+	get_cpuid(info, 1);
+	if (info[3] & (1<<26))
+		path = FORMAT_CONVERSION_SSE2;
+	if (info[2] & (1<<9))
+		path = FORMAT_CONVERSION_SSSE3;
+
+	/* AVX requires OS support for saving the YMM registers */
+	os_avx = (info[2] & (1<<27)) && (info[2] & (1<<28)) &&
+	         (get_xcr0() & 0x6) == 0x6;
+
+	if (os_avx && max_leaf >= 7) {
+		get_cpuid(info, 7);
+		if (info[1] & (1<<5))
+			path = FORMAT_CONVERSION_AVX2;
+	}
+
+	return path;
+}
+
+#else
+
+static inline enum format_conversion_path detect_best_path(void)
+{
+	return FORMAT_CONVERSION_SCALAR;
+}
+
+#endif
+
+static const struct format_conversion_funcs *get_path_funcs(
+		enum format_conversion_path path)
+{
+	switch (path) {
+#ifdef FORMAT_CONVERSION_X86
+	case FORMAT_CONVERSION_SSE2:   return &format_conversion_sse2;
+	case FORMAT_CONVERSION_SSSE3:  return &format_conversion_ssse3;
+	case FORMAT_CONVERSION_AVX2:   return &format_conversion_avx2;
+#endif
+	case FORMAT_CONVERSION_SCALAR: return &format_conversion_c;
+	default:                       return NULL;
 	}
 }
+
+/* the detected values are always the same, so there's no harm if more than
+ * one thread happens to initialize them at the same time */
+static bool                                  best_path_detected = false;
+static enum format_conversion_path           best_path;
+static enum format_conversion_path           cur_path;
+static const struct format_conversion_funcs *cur_funcs = NULL;
+
+enum format_conversion_path format_conversion_best_path(void)
+{
+	if (!best_path_detected) {
+		best_path          = detect_best_path();
+		best_path_detected = true;
+	}
+
+	return best_path;
+}
+
+bool format_conversion_set_path(enum format_conversion_path path)
+{
+	const struct format_conversion_funcs *funcs;
+
+	if (path > format_conversion_best_path())
+		return false;
+
+	funcs = get_path_funcs(path);
+	if (!funcs)
+		return false;
+
+	cur_path  = path;
+	cur_funcs = funcs;
+	return true;
+}
+
+enum format_conversion_path format_conversion_get_path(void)
+{
+	if (!cur_funcs)
+		format_conversion_set_path(format_conversion_best_path());
+	return cur_path;
+}
+
+const char *format_conversion_path_name(enum format_conversion_path path)
+{
+	switch (path) {
+	case FORMAT_CONVERSION_SCALAR: return "scalar";
+	case FORMAT_CONVERSION_SSE2:   return "sse2";
+	case FORMAT_CONVERSION_SSSE3:  return "ssse3";
+	case FORMAT_CONVERSION_AVX2:   return "avx2";
+	}
+
+	return "unknown";
+}
+
+static inline const struct format_conversion_funcs *get_funcs(void)
+{
+	if (!cur_funcs)
+		format_conversion_set_path(format_conversion_best_path());
+	return cur_funcs;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void compress_uyvx_to_i420(const void *input, uint32_t width, uint32_t height,
+		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
+		void **output)
+{
+	get_funcs()->compress_uyvx_to_i420(input, width, height, row_bytes,
+			start_y, end_y, output);
+}
+
+void compress_uyvx_to_nv12(const void *input, uint32_t width, uint32_t height,
+		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
+		void **output)
+{
+	get_funcs()->compress_uyvx_to_nv12(input, width, height, row_bytes,
+			start_y, end_y, width, output);
+}
+
+void compress_uyvx_to_nv12_aligned(const void *input,
+		uint32_t width, uint32_t height, uint32_t row_bytes,
+		uint32_t start_y, uint32_t end_y, uint32_t row_bytes_out,
+		void **output)
+{
+	get_funcs()->compress_uyvx_to_nv12(input, width, height, row_bytes,
+			start_y, end_y, row_bytes_out, output);
+}
+
+void decompress_420(const void *input, uint32_t width, uint32_t height,
+		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
+		void *output)
+{
+	get_funcs()->decompress_420(input, width, height, row_bytes,
+			start_y, end_y, output);
+}
+
+void decompress_nv12(const void *input, uint32_t width, uint32_t height,
+		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
+		void *output)
+{
+	get_funcs()->decompress_nv12(input, width, height, row_bytes,
+			start_y, end_y, output);
+}
+
+void decompress_422(const void *input, uint32_t width, uint32_t height,
+		uint32_t row_bytes, uint32_t start_y, uint32_t end_y,
+		void *output, bool leading_lum)
+{
+	get_funcs()->decompress_422(input, width, height, row_bytes,
+			start_y, end_y, output, leading_lum);
+}
@@ -23,6 +23,26 @@
 extern "C" {
 #endif
 
+/*
+ * The conversion functions use the fastest implementation supported by the
+ * CPU, which is detected on first use.  A specific implementation can be
+ * forced (for testing or benchmarking) with format_conversion_set_path,
+ * which fails if the CPU does not support it.
+ */
+
+enum format_conversion_path {
+	FORMAT_CONVERSION_SCALAR,
+	FORMAT_CONVERSION_SSE2,
+	FORMAT_CONVERSION_SSSE3,
+	FORMAT_CONVERSION_AVX2
+};
+
+EXPORT bool format_conversion_set_path(enum format_conversion_path path);
+EXPORT enum format_conversion_path format_conversion_get_path(void);
+EXPORT enum format_conversion_path format_conversion_best_path(void);
+EXPORT const char *format_conversion_path_name(
+		enum format_conversion_path path);
+
 EXPORT void compress_uyvx_to_i420(const void *input,
 		uint32_t width, uint32_t height, uint32_t row_bytes,
 		uint32_t start_y, uint32_t end_y, void **output);
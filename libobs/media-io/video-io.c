@@ -21,14 +21,28 @@
 #include "../util/threading.h"
 #include "../util/darray.h"
 
+#include "format-conversion.h"
+#include "conversion-pool.h"
 #include "video-io.h"
 
 struct video_input {
 	struct video_convert_info conversion;
 	void (*callback)(void *param, const struct video_frame *frame);
+	void (*skip_handler)(void *param, uint32_t skipped);
 	void *param;
 };
 
+/* each distinct conversion is only done once per frame, and is shared by
+ * all inputs that requested it */
+struct video_conversion {
+	struct video_convert_info info;
+	struct video_frame        frame;
+	uint8_t                   *buffer;
+	uint32_t                  linesize;
+	size_t                    refs;
+	bool                      converted;
+};
+
 struct video_output {
 	struct video_output_info   info;
 
@@ -38,14 +52,28 @@ struct video_output {
 
 	struct video_frame         *cur_frame;
 	struct video_frame         *next_frame;
+
+	/* set while the inputs are using cur_frame, it can't be released
+	 * until they're done */
+	bool                       frame_busy;
 	event_t                    update_event;
 	uint64_t                   frame_time;
 	volatile uint64_t          cur_video_time;
 
+	/* frame times are derived from the frame count and the exact
+	 * fps_den/fps_num ratio, so they never accumulate rounding drift */
+	uint64_t                   start_time;
+	uint64_t                   frame_period; /* fps_den seconds, in ns */
+	volatile uint64_t          total_frames;
+	volatile uint64_t          late_frames;
+	volatile uint64_t          skipped_frames;
+
 	bool                       initialized;
 
 	pthread_mutex_t            input_mutex;
 	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_conversion) conversions;
+	conversion_pool_t          conversion_pool;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -59,40 +87,285 @@ static inline void video_swapframes(struct video_output *video)
 		video->next_frame = NULL;
 	}
 
+	video->frame_busy = video->cur_frame != NULL;
+
 	pthread_mutex_unlock(&video->data_mutex);
 }
 
+static inline void video_frame_done(struct video_output *video)
+{
+	pthread_mutex_lock(&video->data_mutex);
+	video->frame_busy = false;
+	pthread_mutex_unlock(&video->data_mutex);
+}
+
+static inline bool conversion_matches(const struct video_convert_info *a,
+		const struct video_convert_info *b)
+{
+	return a->format    == b->format &&
+	       a->width     == b->width  &&
+	       a->height    == b->height &&
+	       a->row_align == b->row_align;
+}
+
+static inline bool needs_conversion(const struct video_output *video,
+		const struct video_convert_info *info)
+{
+	return info->format != video->info.format ||
+	       info->width  != video->info.width  ||
+	       info->height != video->info.height;
+}
+
+/* only UYVX to 420 with the same dimensions is currently implemented */
+static inline bool conversion_supported(const struct video_output *video,
+		const struct video_convert_info *info)
+{
+	if (video->info.format != VIDEO_FORMAT_UYVX)
+		return false;
+	if (info->width != video->info.width ||
+	    info->height != video->info.height)
+		return false;
+
+	return info->format == VIDEO_FORMAT_I420 ||
+	       info->format == VIDEO_FORMAT_NV12;
+}
+
+static size_t find_conversion(struct video_output *video,
+		const struct video_convert_info *info)
+{
+	for (size_t i = 0; i < video->conversions.num; i++) {
+		struct video_conversion *conv = video->conversions.array+i;
+		if (conversion_matches(&conv->info, info))
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+static void add_conversion(struct video_output *video,
+		const struct video_convert_info *info)
+{
+	struct video_conversion conv;
+	size_t idx = find_conversion(video, info);
+	uint32_t align = info->row_align ? info->row_align : 1;
+
+	if (idx != DARRAY_INVALID) {
+		video->conversions.array[idx].refs++;
+		return;
+	}
+
+	memset(&conv, 0, sizeof(struct video_conversion));
+	conv.info = *info;
+	conv.refs = 1;
+
+	/* planar I420 data is always tightly packed */
+	if (info->format == VIDEO_FORMAT_NV12)
+		conv.linesize = (info->width + align - 1) / align * align;
+	else
+		conv.linesize = info->width;
+
+	conv.buffer = bmalloc_tagged(conv.linesize * info->height * 3 / 2,
+			BMEM_TAG_VIDEO);
+	conv.frame.data     = conv.buffer;
+	conv.frame.row_size = conv.linesize;
+
+	da_push_back(video->conversions, &conv);
+}
+
+static void remove_conversion(struct video_output *video,
+		const struct video_convert_info *info)
+{
+	size_t idx = find_conversion(video, info);
+	struct video_conversion *conv;
+
+	if (idx == DARRAY_INVALID)
+		return;
+
+	conv = video->conversions.array+idx;
+	if (--conv->refs == 0) {
+		bfree(conv->buffer);
+		da_erase(video->conversions, idx);
+	}
+}
+
+struct convert_job {
+	const struct video_frame  *frame;
+	struct video_conversion   *conv;
+	uint32_t                  width;
+	uint32_t                  height;
+	void                      *planes[3];
+};
+
+static void convert_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct convert_job *job = param;
+
+	if (job->conv->info.format == VIDEO_FORMAT_I420)
+		compress_uyvx_to_i420(job->frame->data, job->width,
+				job->height, job->frame->row_size,
+				start_y, end_y, job->planes);
+	else
+		compress_uyvx_to_nv12_aligned(job->frame->data, job->width,
+				job->height, job->frame->row_size,
+				start_y, end_y, job->conv->linesize,
+				job->planes);
+}
+
+static void convert_frame(struct video_output *video,
+		struct video_conversion *conv)
+{
+	struct convert_job job;
+
+	job.frame  = video->cur_frame;
+	job.conv   = conv;
+	job.width  = video->info.width;
+	job.height = video->info.height;
+
+	job.planes[0] = conv->buffer;
+	job.planes[1] = conv->buffer + conv->linesize * job.height;
+	job.planes[2] = (uint8_t*)job.planes[1] + job.width * job.height / 4;
+
+	conversion_pool_run(video->conversion_pool, convert_band, &job,
+			job.height, 2);
+
+	conv->frame.timestamp = job.frame->timestamp;
+	conv->converted = true;
+}
+
+static inline const struct video_frame *get_input_frame(
+		struct video_output *video, struct video_input *input)
+{
+	struct video_conversion *conv;
+	size_t idx;
+
+	if (!needs_conversion(video, &input->conversion))
+		return video->cur_frame;
+
+	idx = find_conversion(video, &input->conversion);
+	if (idx == DARRAY_INVALID)
+		return video->cur_frame;
+
+	conv = video->conversions.array+idx;
+	if (!conv->converted)
+		convert_frame(video, conv);
+
+	return &conv->frame;
+}
+
 static inline void video_output_cur_frame(struct video_output *video)
 {
+	size_t i;
+
 	if (!video->cur_frame)
 		return;
 
 	pthread_mutex_lock(&video->input_mutex);
 
-	/* TODO: conversion */
-	for (size_t i = 0; i < video->inputs.num; i++) {
+	for (i = 0; i < video->conversions.num; i++)
+		video->conversions.array[i].converted = false;
+
+	for (i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array+i;
+		input->callback(input->param, get_input_frame(video, input));
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+/* val * mul / div without overflowing as long as (div - 1) * mul fits */
+static inline uint64_t mul_div64(uint64_t val, uint64_t mul, uint64_t div)
+{
+	return (val / div) * mul + (val % div) * mul / div;
+}
+
+/* time of the given half frame since the start of the clock */
+static inline uint64_t half_frame_time(struct video_output *video,
+		uint64_t half_frame)
+{
+	return video->start_time + mul_div64(half_frame, video->frame_period,
+			(uint64_t)video->info.fps_num * 2);
+}
+
+/* number of whole frames elapsed at the given time */
+static inline uint64_t frames_elapsed(struct video_output *video,
+		uint64_t time)
+{
+	if (time <= video->start_time)
+		return 0;
+
+	return mul_div64(time - video->start_time, video->info.fps_num,
+			video->frame_period);
+}
+
+static void video_output_skipped(struct video_output *video, uint32_t count)
+{
+	size_t i;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	for (i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
-		input->callback(input->param, video->cur_frame);
+		if (input->skip_handler)
+			input->skip_handler(input->param, count);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 }
 
+/*
+ * Frame n is updated at half frame 2n+1 and output at half frame 2n+2.  If
+ * the thread wakes up a whole frame or more past the output time, the frames
+ * it missed are skipped rather than output in a burst.
+ */
+static uint32_t video_wait_output(struct video_output *video,
+		uint64_t frame)
+{
+	uint64_t target = half_frame_time(video, frame * 2 + 2);
+	uint64_t cur_time, elapsed;
+
+	os_sleepto_ns(target);
+	cur_time = os_gettime_ns();
+	elapsed  = frames_elapsed(video, cur_time);
+
+	if (elapsed > frame + 1)
+		return (uint32_t)(elapsed - frame - 1);
+
+	if (cur_time - target > video->frame_time / 2)
+		video->late_frames++;
+
+	return 0;
+}
+
 static void *video_thread(void *param)
 {
 	struct video_output *video = param;
-	uint64_t cur_time = os_gettime_ns();
+	uint64_t frame = 0;
+
+	video->start_time = os_gettime_ns();
 
 	while (event_try(&video->stop_event) == EAGAIN) {
+		uint32_t skipped;
+
 		/* wait half a frame, update frame */
-		os_sleepto_ns(cur_time += (video->frame_time/2));
-		video->cur_video_time = cur_time;
+		os_sleepto_ns(half_frame_time(video, frame * 2 + 1));
+		video->cur_video_time = half_frame_time(video, frame * 2 + 1);
 		event_signal(&video->update_event);
 
 		/* wait another half a frame, swap and output frames */
-		os_sleepto_ns(cur_time += (video->frame_time/2));
+		skipped = video_wait_output(video, frame);
+
 		video_swapframes(video);
 		video_output_cur_frame(video);
+		video_frame_done(video);
+
+		video->total_frames++;
+		frame++;
+
+		if (skipped) {
+			video->skipped_frames += skipped;
+			frame += skipped;
+			video_output_skipped(video, skipped);
+		}
 	}
 
 	return NULL;
@@ -117,8 +390,8 @@ int video_output_open(video_t *video, struct video_output_info *info)
 	memset(out, 0, sizeof(struct video_output));
 
 	memcpy(&out->info, info, sizeof(struct video_output_info));
-	out->frame_time = (uint64_t)(1000000000.0 * (double)info->fps_den /
-		(double)info->fps_num);
+	out->frame_period = (uint64_t)info->fps_den * 1000000000ULL;
+	out->frame_time   = out->frame_period / info->fps_num;
 	out->initialized = false;
 
 	if (pthread_mutex_init(&out->data_mutex, NULL) != 0)
@@ -129,6 +402,9 @@ int video_output_open(video_t *video, struct video_output_info *info)
 		goto fail;
 	if (event_init(&out->update_event, EVENT_TYPE_AUTO) != 0)
 		goto fail;
+
+	out->conversion_pool = conversion_pool_create(0);
+
 	if (pthread_create(&out->thread, NULL, video_thread, out) != 0)
 		goto fail;
 
@@ -147,7 +423,12 @@ void video_output_close(video_t video)
 		return;
 
 	video_output_stop(video);
+	conversion_pool_destroy(video->conversion_pool);
 
+	for (size_t i = 0; i < video->conversions.num; i++)
+		bfree(video->conversions.array[i].buffer);
+
+	da_free(video->conversions);
 	da_free(video->inputs);
 	event_destroy(&video->update_event);
 	event_destroy(&video->stop_event);
@@ -176,12 +457,12 @@ void video_output_connect(video_t video,
 {
 	pthread_mutex_lock(&video->input_mutex);
 
-	if (video_get_input_idx(video, callback, param) != DARRAY_INVALID) {
+	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
 		struct video_input input;
-		input.callback = callback;
-		input.param    = param;
+		input.callback     = callback;
+		input.skip_handler = NULL;
+		input.param        = param;
 
-		/* TODO: conversion */
 		if (conversion) {
 			input.conversion = *conversion;
 
@@ -196,6 +477,17 @@ void video_output_connect(video_t video,
 			input.conversion.row_align = 1;
 		}
 
+		if (needs_conversion(video, &input.conversion)) {
+			if (conversion_supported(video, &input.conversion)) {
+				add_conversion(video, &input.conversion);
+			} else {
+				blog(LOG_WARNING, "video_output_connect: "
+				                  "Unsupported conversion "
+				                  "requested, raw frames will "
+				                  "be output instead");
+			}
+		}
+
 		da_push_back(video->inputs, &input);
 	}
 
@@ -209,8 +501,26 @@ void video_output_disconnect(video_t video,
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
-	if (idx != DARRAY_INVALID)
+	if (idx != DARRAY_INVALID) {
+		remove_conversion(video, &video->inputs.array[idx].conversion);
 		da_erase(video->inputs, idx);
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+}
+
+void video_output_set_skip_handler(video_t video,
+		void (*callback)(void *param, const struct video_frame *frame),
+		void *param,
+		void (*skip_handler)(void *param, uint32_t skipped))
+{
+	size_t idx;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID)
+		video->inputs.array[idx].skip_handler = skip_handler;
 
 	pthread_mutex_unlock(&video->input_mutex);
 }
@@ -227,6 +537,29 @@ void video_output_frame(video_t video, struct video_frame *frame)
 	pthread_mutex_unlock(&video->data_mutex);
 }
 
+bool video_output_release_frame(video_t video,
+		const struct video_frame *frame)
+{
+	bool released = true;
+
+	if (!video)
+		return true;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	if (video->cur_frame == frame) {
+		if (video->frame_busy)
+			released = false;
+		else
+			video->cur_frame = NULL;
+	}
+	if (video->next_frame == frame)
+		video->next_frame = NULL;
+
+	pthread_mutex_unlock(&video->data_mutex);
+	return released;
+}
+
 bool video_output_wait(video_t video)
 {
 	event_wait(&video->update_event);
@@ -256,3 +589,18 @@ void video_output_stop(video_t video)
 		event_signal(&video->update_event);
 	}
 }
+
+uint64_t video_output_total_frames(video_t video)
+{
+	return video ? video->total_frames : 0;
+}
+
+uint64_t video_output_late_frames(video_t video)
+{
+	return video ? video->late_frames : 0;
+}
+
+uint64_t video_output_skipped_frames(video_t video)
+{
+	return video ? video->skipped_frames : 0;
+}
@@ -86,13 +86,42 @@ EXPORT void video_output_disconnect(video_t video,
 		void (*callback)(void *param, const struct video_frame *frame),
 		void *param);
 
+/*
+ * Sets a handler that is called from the video thread when the output falls
+ * a frame or more behind and frames are skipped to catch up.  The input is
+ * identified by its callback/param pair.  skipped is the number of frame
+ * intervals that will never be output, so outputs can duplicate the last
+ * frame (or drop it from their own timeline) deterministically.
+ */
+EXPORT void video_output_set_skip_handler(video_t video,
+		void (*callback)(void *param, const struct video_frame *frame),
+		void *param,
+		void (*skip_handler)(void *param, uint32_t skipped));
+
 EXPORT const struct video_output_info *video_output_getinfo(video_t video);
 EXPORT void     video_output_frame(video_t video, struct video_frame *frame);
+
+/**
+ * Stops the output from using a frame passed to video_output_frame.  Call
+ * before the frame's data is freed or unmapped; the last frame is otherwise
+ * output again whenever no new frame arrives in time.  Doesn't wait: returns
+ * false if the frame is being output right now, in which case it's still in
+ * use and the call has to be repeated later.
+ */
+EXPORT bool     video_output_release_frame(video_t video,
+		const struct video_frame *frame);
+
 EXPORT bool     video_output_wait(video_t video);
 EXPORT uint64_t video_getframetime(video_t video);
 EXPORT uint64_t video_gettime(video_t video);
 EXPORT void     video_output_stop(video_t video);
 
+/* frames output so far, and frames that were output late (by more than half
+ * a frame) or skipped entirely because the output thread fell behind */
+EXPORT uint64_t video_output_total_frames(video_t video);
+EXPORT uint64_t video_output_late_frames(video_t video);
+EXPORT uint64_t video_output_skipped_frames(video_t video);
+
 #ifdef __cplusplus
 }
 #endif
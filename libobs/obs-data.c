@@ -118,7 +118,7 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	name_size = get_name_align_size(name);
 	total_size = name_size + sizeof(struct obs_data_item) + size;
 
-	item = bmalloc(total_size);
+	item = bmalloc_tagged(total_size, BMEM_TAG_DATA);
 	memset(item, 0, total_size);
 
 	item->capacity = total_size;
@@ -224,7 +224,8 @@ static inline void obs_data_item_setdata(
 
 obs_data_t obs_data_create()
 {
-	struct obs_data *data = bmalloc(sizeof(struct obs_data));
+	struct obs_data *data = bmalloc_tagged(sizeof(struct obs_data),
+			BMEM_TAG_DATA);
 	memset(data, 0, sizeof(struct obs_data));
 	data->ref = 1;
 
@@ -452,7 +453,8 @@ obs_data_array_t obs_data_getarray(obs_data_t data, const char *name)
 
 obs_data_array_t obs_data_array_create()
 {
-	struct obs_data_array *array = bmalloc(sizeof(struct obs_data_array));
+	struct obs_data_array *array = bmalloc_tagged(
+			sizeof(struct obs_data_array), BMEM_TAG_DATA);
 	memset(array, 0, sizeof(struct obs_data_array));
 	array->ref = 1;
 
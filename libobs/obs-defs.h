@@ -31,3 +31,4 @@
 #define SOURCE_ASYNC_VIDEO    (1<<2) /* Async video (use with SOURCE_VIDEO) */
 #define SOURCE_DEFAULT_EFFECT (1<<3) /* Source uses default/filter effect */
 #define SOURCE_YUV            (1<<4) /* Source is in YUV color space */
+#define SOURCE_STATIC_VIDEO   (1<<5) /* Video only changes on update */
@@ -24,6 +24,7 @@
 
 #include "media-io/video-io.h"
 #include "media-io/audio-io.h"
+#include "media-io/conversion-pool.h"
 
 #include "obs.h"
 #include "obs-module.h"
@@ -40,7 +41,11 @@
 			return false; \
 	} while (false)
 
-#define NUM_TEXTURES 2
+/* depth of the output texture ring.  frames are mapped NUM_TEXTURES-1 frames
+ * after being staged so that the GPU readback has finished by then */
+#ifndef NUM_TEXTURES
+#define NUM_TEXTURES 3
+#endif
 
 struct obs_display {
 	swapchain_t                 swap; /* can be NULL if just sound */
@@ -56,15 +61,51 @@ struct obs_video {
 	stagesurf_t                 copy_surfaces[NUM_TEXTURES];
 	texture_t                   render_textures[NUM_TEXTURES];
 	texture_t                   output_textures[NUM_TEXTURES];
+	texture_t                   convert_textures[NUM_TEXTURES];
 	effect_t                    default_effect;
-	bool                        textures_copied[NUM_TEXTURES];
-	bool                        copy_mapped;
+
+	/* default effect handles, looked up once when it's loaded so the
+	 * render loop doesn't have to look them up by name */
+	technique_t                 default_rgb_tech;
+	technique_t                 default_yuv_tech;
+	technique_t                 default_conversion_tech;
+	eparam_t                    default_diffuse;
+	eparam_t                    default_yuv_matrix;
+	eparam_t                    default_input_width;
+	eparam_t                    default_input_height;
+	eparam_t                    default_color_vec_y;
+	eparam_t                    default_color_vec_u;
+	eparam_t                    default_color_vec_v;
+
+	/* NV12/I420 output is converted on the GPU before staging */
+	bool                        gpu_conversion;
+	const char                  *conversion_tech;
+	bool                        textures_staged[NUM_TEXTURES];
+	bool                        textures_mapped[NUM_TEXTURES];
+	uint64_t                    texture_timestamps[NUM_TEXTURES];
+	struct video_frame          output_frames[NUM_TEXTURES];
 	int                         cur_texture;
 
+	/* counts rendered frames, graphics thread only */
+	uint64_t                    frame_index;
+
+	/* time spent waiting on stagesurface_map */
+	volatile int64_t            map_stall_ns;
+	uint64_t                    map_stall_total_ns;
+	uint64_t                    map_stall_max_ns;
+	uint64_t                    num_mapped_frames;
+
+	/* totals over every scene rendered in the last video frame */
+	volatile long               frame_draw_calls;
+	volatile long               frame_uniform_uploads;
+
 	video_t                     video;
 	pthread_t                   video_thread;
 	bool                        thread_initialized;
 
+	/* used for converting async source frames */
+	conversion_pool_t           conversion_pool;
+
 	uint32_t                    base_width;
 	uint32_t                    base_height;
 };
@@ -16,7 +16,16 @@
 ******************************************************************************/
 
 #include "graphics/math-defs.h"
+#include "graphics/vec4.h"
 #include "obs-scene.h"
+#include "obs-internal.h"
+
+/* items have to stay unchanged for this many frames before they're cached,
+ * so sources that change every other frame don't rebuild a cache each time */
+#define SCENE_CACHE_STABLE_FRAMES 2
+
+/* shorter runs are cheaper to draw directly than through a composite */
+#define SCENE_CACHE_MIN_ITEMS     2
 
 static inline void signal_item_remove(struct obs_scene_item *item)
 {
@@ -39,8 +48,8 @@ static void *scene_create(obs_data_t settings, struct obs_source *source)
 {
 	pthread_mutexattr_t attr;
 	struct obs_scene *scene = bmalloc(sizeof(struct obs_scene));
+	memset(scene, 0, sizeof(struct obs_scene));
 	scene->source     = source;
-	scene->first_item = NULL;
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
@@ -77,6 +86,12 @@ static void scene_destroy(void *data)
 
 	pthread_mutex_unlock(&scene->mutex);
 
+	gs_entercontext(obs_graphics());
+	for (size_t i = 0; i < scene->caches.num; i++)
+		texrender_destroy(scene->caches.array[i].texrender);
+	gs_leavecontext();
+
+	da_free(scene->caches);
 	pthread_mutex_destroy(&scene->mutex);
 	bfree(scene);
 }
@@ -115,16 +130,237 @@ static inline void attach_sceneitem(struct obs_scene_item *item,
 	}
 }
 
+static inline void item_changed(struct obs_scene_item *item)
+{
+	os_atomic_inc_long(&item->gen);
+	if (item->parent)
+		obs_source_changed(item->parent->source);
+}
+
+static inline void invalidate_caches(struct obs_scene *scene)
+{
+	for (size_t i = 0; i < scene->caches.num; i++)
+		scene->caches.array[i].valid = false;
+}
+
+/* an item can be cached once its source is static and neither it nor its
+ * source have changed for SCENE_CACHE_STABLE_FRAMES frames */
+static bool check_item(struct obs_scene_item *item, bool *changed)
+{
+	bool static_video;
+	long gen;
+
+	if (obs_source_removed(item->source)) {
+		item->cacheable = false;
+		return false;
+	}
+
+	static_video = obs_source_content_static(item->source, &gen);
+	gen += os_atomic_load_long(&item->gen);
+
+	if (gen != item->last_gen) {
+		item->last_gen      = gen;
+		item->stable_frames = 0;
+		*changed = true;
+
+	} else if (item->stable_frames < SCENE_CACHE_STABLE_FRAMES) {
+		item->stable_frames++;
+	}
+
+	item->cacheable = static_video &&
+		item->stable_frames >= SCENE_CACHE_STABLE_FRAMES;
+	return static_video;
+}
+
+bool obs_scene_content_static(obs_scene_t scene)
+{
+	struct obs_scene_item *item;
+	bool static_video = true;
+	bool changed      = false;
+
+	pthread_mutex_lock(&scene->mutex);
+
+	if (scene->checked_frame == obs->video.frame_index) {
+		static_video = scene->content_static;
+		pthread_mutex_unlock(&scene->mutex);
+		return static_video;
+	}
+
+	for (item = scene->first_item; item; item = item->next)
+		if (!check_item(item, &changed))
+			static_video = false;
+
+	scene->checked_frame  = obs->video.frame_index;
+	scene->content_static = static_video;
+
+	pthread_mutex_unlock(&scene->mutex);
+
+	/* a nested scene changes whenever one of its items does */
+	if (changed)
+		obs_source_changed(scene->source);
+
+	return static_video;
+}
+
+static inline void render_item(struct obs_scene_item *item)
+{
+	gs_matrix_push();
+	gs_matrix_translate3f(item->origin.x, item->origin.y, 0.0f);
+	gs_matrix_scale3f(item->scale.x, item->scale.y, 1.0f);
+	gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, RAD(-item->rot));
+	gs_matrix_translate3f(-item->pos.x, -item->pos.y, 0.0f);
+
+	obs_source_video_render(item->source);
+
+	gs_matrix_pop();
+}
+
+static void render_run(struct obs_scene_item *item, size_t count)
+{
+	for (; count && item; count--, item = item->next)
+		if (!obs_source_removed(item->source))
+			render_item(item);
+}
+
+static size_t cacheable_run_length(struct obs_scene_item *item)
+{
+	size_t count = 0;
+
+	for (; item && item->cacheable; item = item->next) {
+		if (obs_source_removed(item->source))
+			break;
+		count++;
+	}
+
+	return count;
+}
+
+static bool build_cache(struct obs_scene_cache *cache,
+		struct obs_scene_item *first, size_t count)
+{
+	uint32_t    cx = obs->video.base_width;
+	uint32_t    cy = obs->video.base_height;
+	struct vec4 clear_color;
+
+	if (!cache->texrender)
+		cache->texrender = texrender_create(GS_RGBA, GS_ZS_NONE);
+
+	texrender_reset(cache->texrender);
+	if (!texrender_begin(cache->texrender, cx, cy))
+		return false;
+
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+	/* the composite is kept with premultiplied alpha, so drawing it with
+	 * ONE/INVSRCALPHA gives the same result as drawing the items
+	 * directly */
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	gs_blendfunction_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	gs_sprite_batch_begin();
+	render_run(first, count);
+	gs_sprite_batch_end();
+
+	gs_blend_state_pop();
+	texrender_end(cache->texrender);
+
+	cache->first = first;
+	cache->count = count;
+	cache->cx    = cx;
+	cache->cy    = cy;
+	cache->valid = true;
+	return true;
+}
+
+static void draw_cache(struct obs_scene_cache *cache)
+{
+	struct obs_video *video = &obs->video;
+	texture_t   tex  = texrender_gettexture(cache->texrender);
+	technique_t tech = video->default_rgb_tech;
+
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	gs_blendfunction_separate(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	technique_begin(tech);
+	technique_beginpass(tech, 0);
+
+	effect_settexture(video->default_effect, video->default_diffuse, tex);
+	gs_draw_sprite(tex, 0, 0, 0);
+
+	technique_endpass(tech);
+	technique_end(tech);
+
+	gs_blend_state_pop();
+}
+
+static inline bool cache_current(const struct obs_scene_cache *cache,
+		const struct obs_scene_item *first, size_t count)
+{
+	return cache->valid && cache->first == first &&
+	       cache->count == count &&
+	       cache->cx == obs->video.base_width &&
+	       cache->cy == obs->video.base_height;
+}
+
+/* the run in cache slot 'idx' is only reused if it's exactly the run that
+ * was in that slot last frame; anything else rebuilds it */
+static void render_cached_run(struct obs_scene *scene, size_t idx,
+		struct obs_scene_item *first, size_t count)
+{
+	struct obs_scene_cache *cache;
+
+	if (idx == scene->caches.num)
+		da_push_back_new(scene->caches);
+
+	cache = scene->caches.array+idx;
+
+	if (cache_current(cache, first, count) ||
+	    build_cache(cache, first, count)) {
+		draw_cache(cache);
+	} else {
+		cache->valid = false;
+		render_run(first, count);
+	}
+}
+
+static void free_unused_caches(struct obs_scene *scene, size_t used)
+{
+	for (size_t i = used; i < scene->caches.num; i++)
+		texrender_destroy(scene->caches.array[i].texrender);
+
+	if (used < scene->caches.num)
+		da_resize(scene->caches, used);
+}
+
+/*
+ * Runs of consecutive items that haven't changed for a while are drawn from
+ * a composite as a single quad, so static overlays stay cheap even when a
+ * live source (a webcam, say) sits between them.  Everything else is drawn
+ * directly.
+ */
 static void scene_video_render(void *data)
 {
-	struct obs_scene *scene = data;
+	struct obs_scene      *scene = data;
 	struct obs_scene_item *item;
+	size_t                runs = 0;
 
 	pthread_mutex_lock(&scene->mutex);
 
-	item = scene->first_item;
+	obs_scene_content_static(scene);
+
+	/* items drawn with the same effect state go out in one draw call */
+	gs_sprite_batch_begin();
 
+	item = scene->first_item;
 	while (item) {
+		size_t count;
+
 		if (obs_source_removed(item->source)) {
 			struct obs_scene_item *del_item = item;
 			item = item->next;
@@ -133,19 +369,23 @@ static void scene_video_render(void *data)
 			continue;
 		}
 
-		gs_matrix_push();
-		gs_matrix_translate3f(item->origin.x, item->origin.y, 0.0f);
-		gs_matrix_scale3f(item->scale.x, item->scale.y, 1.0f);
-		gs_matrix_rotaa4f(0.0f, 0.0f, 1.0f, RAD(-item->rot));
-		gs_matrix_translate3f(-item->pos.x, -item->pos.y, 0.0f);
-
-		obs_source_video_render(item->source);
+		count = cacheable_run_length(item);
+		if (count < SCENE_CACHE_MIN_ITEMS) {
+			render_item(item);
+			item = item->next;
+			continue;
+		}
 
-		gs_matrix_pop();
+		render_cached_run(scene, runs++, item, count);
 
-		item = item->next;
+		while (count--)
+			item = item->next;
 	}
 
+	gs_sprite_batch_end();
+
+	free_unused_caches(scene, runs);
+
 	pthread_mutex_unlock(&scene->mutex);
 }
 
@@ -297,6 +537,8 @@ obs_sceneitem_t obs_scene_add(obs_scene_t scene, obs_source_t source)
 
 	pthread_mutex_unlock(&scene->mutex);
 
+	item_changed(item);
+
 	calldata_setptr(&params, "scene", scene);
 	calldata_setptr(&params, "item", item);
 	signal_handler_signal(scene->source->signals, "add", &params);
@@ -350,6 +592,9 @@ void obs_sceneitem_remove(obs_sceneitem_t item)
 	item->removed = true;
 
 	signal_item_remove(item);
+	item_changed(item);
+	if (scene)
+		invalidate_caches(scene);
 	detach_sceneitem(item);
 
 	if (scene)
@@ -371,21 +616,25 @@ obs_source_t obs_sceneitem_getsource(obs_sceneitem_t item)
 void obs_sceneitem_setpos(obs_sceneitem_t item, const struct vec2 *pos)
 {
 	vec2_copy(&item->pos, pos);
+	item_changed(item);
 }
 
 void obs_sceneitem_setrot(obs_sceneitem_t item, float rot)
 {
 	item->rot = rot;
+	item_changed(item);
 }
 
 void obs_sceneitem_setorigin(obs_sceneitem_t item, const struct vec2 *origin)
 {
 	vec2_copy(&item->origin, origin);
+	item_changed(item);
 }
 
 void obs_sceneitem_setscale(obs_sceneitem_t item, const struct vec2 *scale)
 {
 	vec2_copy(&item->scale, scale);
+	item_changed(item);
 }
 
 void obs_sceneitem_setorder(obs_sceneitem_t item, enum order_movement movement)
@@ -418,6 +667,8 @@ void obs_sceneitem_setorder(obs_sceneitem_t item, enum order_movement movement)
 		attach_sceneitem(item, NULL);
 	}
 
+	item_changed(item);
+
 	obs_scene_release(scene);
 	pthread_mutex_unlock(&scene->mutex);
 }
@@ -19,6 +19,7 @@
 
 #include "obs.h"
 #include "obs-source.h"
+#include "util/darray.h"
 
 /* how obs scene! */
 
@@ -35,14 +36,40 @@ struct obs_scene_item {
 	struct vec2           scale;
 	float                 rot;
 
+	/* bumped when the item's transform or order changes */
+	volatile long         gen;
+
+	/* source and item generations when the scene last checked the item,
+	 * and for how many frames they've stayed the same since */
+	long                  last_gen;
+	uint32_t              stable_frames;
+	bool                  cacheable;
+
 	/* would do **prev_next, but not really great for reordering */
 	struct obs_scene_item *prev;
 	struct obs_scene_item *next;
 };
 
+/* composite of a run of consecutive unchanging items */
+struct obs_scene_cache {
+	texrender_t           texrender;
+	struct obs_scene_item *first;
+	size_t                count;
+	uint32_t              cx, cy;
+	bool                  valid;
+};
+
 struct obs_scene {
 	struct obs_source     *source;
 
 	pthread_mutex_t       mutex;
 	struct obs_scene_item *first_item;
+
+	/* one composite per cached run, in the order the runs are drawn */
+	DARRAY(struct obs_scene_cache) caches;
+
+	/* the items are checked once per frame, however many times the scene
+	 * is rendered in it */
+	uint64_t              checked_frame;
+	bool                  content_static;
 };
@@ -25,6 +25,9 @@
 #include "obs-internal.h"
 
 static void obs_source_destroy(obs_source_t source);
+static void release_async_frame(obs_source_t source,
+		struct source_frame *frame);
+static struct source_frame *frame_queue_pop(struct async_frame_queue *queue);
 
 bool load_source_info(void *module, const char *module_name,
 		const char *id, struct source_info *info)
@@ -106,9 +109,11 @@ bool obs_source_init(struct obs_source *source, const struct source_info *info)
 
 	source->refs = 1;
 	source->volume = 1.0f;
+	source->video_frames.max_depth = DEFAULT_ASYNC_FRAMES;
 	pthread_mutex_init_value(&source->filter_mutex);
 	pthread_mutex_init_value(&source->video_mutex);
 	pthread_mutex_init_value(&source->audio_mutex);
+	pthread_mutex_init_value(&source->async_cache_mutex);
 
 	memcpy(&source->callbacks, info, sizeof(struct source_info));
 
@@ -118,6 +123,8 @@ bool obs_source_init(struct obs_source *source, const struct source_info *info)
 		return false;
 	if (pthread_mutex_init(&source->video_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&source->async_cache_mutex, NULL) != 0)
+		return false;
 
 	if (flags & SOURCE_AUDIO) {
 		source->audio_line = audio_output_createline(obs->audio.audio,
@@ -182,6 +189,7 @@ fail:
 
 static void obs_source_destroy(obs_source_t source)
 {
+	struct source_frame *frame;
 	size_t i;
 
 	obs_source_dosignal(source, "source-destroy");
@@ -192,8 +200,12 @@ static void obs_source_destroy(obs_source_t source)
 	for (i = 0; i < source->filters.num; i++)
 		obs_source_release(source->filters.array[i]);
 
-	for (i = 0; i < source->video_frames.num; i++)
-		source_frame_destroy(source->video_frames.array[i]);
+	release_async_frame(source, source->next_frame);
+	while ((frame = frame_queue_pop(&source->video_frames)) != NULL)
+		release_async_frame(source, frame);
+
+	for (i = 0; i < source->async_cache.num; i++)
+		source_frame_destroy(source->async_cache.array[i].frame);
 
 	gs_entercontext(obs->video.graphics);
 	texture_destroy(source->output_texture);
@@ -202,18 +214,19 @@ static void obs_source_destroy(obs_source_t source)
 	if (source->data)
 		source->callbacks.destroy(source->data);
 
-	bfree(source->audio_data.data);
+	bfree(source->audio_data.data[0]);
 	audio_line_destroy(source->audio_line);
 	audio_resampler_destroy(source->resampler);
 
 	proc_handler_destroy(source->procs);
 	signal_handler_destroy(source->signals);
 
-	da_free(source->video_frames);
+	da_free(source->async_cache);
 	da_free(source->filters);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->video_mutex);
+	pthread_mutex_destroy(&source->async_cache_mutex);
 	obs_data_release(source->settings);
 	bfree(source->name);
 	bfree(source);
@@ -285,6 +298,19 @@ void obs_source_update(obs_source_t source, obs_data_t settings)
 
 	if (source->callbacks.update)
 		source->callbacks.update(source->data, source->settings);
+
+	obs_source_changed(source);
+}
+
+void obs_source_changed(obs_source_t source)
+{
+	if (!source)
+		return;
+
+	/* a filter's output is part of what its parent source draws */
+	os_atomic_inc_long(&source->content_gen);
+	if (source->filter_parent)
+		os_atomic_inc_long(&source->filter_parent->content_gen);
 }
 
 void obs_source_activate(obs_source_t source)
@@ -447,80 +473,109 @@ static inline bool is_yuv(enum video_format format)
 	return false;
 }
 
-static bool upload_frame(texture_t tex, const struct source_frame *frame)
-{
-	void *ptr;
-	uint32_t row_bytes;
-	enum convert_type type = get_convert_type(frame->format);
-
-	if (type == CONVERT_NONE) {
-		texture_setimage(tex, frame->data, frame->row_bytes, false);
-		return true;
-	}
+struct upload_job {
+	const struct source_frame *frame;
+	enum convert_type         type;
+	void                      *ptr;
+	uint32_t                  row_bytes;
+};
 
-	if (!texture_map(tex, &ptr, &row_bytes))
-		return false;
+static void upload_band(void *param, uint32_t start_y, uint32_t end_y)
+{
+	struct upload_job         *job   = param;
+	const struct source_frame *frame = job->frame;
 
-	if (type == CONVERT_420)
+	if (job->type == CONVERT_420)
 		decompress_420(frame->data, frame->width, frame->height,
-				frame->row_bytes, 0, frame->height, ptr);
+				job->row_bytes, start_y, end_y, job->ptr);
 
-	else if (type == CONVERT_NV12)
+	else if (job->type == CONVERT_NV12)
 		decompress_nv12(frame->data, frame->width, frame->height,
-				frame->row_bytes, 0, frame->height, ptr);
+				job->row_bytes, start_y, end_y, job->ptr);
 
-	else if (type == CONVERT_422_Y)
+	else if (job->type == CONVERT_422_Y)
 		decompress_422(frame->data, frame->width, frame->height,
-				frame->row_bytes, 0, frame->height, ptr, true);
+				job->row_bytes, start_y, end_y, job->ptr, true);
 
-	else if (type == CONVERT_422_U)
+	else if (job->type == CONVERT_422_U)
 		decompress_422(frame->data, frame->width, frame->height,
-				frame->row_bytes, 0, frame->height, ptr, false);
+				job->row_bytes, start_y, end_y, job->ptr, false);
+}
+
+static bool upload_frame(texture_t tex, const struct source_frame *frame)
+{
+	struct upload_job job;
+
+	job.frame = frame;
+	job.type  = get_convert_type(frame->format);
+
+	if (job.type == CONVERT_NONE) {
+		texture_setimage(tex, frame->data, frame->row_bytes, false);
+		return true;
+	}
+
+	if (!texture_map(tex, &job.ptr, &job.row_bytes))
+		return false;
+
+	conversion_pool_run(obs->video.conversion_pool, upload_band, &job,
+			frame->height, 2);
 
 	texture_unmap(tex);
 	return true;
 }
 
-static void obs_source_draw_texture(texture_t tex, struct source_frame *frame)
+static void obs_source_draw_async_texture(obs_source_t source)
 {
-	effect_t    effect = obs->video.default_effect;
-	bool        yuv    = is_yuv(frame->format);
-	const char  *type  = yuv ? "DrawYUV" : "DrawRGB";
+	struct obs_video *video = &obs->video;
+	texture_t   tex    = source->output_texture;
+	effect_t    effect = video->default_effect;
+	bool        yuv    = source->async_yuv;
 	technique_t tech;
-	eparam_t    param;
-
-	if (!upload_frame(tex, frame))
-		return;
 
-	tech = effect_gettechnique(effect, type);
+	tech = yuv ? video->default_yuv_tech : video->default_rgb_tech;
 	technique_begin(tech);
 	technique_beginpass(tech, 0);
 
-	if (yuv) {
-		param = effect_getparambyname(effect, "yuv_matrix");
-		effect_setval(effect, param, frame->yuv_matrix,
-				sizeof(float) * 16);
-	}
+	if (yuv)
+		effect_setval(effect, video->default_yuv_matrix,
+				source->async_yuv_matrix, sizeof(float) * 16);
 
-	param = effect_getparambyname(effect, "diffuse");
-	effect_settexture(effect, param, tex);
+	effect_settexture(effect, video->default_diffuse, tex);
 
-	gs_draw_sprite(tex, frame->flip ? GS_FLIP_V : 0, 0, 0);
+	gs_draw_sprite(tex, source->async_flip ? GS_FLIP_V : 0, 0, 0);
 
 	technique_endpass(tech);
 	technique_end(tech);
 }
 
+static void obs_source_upload_async_frame(obs_source_t source,
+		struct source_frame *frame)
+{
+	source->async_drawn = set_texture_size(source, frame) &&
+		upload_frame(source->output_texture, frame);
+	if (!source->async_drawn)
+		return;
+
+	source->async_flip = frame->flip;
+	source->async_yuv  = is_yuv(frame->format);
+	memcpy(source->async_yuv_matrix, frame->yuv_matrix,
+			sizeof(source->async_yuv_matrix));
+
+	os_atomic_inc_long(&source->content_gen);
+}
+
+/* the last frame stays on screen until the next one is due */
 static void obs_source_render_async_video(obs_source_t source)
 {
 	struct source_frame *frame = obs_source_getframe(source);
-	if (!frame)
-		return;
 
-	if (set_texture_size(source, frame))
-		obs_source_draw_texture(source->output_texture, frame);
+	if (frame) {
+		obs_source_upload_async_frame(source, frame);
+		obs_source_releaseframe(source, frame);
+	}
 
-	obs_source_releaseframe(source, frame);
+	if (source->async_drawn)
+		obs_source_draw_async_texture(source);
 }
 
 static inline void obs_source_render_filters(obs_source_t source)
@@ -532,9 +587,8 @@ static inline void obs_source_render_filters(obs_source_t source)
 
 static inline void obs_source_default_render(obs_source_t source, bool yuv)
 {
-	effect_t    effect     = obs->video.default_effect;
-	const char  *tech_name = yuv ? "DrawYUV" : "DrawRGB";
-	technique_t tech       = effect_gettechnique(effect, tech_name);
+	technique_t tech = yuv ?
+		obs->video.default_yuv_tech : obs->video.default_rgb_tech;
 	size_t      passes, i;
 
 	passes = technique_begin(tech);
@@ -620,6 +674,8 @@ void obs_source_filter_add(obs_source_t source, obs_source_t filter)
 
 	filter->filter_parent = source;
 	filter->filter_target = source;
+
+	obs_source_changed(source);
 }
 
 void obs_source_filter_remove(obs_source_t source, obs_source_t filter)
@@ -643,6 +699,8 @@ void obs_source_filter_remove(obs_source_t source, obs_source_t filter)
 
 	filter->filter_parent = NULL;
 	filter->filter_target = NULL;
+
+	obs_source_changed(source);
 }
 
 void obs_source_filter_setorder(obs_source_t source, obs_source_t filter,
@@ -680,6 +738,8 @@ void obs_source_filter_setorder(obs_source_t source, obs_source_t filter,
 			source : source->filters.array[idx+1];
 		source->filters.array[i]->filter_target = next_filter;
 	}
+
+	obs_source_changed(source);
 }
 
 obs_data_t obs_source_getsettings(obs_source_t source)
@@ -704,31 +764,211 @@ static inline struct source_frame *filter_async_video(obs_source_t source,
 	return in;
 }
 
+static inline size_t get_frame_size(const struct source_frame *frame)
+{
+	size_t size = (size_t)frame->row_bytes * (size_t)frame->height;
+
+	/* the chroma planes of 4:2:0 formats follow the luma plane */
+	if (frame->format == VIDEO_FORMAT_I420 ||
+	    frame->format == VIDEO_FORMAT_NV12)
+		size += size / 2;
+
+	return size;
+}
+
+static inline bool frame_matches(const struct source_frame *cached,
+		const struct source_frame *frame)
+{
+	return cached->format    == frame->format &&
+	       cached->width     == frame->width  &&
+	       cached->height    == frame->height &&
+	       cached->row_bytes == frame->row_bytes;
+}
+
+static inline void remove_cached_frame(obs_source_t source, size_t idx)
+{
+	struct async_frame *af = source->async_cache.array+idx;
+
+	source->cache_stats.frames--;
+	source->cache_stats.bytes -= af->size;
+
+	source_frame_destroy(af->frame);
+	da_erase(source->async_cache, idx);
+}
+
+/* finds an unused cached frame of the same format/size, or allocates a new
+ * one.  unused frames of any other format/size are stale and are freed. */
+static struct source_frame *get_cached_frame(obs_source_t source,
+		const struct source_frame *frame, size_t size)
+{
+	struct source_frame_cache_stats *stats = &source->cache_stats;
+	struct source_frame *new_frame = NULL;
+	struct async_frame  af;
+	size_t i = 0;
+
+	pthread_mutex_lock(&source->async_cache_mutex);
+
+	while (i < source->async_cache.num) {
+		struct async_frame *cur = source->async_cache.array+i;
+
+		if (cur->refs) {
+			i++;
+		} else if (!frame_matches(cur->frame, frame)) {
+			remove_cached_frame(source, i);
+		} else {
+			if (!new_frame) {
+				new_frame = cur->frame;
+				cur->refs = 1;
+			}
+			i++;
+		}
+	}
+
+	if (new_frame) {
+		stats->hits++;
+	} else {
+		new_frame = bmalloc(sizeof(struct source_frame));
+		new_frame->data = bmalloc_tagged(size, BMEM_TAG_VIDEO);
+
+		af.frame = new_frame;
+		af.size  = size;
+		af.refs  = 1;
+		da_push_back(source->async_cache, &af);
+
+		stats->misses++;
+		stats->frames++;
+		stats->bytes += size;
+		if (stats->frames > stats->high_water)
+			stats->high_water = stats->frames;
+	}
+
+	pthread_mutex_unlock(&source->async_cache_mutex);
+	return new_frame;
+}
+
 static inline struct source_frame *cache_video(obs_source_t source,
 		const struct source_frame *frame)
 {
-	/* TODO: use an actual cache */
-	struct source_frame *new_frame = bmalloc(sizeof(struct source_frame));
+	size_t size = get_frame_size(frame);
+	struct source_frame *new_frame = get_cached_frame(source, frame, size);
+	void *data = new_frame->data;
+
 	memcpy(new_frame, frame, sizeof(struct source_frame));
-	new_frame->data = bmalloc(frame->row_bytes * frame->height);
+	new_frame->data = data;
+	memcpy(new_frame->data, frame->data, size);
 
 	return new_frame;
 }
 
+/* frames that did not come from the cache (e.g. frames created by filters)
+ * are simply destroyed */
+static void release_async_frame(obs_source_t source,
+		struct source_frame *frame)
+{
+	bool cached = false;
+	size_t i;
+
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&source->async_cache_mutex);
+
+	for (i = 0; i < source->async_cache.num; i++) {
+		struct async_frame *af = source->async_cache.array+i;
+		if (af->frame == frame) {
+			if (af->refs)
+				af->refs--;
+			cached = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->async_cache_mutex);
+
+	if (!cached)
+		source_frame_destroy(frame);
+}
+
+static inline long next_frame_idx(long idx)
+{
+	return (long)((unsigned long)idx + 1);
+}
+
+static inline unsigned long frame_queue_depth(struct async_frame_queue *queue)
+{
+	unsigned long head = (unsigned long)os_atomic_load_long(&queue->head);
+	unsigned long tail = (unsigned long)os_atomic_load_long(&queue->tail);
+	return tail - head;
+}
+
+/* called by the consumer, and by the producer when dropping frames */
+static struct source_frame *frame_queue_pop(struct async_frame_queue *queue)
+{
+	for (;;) {
+		long head = os_atomic_load_long(&queue->head);
+		long tail = os_atomic_load_long(&queue->tail);
+		struct source_frame *frame;
+
+		if (head == tail)
+			return NULL;
+
+		frame = queue->frames[(unsigned long)head &
+			(MAX_ASYNC_FRAMES-1)];
+
+		if (os_atomic_compare_swap_long(&queue->head, head,
+					next_frame_idx(head)))
+			return frame;
+	}
+}
+
+static void frame_queue_push(obs_source_t source, struct source_frame *frame)
+{
+	struct async_frame_queue *queue = &source->video_frames;
+	unsigned long max_depth = os_atomic_load_long(&queue->max_depth);
+	long tail = queue->tail;
+
+	while (frame_queue_depth(queue) >= max_depth) {
+		struct source_frame *oldest = frame_queue_pop(queue);
+		if (oldest) {
+			os_atomic_inc_long(&queue->dropped);
+			release_async_frame(source, oldest);
+		}
+	}
+
+	queue->frames[(unsigned long)tail & (MAX_ASYNC_FRAMES-1)] = frame;
+	os_atomic_set_long(&queue->tail, next_frame_idx(tail));
+}
+
+void obs_source_set_async_queue_depth(obs_source_t source, uint32_t depth)
+{
+	if (depth < 1)
+		depth = 1;
+	else if (depth > MAX_ASYNC_FRAMES)
+		depth = MAX_ASYNC_FRAMES;
+
+	os_atomic_set_long(&source->video_frames.max_depth, (long)depth);
+}
+
+uint32_t obs_source_get_dropped_frames(obs_source_t source)
+{
+	return (uint32_t)os_atomic_load_long(&source->video_frames.dropped);
+}
+
 void obs_source_output_video(obs_source_t source,
 		const struct source_frame *frame)
 {
-	struct source_frame *output = cache_video(source, frame);
+	struct source_frame *input  = cache_video(source, frame);
+	struct source_frame *output;
 
 	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_video(source, output);
+	output = filter_async_video(source, input);
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (output) {
-		pthread_mutex_lock(&source->video_mutex);
-		da_push_back(source->video_frames, &output);
-		pthread_mutex_unlock(&source->video_mutex);
-	}
+	if (output != input)
+		release_async_frame(source, input);
+
+	if (output)
+		frame_queue_push(source, output);
 }
 
 static inline struct filtered_audio *filter_async_audio(obs_source_t source,
@@ -755,7 +995,9 @@ static inline void reset_resampler(obs_source_t source,
 
 	obs_info = audio_output_getinfo(obs->audio.audio);
 
-	output_info.format           = obs_info->format;
+	/* audio is converted to planar float as soon as it comes in, so
+	 * filters and the mixer can work on each channel separately */
+	output_info.format           = AUDIO_FORMAT_FLOAT_PLANAR;
 	output_info.samples_per_sec  = obs_info->samples_per_sec;
 	output_info.speakers         = obs_info->speakers;
 
@@ -763,14 +1005,16 @@ static inline void reset_resampler(obs_source_t source,
 	source->sample_info.samples_per_sec = audio->samples_per_sec;
 	source->sample_info.speakers        = audio->speakers;
 
+	audio_resampler_destroy(source->resampler);
+	source->resampler = NULL;
+
 	if (source->sample_info.samples_per_sec == obs_info->samples_per_sec &&
-	    source->sample_info.format          == obs_info->format          &&
+	    source->sample_info.format          == AUDIO_FORMAT_FLOAT_PLANAR &&
 	    source->sample_info.speakers        == obs_info->speakers) {
 		source->audio_failed = false;
 		return;
 	}
 
-	audio_resampler_destroy(source->resampler);
 	source->resampler = audio_resampler_create(&output_info,
 			&source->sample_info);
 
@@ -779,77 +1023,134 @@ static inline void reset_resampler(obs_source_t source,
 		blog(LOG_ERROR, "creation of resampler failed");
 }
 
-static inline void copy_audio_data(obs_source_t source,
-		const void *data, uint32_t frames, uint64_t timestamp)
+/* sizes the source's planar float audio storage for the given number of
+ * frames and points the planes of audio_data at it, returns the number of
+ * planes */
+static size_t ensure_audio_storage(obs_source_t source, uint32_t frames)
 {
-	size_t blocksize = audio_output_blocksize(obs->audio.audio);
-	size_t size = (size_t)frames * blocksize;
+	const struct audio_output_info *info;
+	size_t channels, plane_size, size;
+
+	info       = audio_output_getinfo(obs->audio.audio);
+	channels   = get_audio_channels(info->speakers);
+	plane_size = (size_t)frames * sizeof(float);
+	size       = plane_size * channels;
 
-	/* ensure audio storage capacity */
 	if (source->audio_storage_size < size) {
-		bfree(source->audio_data.data);
-		source->audio_data.data = bmalloc(size);
+		bfree(source->audio_data.data[0]);
+		source->audio_data.data[0] = bmalloc_tagged(size, BMEM_TAG_AUDIO);
 		source->audio_storage_size = size;
 	}
 
+	for (size_t i = 0; i < channels; i++)
+		source->audio_data.data[i] =
+			source->audio_data.data[0] + plane_size * i;
+
+	return channels;
+}
+
+static inline void copy_audio_data(obs_source_t source,
+		const uint8_t *const data[], uint32_t frames,
+		uint64_t timestamp)
+{
+	size_t plane_size = (size_t)frames * sizeof(float);
+	size_t channels   = ensure_audio_storage(source, frames);
+
+	for (size_t i = 0; i < channels; i++)
+		memcpy(source->audio_data.data[i], data[i], plane_size);
+
 	source->audio_data.frames = frames;
 	source->audio_data.timestamp = timestamp;
-	memcpy(source->audio_data.data, data, size);
 }
 
-/* resamples/remixes new audio to the designated main audio output format */
-static void process_audio(obs_source_t source, const struct source_audio *audio)
+/* resamples/remixes new audio straight into the source's audio storage */
+static bool resample_audio(obs_source_t source,
+		const struct source_audio *audio)
 {
-	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
-	    source->sample_info.format          != audio->format          ||
-	    source->sample_info.speakers        != audio->speakers)
-		reset_resampler(source, audio);
+	uint32_t max_frames;
+	uint32_t frames;
+	uint64_t offset;
 
-	if (source->audio_failed)
-		return;
+	max_frames = audio_resampler_max_output(source->resampler,
+			audio->frames);
+	ensure_audio_storage(source, max_frames);
 
-	if (source->resampler) {
-		void *output;
-		uint32_t frames;
-		uint64_t offset;
+	if (!audio_resampler_resample_to(source->resampler,
+				source->audio_data.data, max_frames, &frames,
+				audio->data, audio->frames, &offset))
+		return false;
 
-		audio_resampler_resample(source->resampler, &output, &frames,
-				audio->data, audio->frames, &offset);
+	source->audio_data.frames    = frames;
+	source->audio_data.timestamp = audio->timestamp - offset;
+	return true;
+}
 
-		copy_audio_data(source, output, frames,
-				audio->timestamp - offset);
-	} else {
-		copy_audio_data(source, audio->data, audio->frames,
-				audio->timestamp);
+/* puts new audio in the source's own storage so filters can modify it */
+static bool process_audio(obs_source_t source,
+		const struct source_audio *audio)
+{
+	if (source->resampler)
+		return resample_audio(source, audio);
+
+	copy_audio_data(source, audio->data, audio->frames, audio->timestamp);
+	return true;
+}
+
+static void output_audio_data(obs_source_t source,
+		const uint8_t *const data[], uint32_t frames,
+		uint64_t timestamp)
+{
+	uint32_t flags = obs_source_get_output_flags(source);
+
+	pthread_mutex_lock(&source->audio_mutex);
+
+	/* wait for video to start before outputting any audio so we have a
+	 * base for sync */
+	if (source->timing_set || (flags & SOURCE_ASYNC_VIDEO) == 0) {
+		struct audio_data out;
+
+		for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++)
+			out.data[i] = data[i];
+
+		out.frames    = frames;
+		out.timestamp = timestamp;
+		source_output_audio_line(source, &out);
 	}
+
+	pthread_mutex_unlock(&source->audio_mutex);
 }
 
+/*
+ * Audio that's already in the main output format and has no filters to go
+ * through is handed straight to the audio line, which is its only copy.
+ * Otherwise it's resampled or copied once into the source's own storage,
+ * which filters are allowed to modify.
+ */
 void obs_source_output_audio(obs_source_t source,
 		const struct source_audio *audio)
 {
-	uint32_t flags = obs_source_get_output_flags(source);
-	size_t blocksize = audio_output_blocksize(obs->audio.audio);
 	struct filtered_audio *output;
 
-	process_audio(source, audio);
+	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
+	    source->sample_info.format          != audio->format          ||
+	    source->sample_info.speakers        != audio->speakers)
+		reset_resampler(source, audio);
+
+	if (source->audio_failed)
+		return;
 
 	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_audio(source, &source->audio_data);
-
-	if (output) {
-		pthread_mutex_lock(&source->audio_mutex);
-
-		/* wait for video to start before outputting any audio so we
-		 * have a base for sync */
-		if (source->timing_set || (flags & SOURCE_ASYNC_VIDEO) == 0) {
-			struct audio_data data;
-			data.data      = output->data;
-			data.frames    = output->frames;
-			data.timestamp = output->timestamp;
-			source_output_audio_line(source, &data);
-		}
 
-		pthread_mutex_unlock(&source->audio_mutex);
+	if (!source->resampler && !source->filters.num) {
+		output_audio_data(source, audio->data, audio->frames,
+				audio->timestamp);
+
+	} else if (process_audio(source, audio)) {
+		output = filter_async_audio(source, &source->audio_data);
+		if (output)
+			output_audio_data(source,
+					(const uint8_t *const *)output->data,
+					output->frames, output->timestamp);
 	}
 
 	pthread_mutex_unlock(&source->filter_mutex);
@@ -860,10 +1161,26 @@ static inline bool frame_out_of_bounds(obs_source_t source, uint64_t ts)
 	return ((ts - source->last_frame_ts) > MAX_TIMESTAMP_JUMP);
 }
 
+/* frames are popped from the queue before they're needed to check their
+ * timestamps, so the next frame is held by the consumer until it's used */
+static inline struct source_frame *peek_next_frame(obs_source_t source)
+{
+	if (!source->next_frame)
+		source->next_frame = frame_queue_pop(&source->video_frames);
+	return source->next_frame;
+}
+
+static inline struct source_frame *pop_next_frame(obs_source_t source)
+{
+	struct source_frame *frame = peek_next_frame(source);
+	source->next_frame = NULL;
+	return frame;
+}
+
 static inline struct source_frame *get_closest_frame(obs_source_t source,
 		uint64_t sys_time, int *audio_time_refs)
 {
-	struct source_frame *next_frame = source->video_frames.array[0];
+	struct source_frame *next_frame = peek_next_frame(source);
 	struct source_frame *frame      = NULL;
 	uint64_t sys_offset = sys_time - source->last_sys_timestamp;
 	uint64_t frame_time = next_frame->timestamp;
@@ -879,16 +1196,14 @@ static inline struct source_frame *get_closest_frame(obs_source_t source,
 	}
 
 	while (frame_offset <= sys_offset) {
-		source_frame_destroy(frame);
+		release_async_frame(source, frame);
 
-		frame = next_frame;
-		da_erase(source->video_frames, 0);
+		frame = pop_next_frame(source);
+		next_frame = peek_next_frame(source);
 
-		if (!source->video_frames.num)
+		if (!next_frame)
 			break;
 
-		next_frame = source->video_frames.array[0];
-
 		/* more timestamp checking and compensating */
 		if ((next_frame->timestamp - frame_time) > MAX_TIMESTAMP_JUMP) {
 			source->last_frame_ts =
@@ -918,14 +1233,13 @@ struct source_frame *obs_source_getframe(obs_source_t source)
 
 	pthread_mutex_lock(&source->video_mutex);
 
-	if (!source->video_frames.num)
+	if (!peek_next_frame(source))
 		goto unlock;
 
 	sys_time = os_gettime_ns();
 
 	if (!source->last_frame_ts) {
-		frame = source->video_frames.array[0];
-		da_erase(source->video_frames, 0);
+		frame = pop_next_frame(source);
 
 		source->last_frame_ts = frame->timestamp;
 	} else {
@@ -953,11 +1267,58 @@ unlock:
 void obs_source_releaseframe(obs_source_t source, struct source_frame *frame)
 {
 	if (frame) {
-		source_frame_destroy(frame);
+		release_async_frame(source, frame);
 		obs_source_release(source);
 	}
 }
 
+static inline bool filters_static(obs_source_t source)
+{
+	bool   static_video = true;
+	size_t i;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (i = 0; i < source->filters.num; i++) {
+		obs_source_t filter = source->filters.array[i];
+		uint32_t     flags  = obs_source_get_output_flags(filter);
+
+		if ((flags & SOURCE_STATIC_VIDEO) == 0) {
+			static_video = false;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return static_video;
+}
+
+/* video thread only.  async sources are static while there are no frames
+ * waiting to be shown; other sources have to say so with
+ * SOURCE_STATIC_VIDEO (scenes check their items). */
+bool obs_source_content_static(obs_source_t source, long *gen)
+{
+	bool static_video = filters_static(source);
+
+	if (source->type == SOURCE_SCENE) {
+		if (!obs_scene_content_static(source->data))
+			static_video = false;
+
+	} else if (source->callbacks.video_render) {
+		uint32_t flags = obs_source_get_output_flags(source);
+		if ((flags & SOURCE_STATIC_VIDEO) == 0)
+			static_video = false;
+
+	} else if (!source->filter_target) {
+		if (source->next_frame ||
+		    frame_queue_depth(&source->video_frames) != 0)
+			static_video = false;
+	}
+
+	*gen = os_atomic_load_long(&source->content_gen);
+	return static_video;
+}
+
 const char *obs_source_getname(obs_source_t source)
 {
 	return source->name;
@@ -1069,3 +1430,11 @@ float obs_source_getvolume(obs_source_t source)
 {
 	return source->volume;
 }
+
+void obs_source_get_frame_cache_stats(obs_source_t source,
+		struct source_frame_cache_stats *stats)
+{
+	pthread_mutex_lock(&source->async_cache_mutex);
+	*stats = source->cache_stats;
+	pthread_mutex_unlock(&source->async_cache_mutex);
+}
@@ -101,6 +101,9 @@
  *           + SOURCE_ASYNC_VIDEO: video is sent asynchronously via RAM
  *           + SOURCE_DEFAULT_EFFECT: source uses default effect
  *           + SOURCE_YUV: source is in YUV color space
+ *           + SOURCE_STATIC_VIDEO: video only changes when the source is
+ *             updated or calls obs_source_changed, so scenes can reuse a
+ *             cached image of it
  *
  * ===========================================
  *   Optional Source Exports
@@ -161,7 +164,9 @@
  *       Filters audio data.  Used with audio filters.
  *
  *       frame: Video frame data.
- *       returns: New video frame data (or NULL if pending)
+ *       returns: New video frame data (or NULL if pending).  If a different
+ *                frame is returned, the original frame is released, so
+ *                filters must copy any data they want to keep.
  *
  * ---------------------------------------------------------
  *   struct filter_audio [name]_filter_audio(void *data,
@@ -174,6 +179,32 @@
 
 struct obs_source;
 
+/* async frames are recycled instead of being reallocated for every call to
+ * obs_source_output_video.  'refs' is the number of users of the frame
+ * (the frame queue and the renderer); the frame goes back to the cache when
+ * it reaches zero. */
+struct async_frame {
+	struct source_frame          *frame;
+	size_t                       size;
+	long                         refs;
+};
+
+/* maximum number of queued async frames (must be a power of two) */
+#define MAX_ASYNC_FRAMES     64
+#define DEFAULT_ASYNC_FRAMES 16
+
+/* single-producer (the thread calling obs_source_output_video), single-
+ * consumer (the video thread) queue of async frames.  when the queue depth
+ * reaches max_depth, the producer drops the oldest frame, so both sides
+ * compete for 'head' and the winner of the exchange owns the frame. */
+struct async_frame_queue {
+	struct source_frame * volatile frames[MAX_ASYNC_FRAMES];
+	volatile long                  head;
+	volatile long                  tail;
+	volatile long                  max_depth;
+	volatile long                  dropped;
+};
+
 struct source_info {
 	const char *id;
 
@@ -246,15 +277,30 @@ struct obs_source {
 
 	/* async video data */
 	texture_t                    output_texture;
-	DARRAY(struct source_frame*) video_frames;
+	struct async_frame_queue     video_frames;
+	struct source_frame          *next_frame;
 	pthread_mutex_t              video_mutex;
 
+	/* async frame cache */
+	DARRAY(struct async_frame)   async_cache;
+	pthread_mutex_t              async_cache_mutex;
+	struct source_frame_cache_stats cache_stats;
+
 	/* filters */
 	struct obs_source            *filter_parent;
 	struct obs_source            *filter_target;
 	DARRAY(struct obs_source*)   filters;
 	pthread_mutex_t              filter_mutex;
 	bool                         rendering_filter;
+
+	/* advanced whenever what the source draws may have changed */
+	volatile long                content_gen;
+
+	/* last async frame drawn, redrawn until a new frame is ready */
+	bool                         async_drawn;
+	bool                         async_flip;
+	bool                         async_yuv;
+	float                        async_yuv_matrix[16];
 };
 
 extern bool load_source_info(void *module, const char *module_name,
@@ -264,6 +310,11 @@ bool obs_source_init_handlers(struct obs_source *source);
 extern bool obs_source_init(struct obs_source *source,
 		const struct source_info *info);
 
+/* returns false if the source's video may change without its content
+ * generation advancing, in which case it has to be rendered every frame */
+extern bool obs_source_content_static(obs_source_t source, long *gen);
+extern bool obs_scene_content_static(obs_scene_t scene);
+
 extern void obs_source_activate(obs_source_t source);
 extern void obs_source_deactivate(obs_source_t source);
 extern void obs_source_video_tick(obs_source_t source, float seconds);
@@ -17,6 +17,7 @@
 
 #include "obs.h"
 #include "obs-internal.h"
+#include "util/platform.h"
 #include "graphics/vec4.h"
 
 static void tick_sources(uint64_t cur_time, uint64_t *last_time)
@@ -64,27 +65,32 @@ static inline void render_end(struct obs_display *display)
 	gs_present();
 }
 
-static void render_display(struct obs_display *display)
+static void render_channels(obs_source_t *channels, bool remove)
 {
 	size_t i;
-	render_begin(display);
 
 	for (i = 0; i < MAX_CHANNELS; i++) {
-		struct obs_source **p_source;
+		obs_source_t *p_source = channels+i;
 
-		p_source = (display) ? display->channels+i :
-		                       obs->data.channels+i;
+		if (!*p_source)
+			continue;
 
-		if (*p_source) {
-			if ((*p_source)->removed) {
+		if ((*p_source)->removed) {
+			if (remove) {
 				obs_source_release(*p_source);
 				*p_source = NULL;
-			} else {
-				obs_source_video_render(*p_source);
 			}
+		} else {
+			obs_source_video_render(*p_source);
 		}
 	}
+}
 
+static void render_display(struct obs_display *display)
+{
+	render_begin(display);
+	render_channels(display ? display->channels : obs->data.channels,
+			true);
 	render_end(display);
 }
 
@@ -108,38 +114,207 @@ static inline void render_displays(void)
 	render_display(NULL);
 }
 
-static bool swap_frame(uint64_t timestamp)
+static inline void set_render_size(uint32_t width, uint32_t height)
 {
-	struct obs_video *video = &obs->video;
-	stagesurf_t last_surface = video->copy_surfaces[video->cur_texture];
-	stagesurf_t surface;
-	struct video_frame frame;
-
-	/* the last frame stays mapped until rendering starts with the next */
-	if (video->copy_mapped) {
-		stagesurface_unmap(last_surface);
-		video->copy_mapped = false;
-	}
+	gs_enable_depthtest(false);
+	gs_setcullmode(GS_NEITHER);
+
+	gs_ortho(0.0f, (float)width, 0.0f, (float)height, -100.0f, 100.0f);
+	gs_setviewport(0, 0, width, height);
+}
 
-	video->textures_copied[video->cur_texture] = true;
-	/* TODO: texture staging */
-	//gs_stage_texture(last_surface, );
+static inline void render_main_texture(struct obs_video *video,
+		int cur_texture)
+{
+	struct vec4 clear_color;
 
-	if (++video->cur_texture == NUM_TEXTURES)
-		video->cur_texture = 0;
+	gs_setrendertarget(video->render_textures[cur_texture], NULL);
 
-	if (video->textures_copied[video->cur_texture]) {
-		surface = video->copy_surfaces[video->cur_texture];
-		video->copy_mapped = stagesurface_map(surface, &frame.data,
-				&frame.row_size);
+	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
 
-		if (video->copy_mapped) {
-			frame.timestamp = timestamp;
-			video_output_frame(video->video, &frame);
-		}
+	set_render_size(video->base_width, video->base_height);
+	render_channels(obs->data.channels, false);
+}
+
+static inline void render_output_texture(struct obs_video *video,
+		int cur_texture)
+{
+	texture_t   texture = video->render_textures[cur_texture];
+	texture_t   target  = video->output_textures[cur_texture];
+	uint32_t    width   = texture_getwidth(target);
+	uint32_t    height  = texture_getheight(target);
+	effect_t    effect  = video->default_effect;
+	technique_t tech    = video->default_rgb_tech;
+	size_t      passes, i;
+
+	gs_setrendertarget(target, NULL);
+	set_render_size(width, height);
+
+	effect_settexture(effect, video->default_diffuse, texture);
+
+	passes = technique_begin(tech);
+	for (i = 0; i < passes; i++) {
+		technique_beginpass(tech, i);
+		gs_draw_sprite(texture, 0, width, height);
+		technique_endpass(tech);
 	}
+	technique_end(tech);
+}
+
+static inline void set_eparam_vec4(effect_t effect, eparam_t param,
+		float x, float y, float z, float w)
+{
+	struct vec4 val;
+	vec4_set(&val, x, y, z, w);
+	effect_setvec4(effect, param, &val);
+}
+
+/* BT.601 limited range RGB to YUV, with the offsets in the last component */
+static inline void set_color_vecs(struct obs_video *video)
+{
+	effect_t effect = video->default_effect;
+
+	set_eparam_vec4(effect, video->default_color_vec_y,
+			 0.256788f,  0.504129f,  0.097906f, 0.062745f);
+	set_eparam_vec4(effect, video->default_color_vec_u,
+			-0.148223f, -0.290993f,  0.439216f, 0.501961f);
+	set_eparam_vec4(effect, video->default_color_vec_v,
+			 0.439216f, -0.367788f, -0.071427f, 0.501961f);
+}
+
+static inline void render_convert_texture(struct obs_video *video,
+		int cur_texture)
+{
+	texture_t   texture = video->output_textures[cur_texture];
+	texture_t   target  = video->convert_textures[cur_texture];
+	uint32_t    width   = texture_getwidth(target);
+	uint32_t    height  = texture_getheight(target);
+	effect_t    effect  = video->default_effect;
+	technique_t tech    = video->default_conversion_tech;
+	size_t      passes, i;
+
+	gs_setrendertarget(target, NULL);
+	set_render_size(width, height);
+
+	effect_settexture(effect, video->default_diffuse, texture);
+	effect_setfloat(effect, video->default_input_width,
+			(float)texture_getwidth(texture));
+	effect_setfloat(effect, video->default_input_height,
+			(float)texture_getheight(texture));
+	set_color_vecs(video);
+
+	passes = technique_begin(tech);
+	for (i = 0; i < passes; i++) {
+		technique_beginpass(tech, i);
+		gs_draw_sprite(texture, 0, width, height);
+		technique_endpass(tech);
+	}
+	technique_end(tech);
+}
+
+/* the video output keeps outputting the last frame until it gets a new one,
+ * so it has to let go of the mapped data before it's unmapped.  returns false
+ * without waiting if the frame is still being output */
+static inline bool unmap_output_frame(struct obs_video *video, int texture)
+{
+	if (!video->textures_mapped[texture])
+		return true;
+
+	if (!video_output_release_frame(video->video,
+				video->output_frames+texture))
+		return false;
 
-	return video->copy_mapped;
+	stagesurface_unmap(video->copy_surfaces[texture]);
+	video->textures_mapped[texture] = false;
+	return true;
+}
+
+static inline void stage_output_texture(struct obs_video *video,
+		int cur_texture, uint64_t timestamp)
+{
+	stagesurf_t copy = video->copy_surfaces[cur_texture];
+	texture_t   texture;
+
+	/* the surface being restaged was the one output last frame.  if the
+	 * outputs are still using it, this frame isn't read back rather than
+	 * making rendering wait on them */
+	if (!unmap_output_frame(video, cur_texture))
+		return;
+
+	texture = video->gpu_conversion ?
+		video->convert_textures[cur_texture] :
+		video->output_textures[cur_texture];
+
+	gs_stage_texture(copy, texture);
+	video->textures_staged[cur_texture]    = true;
+	video->texture_timestamps[cur_texture] = timestamp;
+}
+
+static inline void render_video(struct obs_video *video, int cur_texture,
+		uint64_t timestamp)
+{
+	gs_beginscene();
+
+	render_main_texture(video, cur_texture);
+	render_output_texture(video, cur_texture);
+	if (video->gpu_conversion)
+		render_convert_texture(video, cur_texture);
+	stage_output_texture(video, cur_texture, timestamp);
+
+	gs_setrendertarget(NULL, NULL);
+	gs_endscene();
+}
+
+static inline void update_map_stall(struct obs_video *video, uint64_t stall)
+{
+	os_atomic_set_int64(&video->map_stall_ns, (int64_t)stall);
+	video->map_stall_total_ns += stall;
+	video->num_mapped_frames++;
+
+	if (stall > video->map_stall_max_ns)
+		video->map_stall_max_ns = stall;
+}
+
+/* maps the oldest staged surface in the ring.  it was staged NUM_TEXTURES-1
+ * frames ago, so the readback should have completed and the map should not
+ * have to wait on the GPU.  the frame keeps the time it was rendered at. */
+static bool download_frame(struct obs_video *video, int map_texture)
+{
+	stagesurf_t        surface = video->copy_surfaces[map_texture];
+	struct video_frame *frame  = video->output_frames+map_texture;
+	uint64_t           start;
+
+	if (!video->textures_staged[map_texture])
+		return false;
+
+	video->textures_staged[map_texture] = false;
+
+	/* the previous frame stays mapped until its surface is restaged, so
+	 * if this fails the output keeps a valid frame */
+	start = os_gettime_ns();
+	if (!stagesurface_map(surface, &frame->data, &frame->row_size))
+		return false;
+	update_map_stall(video, os_gettime_ns() - start);
+
+	video->textures_mapped[map_texture] = true;
+	frame->timestamp = video->texture_timestamps[map_texture];
+	return true;
+}
+
+static void swap_frame(uint64_t timestamp)
+{
+	struct obs_video *video = &obs->video;
+	int cur_texture = video->cur_texture;
+	int map_texture = (cur_texture + 1) % NUM_TEXTURES;
+
+	render_video(video, cur_texture, timestamp);
+
+	if (download_frame(video, map_texture))
+		video_output_frame(video->video,
+				video->output_frames+map_texture);
+
+	video->cur_texture = map_texture;
 }
 
 void *obs_video_thread(void *param)
@@ -150,11 +325,19 @@ void *obs_video_thread(void *param)
 		uint64_t cur_time = video_gettime(obs->video.video);
 
 		gs_entercontext(obs_graphics());
+		gs_beginframe();
+		obs->video.frame_index++;
 
 		tick_sources(cur_time, &last_time);
 		render_displays();
 		swap_frame(cur_time);
 
+		gs_endframe();
+		os_atomic_set_long(&obs->video.frame_draw_calls,
+				(long)gs_get_draw_calls());
+		os_atomic_set_long(&obs->video.frame_uniform_uploads,
+				(long)gs_get_uniform_uploads());
+
 		gs_leavecontext();
 	}
 
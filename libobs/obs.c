@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "util/platform.h"
 #include "callback/calldata.h"
 
 #include "obs.h"
@@ -48,15 +49,54 @@ static inline void make_video_info(struct video_output_info *vi,
 	vi->height  = ovi->output_height;
 }
 
+static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
+{
+	struct obs_video *video = &obs->video;
+
+	video->gpu_conversion  = false;
+	video->conversion_tech = NULL;
+
+	switch ((uint32_t)ovi->output_format) {
+	case VIDEO_FORMAT_NV12:
+		video->conversion_tech = "ConvertNV12";
+		break;
+	case VIDEO_FORMAT_I420:
+		video->conversion_tech = "ConvertI420";
+		break;
+	default:
+		return true;
+	}
+
+	/* every texel of the conversion target holds four bytes of a plane,
+	 * and each I420 chroma plane has to cover whole texel rows */
+	if ((ovi->output_width % 8) != 0 || (ovi->output_height % 4) != 0) {
+		blog(LOG_ERROR, "Output dimensions must be a multiple of 8x4 "
+		                "for NV12/I420 output");
+		return false;
+	}
+
+	video->gpu_conversion = true;
+	return true;
+}
+
 static bool obs_init_textures(struct obs_video_info *ovi)
 {
 	struct obs_video *video = &obs->video;
+	uint32_t copy_width  = ovi->output_width;
+	uint32_t copy_height = ovi->output_height;
 	size_t i;
 
+	if (!obs_init_gpu_conversion(ovi))
+		return false;
+
+	if (video->gpu_conversion) {
+		copy_width  = ovi->output_width / 4;
+		copy_height = ovi->output_height * 3 / 2;
+	}
+
 	for (i = 0; i < NUM_TEXTURES; i++) {
 		video->copy_surfaces[i] = gs_create_stagesurface(
-				ovi->output_width, ovi->output_height,
-				GS_RGBA);
+				copy_width, copy_height, GS_RGBA);
 
 		if (!video->copy_surfaces[i])
 			return false;
@@ -74,11 +114,61 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 
 		if (!video->output_textures[i])
 			return false;
+
+		if (video->gpu_conversion) {
+			video->convert_textures[i] = gs_create_texture(
+					copy_width, copy_height,
+					GS_RGBA, 1, NULL, GS_RENDERTARGET);
+
+			if (!video->convert_textures[i])
+				return false;
+		}
 	}
 
 	return true;
 }
 
+static void obs_init_default_effect_handles(struct obs_video *video)
+{
+	effect_t effect = video->default_effect;
+
+	video->default_rgb_tech = effect_gettechnique(effect, "DrawRGB");
+	video->default_yuv_tech = effect_gettechnique(effect, "DrawYUV");
+	video->default_conversion_tech = video->conversion_tech ?
+		effect_gettechnique(effect, video->conversion_tech) : NULL;
+
+	video->default_diffuse      = effect_getparambyname(effect, "diffuse");
+	video->default_yuv_matrix   = effect_getparambyname(effect,
+			"yuv_matrix");
+	video->default_input_width  = effect_getparambyname(effect,
+			"input_width");
+	video->default_input_height = effect_getparambyname(effect,
+			"input_height");
+	video->default_color_vec_y  = effect_getparambyname(effect,
+			"color_vec_y");
+	video->default_color_vec_u  = effect_getparambyname(effect,
+			"color_vec_u");
+	video->default_color_vec_v  = effect_getparambyname(effect,
+			"color_vec_v");
+}
+
+/* compiled effects are cached in the user's config directory */
+static void obs_init_effect_cache(void)
+{
+	char *config_path = os_get_config_path("obs-studio");
+	char *cache_path  = os_get_config_path("obs-studio/effect-cache");
+
+	if (os_mkdir(config_path) != MKDIR_ERROR &&
+	    os_mkdir(cache_path)  != MKDIR_ERROR)
+		gs_set_cache_path(cache_path);
+	else
+		blog(LOG_WARNING, "Could not create effect cache directory "
+		                  "'%s'", cache_path);
+
+	bfree(config_path);
+	bfree(cache_path);
+}
+
 static bool obs_init_graphics(struct obs_video_info *ovi)
 {
 	struct obs_video *video = &obs->video;
@@ -100,6 +190,7 @@ static bool obs_init_graphics(struct obs_video_info *ovi)
 	}
 
 	gs_entercontext(video->graphics);
+	obs_init_effect_cache();
 
 	if (!obs_init_textures(ovi))
 		success = false;
@@ -111,6 +202,8 @@ static bool obs_init_graphics(struct obs_video_info *ovi)
 		bfree(filename);
 		if (!video->default_effect)
 			success = false;
+		else
+			obs_init_default_effect_handles(video);
 	}
 
 	gs_leavecontext();
@@ -135,6 +228,8 @@ static bool obs_init_video(struct obs_video_info *ovi)
 		return false;
 	}
 
+	video->conversion_pool = conversion_pool_create(0);
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -160,6 +255,27 @@ static void obs_free_video()
 		video_output_close(video->video);
 		video->video = NULL;
 	}
+
+	conversion_pool_destroy(video->conversion_pool);
+	video->conversion_pool = NULL;
+}
+
+static void log_map_stalls(struct obs_video *video)
+{
+	if (!video->num_mapped_frames)
+		return;
+
+	blog(LOG_INFO, "video staging: %llu frames, average map stall "
+	               "%.3f ms, max %.3f ms",
+	               (unsigned long long)video->num_mapped_frames,
+	               (double)video->map_stall_total_ns /
+	               (double)video->num_mapped_frames / 1000000.0,
+	               (double)video->map_stall_max_ns / 1000000.0);
+
+	os_atomic_set_int64(&video->map_stall_ns, 0);
+	video->map_stall_total_ns = 0;
+	video->map_stall_max_ns   = 0;
+	video->num_mapped_frames  = 0;
 }
 
 static void obs_free_graphics()
@@ -168,20 +284,23 @@ static void obs_free_graphics()
 	size_t i;
 
 	if (video->graphics) {
-		int cur_texture = video->cur_texture;
 		gs_entercontext(video->graphics);
 
-		if (video->copy_mapped)
-			stagesurface_unmap(video->copy_surfaces[cur_texture]);
-
 		for (i = 0; i < NUM_TEXTURES; i++) {
+			if (video->textures_mapped[i])
+				stagesurface_unmap(video->copy_surfaces[i]);
+
 			stagesurface_destroy(video->copy_surfaces[i]);
 			texture_destroy(video->render_textures[i]);
 			texture_destroy(video->output_textures[i]);
-
-			video->copy_surfaces[i]   = NULL;
-			video->render_textures[i] = NULL;
-			video->output_textures[i] = NULL;
+			texture_destroy(video->convert_textures[i]);
+
+			video->copy_surfaces[i]    = NULL;
+			video->render_textures[i]  = NULL;
+			video->output_textures[i]  = NULL;
+			video->convert_textures[i] = NULL;
+			video->textures_staged[i]  = false;
+			video->textures_mapped[i]  = false;
 		}
 
 		effect_destroy(video->default_effect);
@@ -192,6 +311,8 @@ static void obs_free_graphics()
 		gs_destroy(video->graphics);
 		video->graphics = NULL;
 		video->cur_texture = 0;
+
+		log_map_stalls(video);
 	}
 }
 
@@ -342,6 +463,13 @@ void obs_shutdown(void)
 
 	bfree(obs);
 	obs = NULL;
+
+	/* anything still live at this point was leaked by libobs or by
+	 * whoever is holding on to libobs objects */
+	if (bmem_tracking_enabled()) {
+		blog(LOG_INFO, "Memory still allocated after shutdown:");
+		bmem_log_tag_stats(LOG_INFO);
+	}
 }
 
 bool obs_reset_video(struct obs_video_info *ovi)
@@ -453,6 +581,26 @@ video_t obs_video(void)
 	return (obs != NULL) ? obs->video.video : NULL;
 }
 
+uint64_t obs_get_frame_map_stall(void)
+{
+	return (obs != NULL) ?
+		(uint64_t)os_atomic_load_int64(&obs->video.map_stall_ns) : 0;
+}
+
+uint32_t obs_get_frame_draw_calls(void)
+{
+	if (!obs)
+		return 0;
+	return (uint32_t)os_atomic_load_long(&obs->video.frame_draw_calls);
+}
+
+uint32_t obs_get_frame_uniform_uploads(void)
+{
+	if (!obs)
+		return 0;
+	return (uint32_t)os_atomic_load_long(&obs->video.frame_uniform_uploads);
+}
+
 /* TODO: optimize this later so it's not just O(N) string lookups */
 static inline struct obs_modal_ui *get_modal_ui_callback(const char *name,
 		const char *task, const char *target)
@@ -83,7 +83,9 @@ struct obs_video_info {
 	uint32_t            base_width;
 	uint32_t            base_height;
 
-	/* output dimensions and format */
+	/* output dimensions and format.  NV12 and I420 are converted on the
+	 * GPU before readback and need dimensions that are a multiple of 8x4,
+	 * other formats are read back as RGBA */
 	uint32_t            output_width;
 	uint32_t            output_height;
 	enum video_format   output_format;
@@ -95,14 +97,18 @@ struct obs_video_info {
 	struct gs_window    window;
 };
 
+/* filtered audio is always AUDIO_FORMAT_FLOAT_PLANAR, one plane per channel
+ * at the main audio output's sample rate and speaker layout */
 struct filtered_audio {
-	void                *data;
+	uint8_t             *data[MAX_AUDIO_CHANNELS];
 	uint32_t            frames;
 	uint64_t            timestamp;
 };
 
+/* planar formats use one plane per channel, interleaved formats only use
+ * data[0] */
 struct source_audio {
-	const void          *data;
+	const uint8_t       *data[MAX_AUDIO_CHANNELS];
 	uint32_t            frames;
 
 	/* audio will be automatically resampled/upmixed/downmixed */
@@ -134,6 +140,17 @@ static inline void source_frame_destroy(struct source_frame *frame)
 	}
 }
 
+struct source_frame_cache_stats {
+	uint64_t            hits;
+	uint64_t            misses;
+
+	/* frames/bytes currently owned by the cache, and the most frames the
+	 * cache has ever had to hold at once */
+	size_t              frames;
+	size_t              bytes;
+	size_t              high_water;
+};
+
 enum packet_priority {
 	PACKET_PRIORITY_DISPOSABLE,
 	PACKET_PRIORITY_LOW,
@@ -245,6 +262,20 @@ EXPORT graphics_t obs_graphics(void);
 EXPORT audio_t obs_audio(void);
 EXPORT video_t obs_video(void);
 
+/**
+ * Returns the time in nanoseconds that the last output frame had to wait for
+ * its staged texture to be mapped.  Anything consistently above zero means
+ * the GPU readback is not keeping up with the staging ring.
+ */
+EXPORT uint64_t obs_get_frame_map_stall(void);
+
+/**
+ * Returns the number of draw calls and effect parameter uploads made by the
+ * last video frame, across the displays and the output render
+ */
+EXPORT uint32_t obs_get_frame_draw_calls(void);
+EXPORT uint32_t obs_get_frame_uniform_uploads(void);
+
 /**
  * Adds a source to the user source list and increments the reference counter
  * for that source.
@@ -372,6 +403,12 @@ EXPORT obs_properties_t obs_source_properties(enum obs_source_type type,
 /** Updates settings for this source */
 EXPORT void obs_source_update(obs_source_t source, obs_data_t settings);
 
+/**
+ * Marks the video of a source as changed.  Only needed for sources with
+ * SOURCE_STATIC_VIDEO whose video changes outside of obs_source_update
+ */
+EXPORT void obs_source_changed(obs_source_t source);
+
 /** Renders a video source. */
 EXPORT void obs_source_video_render(obs_source_t source);
 
@@ -422,6 +459,20 @@ EXPORT void obs_source_setvolume(obs_source_t source, float volume);
 /** Gets the volume for a source that has audio output */
 EXPORT float obs_source_getvolume(obs_source_t source);
 
+/**
+ * Sets the maximum number of async video frames that can be queued for a
+ * source before the oldest queued frames start being dropped
+ */
+EXPORT void obs_source_set_async_queue_depth(obs_source_t source,
+		uint32_t depth);
+
+/** Gets the number of async video frames dropped due to a full queue */
+EXPORT uint32_t obs_source_get_dropped_frames(obs_source_t source);
+
+/** Gets the async video frame cache statistics of a source */
+EXPORT void obs_source_get_frame_cache_stats(obs_source_t source,
+		struct source_frame_cache_stats *stats);
+
 /* ------------------------------------------------------------------------- */
 /* Functions used by sources */
 
@@ -18,6 +18,7 @@
 #include <string.h>
 #include "base.h"
 #include "bmem.h"
+#include "threading.h"
 
 /*
  * NOTE: totally jacked the mem alignment trick from ffmpeg, credit to them:
@@ -82,52 +83,487 @@ static void a_free(void *ptr)
 #endif
 }
 
+/*
+ * Every allocation is prefixed with a header holding its size and tag, so
+ * that tracking can be switched on and off at any time.  Blocks allocated
+ * while tracking is off are marked untracked and never touch the counters,
+ * which keeps the counters balanced and the cost of the off state down to
+ * one branch per call.  The header also records whether the block came from
+ * the slab allocator, so it can be toggled at any time as well.
+ */
+
+struct bmem_header {
+	size_t   size;
+	uint32_t tag;
+	uint16_t tracked;
+	uint16_t slab_class; /* size class + 1, or 0 for the base allocator */
+};
+
+#define HEADER_SIZE ALIGNMENT
+
+struct bmem_counters {
+	volatile int64_t live_bytes;
+	volatile int64_t peak_bytes;
+	volatile int64_t live_allocs;
+	volatile int64_t total_allocs;
+	volatile int64_t total_bytes;
+};
+
+static const char *tag_names[BMEM_TAG_COUNT] = {
+	"general",
+	"video",
+	"audio",
+	"graphics",
+	"data"
+};
+
 static struct base_allocator alloc = {a_malloc, a_realloc, a_free};
-static uint64_t num_allocs = 0;
+static volatile long num_allocs = 0;
+static volatile long tracking = 0;
+static volatile long use_slab = 0;
+static struct bmem_counters counters[BMEM_TAG_COUNT];
+
+/* ------------------------------------------------------------------------- */
+/* slab allocator */
+
+/*
+ * Small blocks (header included) are carved out of 64k chunks taken from the
+ * base allocator, one size class per chunk.  Each thread keeps a short free
+ * list per class, and only takes the global lock to trade half of a list
+ * with the global free lists.  Chunks are kept for reuse rather than given
+ * back.  Blocks keep the usual ALIGNMENT guarantee, and since chunks are
+ * aligned by the base allocator, small blocks no longer pay for the 32bit
+ * alignment hack.
+ */
+
+#define SLAB_CLASSES    9
+#define SLAB_MAX_SIZE   512
+#define SLAB_CHUNK_SIZE (64 * 1024)
+#define SLAB_CACHE_MAX  64
+
+static const size_t slab_sizes[SLAB_CLASSES] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+struct slab_block {
+	struct slab_block *next;
+};
+
+struct slab_chunk {
+	struct slab_chunk *next;
+};
+
+#define SLAB_CHUNK_HEADER ALIGNMENT
+
+struct slab_cache {
+	struct slab_block *blocks[SLAB_CLASSES];
+	size_t            count[SLAB_CLASSES];
+};
+
+static pthread_mutex_t   slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t    slab_once  = PTHREAD_ONCE_INIT;
+static pthread_key_t     slab_key;
+static bool              slab_key_valid = false;
+static struct slab_block *slab_lists[SLAB_CLASSES];
+static struct slab_chunk *slab_chunks = NULL;
+
+static inline int slab_class(size_t size)
+{
+	int i;
+
+	for (i = 0; i < SLAB_CLASSES; i++)
+		if (size <= slab_sizes[i])
+			return i;
+
+	return -1;
+}
+
+/* slab_mutex must be held */
+static void slab_push_list(int cls, struct slab_block *first,
+		struct slab_block *last)
+{
+	last->next = slab_lists[cls];
+	slab_lists[cls] = first;
+}
+
+/* slab_mutex must be held */
+static bool slab_add_chunk(int cls)
+{
+	struct slab_chunk *chunk = alloc.malloc(SLAB_CHUNK_SIZE);
+	size_t block_size = slab_sizes[cls];
+	size_t count = (SLAB_CHUNK_SIZE - SLAB_CHUNK_HEADER) / block_size;
+	char   *blocks;
+	size_t i;
+
+	if (!chunk)
+		return false;
+
+	chunk->next = slab_chunks;
+	slab_chunks = chunk;
+
+	blocks = (char*)chunk + SLAB_CHUNK_HEADER;
+	for (i = 0; i < count - 1; i++)
+		((struct slab_block*)(blocks + i * block_size))->next =
+			(struct slab_block*)(blocks + (i + 1) * block_size);
+
+	slab_push_list(cls, (struct slab_block*)blocks,
+			(struct slab_block*)(blocks + (count - 1) * block_size));
+	return true;
+}
+
+/* slab_mutex must be held.  returns up to 'max' blocks as a list */
+static struct slab_block *slab_take_list(int cls, size_t max, size_t *count)
+{
+	struct slab_block *first, *last;
+	size_t n = 1;
+
+	if (!slab_lists[cls] && !slab_add_chunk(cls)) {
+		*count = 0;
+		return NULL;
+	}
+
+	first = last = slab_lists[cls];
+	while (n < max && last->next) {
+		last = last->next;
+		n++;
+	}
+
+	slab_lists[cls] = last->next;
+	last->next = NULL;
+
+	*count = n;
+	return first;
+}
+
+static void slab_cache_flush(struct slab_cache *cache, int cls, size_t keep)
+{
+	struct slab_block *first, *last;
+
+	if (cache->count[cls] <= keep)
+		return;
+
+	first = last = cache->blocks[cls];
+	while (--cache->count[cls] > keep)
+		last = last->next;
+
+	cache->blocks[cls] = last->next;
+
+	pthread_mutex_lock(&slab_mutex);
+	slab_push_list(cls, first, last);
+	pthread_mutex_unlock(&slab_mutex);
+}
+
+static void slab_thread_exit(void *param)
+{
+	struct slab_cache *cache = param;
+	int i;
+
+	for (i = 0; i < SLAB_CLASSES; i++)
+		slab_cache_flush(cache, i, 0);
+
+	alloc.free(cache);
+}
+
+static void slab_init(void)
+{
+	slab_key_valid = pthread_key_create(&slab_key, slab_thread_exit) == 0;
+}
+
+static struct slab_cache *slab_get_cache(void)
+{
+	struct slab_cache *cache;
+
+	pthread_once(&slab_once, slab_init);
+	if (!slab_key_valid)
+		return NULL;
+
+	cache = pthread_getspecific(slab_key);
+	if (!cache) {
+		cache = alloc.malloc(sizeof(struct slab_cache));
+		if (!cache)
+			return NULL;
+
+		memset(cache, 0, sizeof(struct slab_cache));
+		pthread_setspecific(slab_key, cache);
+	}
+
+	return cache;
+}
+
+static void *slab_alloc(int cls)
+{
+	struct slab_cache *cache = slab_get_cache();
+	struct slab_block *block;
+	size_t count;
+
+	if (!cache) {
+		pthread_mutex_lock(&slab_mutex);
+		block = slab_take_list(cls, 1, &count);
+		pthread_mutex_unlock(&slab_mutex);
+		return block;
+	}
+
+	if (!cache->blocks[cls]) {
+		pthread_mutex_lock(&slab_mutex);
+		cache->blocks[cls] = slab_take_list(cls, SLAB_CACHE_MAX / 2,
+				&cache->count[cls]);
+		pthread_mutex_unlock(&slab_mutex);
+
+		if (!cache->blocks[cls])
+			return NULL;
+	}
+
+	block = cache->blocks[cls];
+	cache->blocks[cls] = block->next;
+	cache->count[cls]--;
+	return block;
+}
+
+static void slab_free(int cls, void *ptr)
+{
+	struct slab_cache *cache = slab_get_cache();
+	struct slab_block *block = ptr;
+
+	if (!cache) {
+		pthread_mutex_lock(&slab_mutex);
+		slab_push_list(cls, block, block);
+		pthread_mutex_unlock(&slab_mutex);
+		return;
+	}
+
+	block->next = cache->blocks[cls];
+	cache->blocks[cls] = block;
+
+	if (++cache->count[cls] > SLAB_CACHE_MAX)
+		slab_cache_flush(cache, cls, SLAB_CACHE_MAX / 2);
+}
+
+/* allocates a block with room for the header, from the slab if it's small
+ * enough and enabled */
+static struct bmem_header *header_alloc(size_t size)
+{
+	size_t total = size + HEADER_SIZE;
+	struct bmem_header *header;
+	int cls = -1;
+
+	if (use_slab && total <= SLAB_MAX_SIZE)
+		cls = slab_class(total);
+
+	header = (cls >= 0) ? slab_alloc(cls) : NULL;
+	if (header) {
+		header->slab_class = (uint16_t)(cls + 1);
+		return header;
+	}
+
+	header = alloc.malloc(total);
+	if (header)
+		header->slab_class = 0;
+	return header;
+}
+
+static void header_free(struct bmem_header *header)
+{
+	if (header->slab_class)
+		slab_free(header->slab_class - 1, header);
+	else
+		alloc.free(header);
+}
+
+static struct bmem_header *header_realloc(struct bmem_header *header,
+		size_t size)
+{
+	struct bmem_header *new_header;
+
+	if (!header->slab_class)
+		return alloc.realloc(header, size + HEADER_SIZE);
+
+	/* stays in the same block if it still fits */
+	if (size + HEADER_SIZE <= slab_sizes[header->slab_class - 1])
+		return header;
+
+	new_header = header_alloc(size);
+	if (!new_header)
+		return NULL;
+
+	memcpy((char*)new_header + HEADER_SIZE, (char*)header + HEADER_SIZE,
+			header->size);
+	new_header->size    = header->size;
+	new_header->tag     = header->tag;
+	new_header->tracked = header->tracked;
+
+	header_free(header);
+	return new_header;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline struct bmem_header *get_header(void *ptr)
+{
+	return (struct bmem_header*)((char*)ptr - HEADER_SIZE);
+}
+
+static void track_size(uint32_t tag, int64_t change)
+{
+	struct bmem_counters *c = counters + tag;
+	int64_t live = os_atomic_add_int64(&c->live_bytes, change);
+	int64_t peak;
+
+	if (change > 0)
+		os_atomic_add_int64(&c->total_bytes, change);
+
+	do {
+		peak = os_atomic_load_int64(&c->peak_bytes);
+	} while (live > peak &&
+	         !os_atomic_compare_swap_int64(&c->peak_bytes, peak, live));
+}
+
+static inline void track_alloc(struct bmem_header *header)
+{
+	struct bmem_counters *c = counters + header->tag;
+
+	os_atomic_add_int64(&c->live_allocs, 1);
+	os_atomic_add_int64(&c->total_allocs, 1);
+	track_size(header->tag, (int64_t)header->size);
+}
+
+static inline void track_free(struct bmem_header *header)
+{
+	os_atomic_add_int64(&counters[header->tag].live_allocs, -1);
+	track_size(header->tag, -(int64_t)header->size);
+}
 
 void base_set_allocator(struct base_allocator *defs)
 {
 	memcpy(&alloc, defs, sizeof(struct base_allocator));
 }
 
-void *bmalloc(size_t size)
+void *bmalloc_tagged(size_t size, enum bmem_tag tag)
 {
-	void *ptr = alloc.malloc(size);
-	if (!ptr && !size)
-		ptr = alloc.malloc(1);
-	if (!ptr)
+	struct bmem_header *header = header_alloc(size);
+	if (!header)
 		bcrash("Out of memory while trying to allocate %lu bytes",
 				(unsigned long)size);
 
-	num_allocs++;
-	return ptr;
+	if (tag >= BMEM_TAG_COUNT)
+		tag = BMEM_TAG_GENERAL;
+
+	header->size    = size;
+	header->tag     = (uint32_t)tag;
+	header->tracked = tracking != 0;
+
+	if (header->tracked)
+		track_alloc(header);
+
+	os_atomic_inc_long(&num_allocs);
+	return (char*)header + HEADER_SIZE;
+}
+
+void *bmalloc(size_t size)
+{
+	return bmalloc_tagged(size, BMEM_TAG_GENERAL);
 }
 
 void *brealloc(void *ptr, size_t size)
 {
-	if (!ptr)
-		num_allocs++;
+	struct bmem_header *header;
+	size_t old_size;
 
-	ptr = alloc.realloc(ptr, size);
-	if (!ptr && !size)
-		ptr = alloc.realloc(ptr, 1);
 	if (!ptr)
+		return bmalloc(size);
+
+	header   = get_header(ptr);
+	old_size = header->size;
+
+	header = header_realloc(header, size);
+	if (!header)
 		bcrash("Out of memory while trying to allocate %lu bytes",
 				(unsigned long)size);
 
-	return ptr;
+	header->size = size;
+	if (header->tracked)
+		track_size(header->tag, (int64_t)size - (int64_t)old_size);
+
+	return (char*)header + HEADER_SIZE;
 }
 
 void bfree(void *ptr)
 {
-	if (ptr)
-		num_allocs--;
-	alloc.free(ptr);
+	struct bmem_header *header;
+
+	if (!ptr)
+		return;
+
+	header = get_header(ptr);
+	if (header->tracked)
+		track_free(header);
+
+	os_atomic_dec_long(&num_allocs);
+	header_free(header);
 }
 
 uint64_t bnum_allocs(void)
 {
-	return num_allocs;
+	return (uint64_t)os_atomic_load_long(&num_allocs);
+}
+
+void bmem_set_tracking(bool enable)
+{
+	os_atomic_set_long(&tracking, enable);
+}
+
+bool bmem_tracking_enabled(void)
+{
+	return os_atomic_load_long(&tracking) != 0;
+}
+
+void bmem_set_slab_allocator(bool enable)
+{
+	os_atomic_set_long(&use_slab, enable);
+}
+
+bool bmem_slab_allocator_enabled(void)
+{
+	return os_atomic_load_long(&use_slab) != 0;
+}
+
+const char *bmem_tag_name(enum bmem_tag tag)
+{
+	return tag < BMEM_TAG_COUNT ? tag_names[tag] : NULL;
+}
+
+void bmem_get_tag_stats(enum bmem_tag tag, struct bmem_tag_stats *stats)
+{
+	struct bmem_counters *c;
+
+	memset(stats, 0, sizeof(struct bmem_tag_stats));
+	if (tag >= BMEM_TAG_COUNT)
+		return;
+
+	c = counters + tag;
+	stats->live_bytes   = (uint64_t)os_atomic_load_int64(&c->live_bytes);
+	stats->peak_bytes   = (uint64_t)os_atomic_load_int64(&c->peak_bytes);
+	stats->live_allocs  = (uint64_t)os_atomic_load_int64(&c->live_allocs);
+	stats->total_allocs = (uint64_t)os_atomic_load_int64(&c->total_allocs);
+	stats->total_bytes  = (uint64_t)os_atomic_load_int64(&c->total_bytes);
+}
+
+void bmem_log_tag_stats(int log_level)
+{
+	int i;
+
+	for (i = 0; i < BMEM_TAG_COUNT; i++) {
+		struct bmem_tag_stats stats;
+		bmem_get_tag_stats((enum bmem_tag)i, &stats);
+
+		blog(log_level, "\t%-8s: %llu bytes in %llu allocations "
+		                "(peak %llu bytes, %llu allocations of %llu "
+		                "bytes total)", tag_names[i],
+		                (unsigned long long)stats.live_bytes,
+		                (unsigned long long)stats.live_allocs,
+		                (unsigned long long)stats.peak_bytes,
+		                (unsigned long long)stats.total_allocs,
+		                (unsigned long long)stats.total_bytes);
+	}
 }
 
 void *bmemdup(const void *ptr, size_t size)
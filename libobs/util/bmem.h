@@ -33,12 +33,54 @@ struct base_allocator {
 
 EXPORT void base_set_allocator(struct base_allocator *defs);
 
+/*
+ * Serves small allocations (up to about 500 bytes) from per-thread caches of
+ * fixed-size blocks instead of the base allocator.  Off by default; meant to
+ * be switched on at startup, although it's safe to toggle at any time.
+ */
+EXPORT void bmem_set_slab_allocator(bool enable);
+EXPORT bool bmem_slab_allocator_enabled(void);
+
+/*
+ * Allocation accounting
+ *
+ *   Allocations can be tagged with the subsystem they belong to.  When
+ * tracking is enabled, live bytes, peak bytes and allocation counts are kept
+ * per tag.  Untagged allocations count as BMEM_TAG_GENERAL, and reallocated
+ * blocks keep their original tag.  Only blocks allocated while tracking is
+ * enabled are counted.
+ */
+
+enum bmem_tag {
+	BMEM_TAG_GENERAL,
+	BMEM_TAG_VIDEO,
+	BMEM_TAG_AUDIO,
+	BMEM_TAG_GRAPHICS,
+	BMEM_TAG_DATA,
+	BMEM_TAG_COUNT
+};
+
+struct bmem_tag_stats {
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+	uint64_t live_allocs;
+	uint64_t total_allocs;
+	uint64_t total_bytes;
+};
+
 EXPORT void *bmalloc(size_t size);
+EXPORT void *bmalloc_tagged(size_t size, enum bmem_tag tag);
 EXPORT void *brealloc(void *ptr, size_t size);
 EXPORT void bfree(void *ptr);
 
 EXPORT uint64_t bnum_allocs(void);
 
+EXPORT void bmem_set_tracking(bool enable);
+EXPORT bool bmem_tracking_enabled(void);
+EXPORT const char *bmem_tag_name(enum bmem_tag tag);
+EXPORT void bmem_get_tag_stats(enum bmem_tag tag, struct bmem_tag_stats *stats);
+EXPORT void bmem_log_tag_stats(int log_level);
+
 EXPORT void *bmemdup(const void *ptr, size_t size);
 
 static inline char *bstrdup_n(const char *str, size_t n)
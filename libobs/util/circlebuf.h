@@ -27,7 +27,17 @@
 extern "C" {
 #endif
 
-/* Dynamic circular buffer */
+/*
+ * Dynamic circular buffer
+ *
+ *   Data can either be copied in and out (push_back/pop_front), or accessed
+ *   in place: peek_front and reserve_back return the ring memory as up to
+ *   two contiguous spans, the second being non-empty only if the data wraps
+ *   around the end of the buffer.
+ *
+ *   In power-of-two mode (circlebuf_init_pow2) the capacity is always a
+ *   power of two and positions wrap with a mask instead of a branch.
+ */
 
 struct circlebuf {
 	void   *data;
@@ -36,6 +46,8 @@ struct circlebuf {
 	size_t start_pos;
 	size_t end_pos;
 	size_t capacity;
+
+	bool   pow2;
 };
 
 static inline void circlebuf_init(struct circlebuf *cb)
@@ -43,10 +55,41 @@ static inline void circlebuf_init(struct circlebuf *cb)
 	memset(cb, 0, sizeof(struct circlebuf));
 }
 
+static inline void circlebuf_init_pow2(struct circlebuf *cb)
+{
+	memset(cb, 0, sizeof(struct circlebuf));
+	cb->pow2 = true;
+}
+
 static inline void circlebuf_free(struct circlebuf *cb)
 {
+	bool pow2 = cb->pow2;
+
 	bfree(cb->data);
 	memset(cb, 0, sizeof(struct circlebuf));
+	cb->pow2 = pow2;
+}
+
+/* wraps a position that's less than twice the capacity */
+static inline size_t circlebuf_wrap(const struct circlebuf *cb, size_t pos)
+{
+	if (cb->pow2)
+		return pos & (cb->capacity - 1);
+
+	return (pos >= cb->capacity) ? pos - cb->capacity : pos;
+}
+
+static inline size_t circlebuf_round_capacity(const struct circlebuf *cb,
+		size_t capacity)
+{
+	size_t pow2_capacity = 1;
+
+	if (!cb->pow2)
+		return capacity;
+
+	while (pow2_capacity < capacity)
+		pow2_capacity <<= 1;
+	return pow2_capacity;
 }
 
 static inline void circlebuf_reorder_data(struct circlebuf *cb,
@@ -64,41 +107,55 @@ static inline void circlebuf_reorder_data(struct circlebuf *cb,
 	cb->start_pos += difference;
 }
 
-static inline void circlebuf_ensure_capacity(struct circlebuf *cb)
+static inline void circlebuf_realloc(struct circlebuf *cb,
+		size_t new_capacity)
 {
-	size_t new_capacity;
-	if (cb->size <= cb->capacity)
-		return;
+	new_capacity = circlebuf_round_capacity(cb, new_capacity);
 
-	new_capacity = cb->capacity*2;
-	if (cb->size > new_capacity)
-		new_capacity = cb->size;
+	/* data that ends exactly at the end of the buffer has end_pos wrapped
+	 * to 0, but stays where it is when the buffer grows */
+	if (cb->size && !cb->end_pos)
+		cb->end_pos = cb->capacity;
 
 	cb->data = brealloc(cb->data, new_capacity);
 	circlebuf_reorder_data(cb, new_capacity);
 	cb->capacity = new_capacity;
 }
 
+/* grows the buffer to hold at least 'needed' bytes.  must be called before
+ * cb->size is updated */
+static inline void circlebuf_grow(struct circlebuf *cb, size_t needed)
+{
+	size_t new_capacity;
+	if (needed <= cb->capacity)
+		return;
+
+	new_capacity = cb->capacity*2;
+	if (needed > new_capacity)
+		new_capacity = needed;
+
+	circlebuf_realloc(cb, new_capacity);
+}
+
 static inline void circlebuf_reserve(struct circlebuf *cb, size_t capacity)
 {
 	if (capacity <= cb->capacity)
 		return;
 
-	cb->data = brealloc(cb->data, capacity);
-	circlebuf_reorder_data(cb, capacity);
-	cb->capacity = capacity;
+	circlebuf_realloc(cb, capacity);
 }
 
 static inline void circlebuf_upsize(struct circlebuf *cb, size_t size)
 {
 	size_t add_size = size - cb->size;
-	size_t new_end_pos = cb->end_pos + add_size;
+	size_t new_end_pos;
 
 	if (size <= cb->size)
 		return;
 
+	circlebuf_grow(cb, size);
+	new_end_pos = cb->end_pos + add_size;
 	cb->size = size;
-	circlebuf_ensure_capacity(cb);
 
 	if (new_end_pos > cb->capacity) {
 		size_t back_size = cb->capacity - cb->end_pos;
@@ -108,12 +165,11 @@ static inline void circlebuf_upsize(struct circlebuf *cb, size_t size)
 			memset((uint8_t*)cb->data + cb->end_pos, 0, back_size);
 
 		memset(cb->data, 0, loop_size);
-		new_end_pos -= cb->capacity;
 	} else {
 		memset((uint8_t*)cb->data + cb->end_pos, 0, add_size);
 	}
 
-	cb->end_pos = new_end_pos;
+	cb->end_pos = circlebuf_wrap(cb, new_end_pos);
 }
 
 /** Overwrites data at a specific point in the buffer (relative).  */
@@ -126,9 +182,7 @@ static inline void circlebuf_place(struct circlebuf *cb, size_t position,
 	if (end_point > cb->size)
 		circlebuf_upsize(cb, end_point);
 
-	position += cb->start_pos;
-	if (position >= cb->capacity)
-		position -= cb->capacity;
+	position = circlebuf_wrap(cb, cb->start_pos + position);
 
 	data_end_pos = position + size;
 	if (data_end_pos > cb->capacity) {
@@ -146,10 +200,11 @@ static inline void circlebuf_place(struct circlebuf *cb, size_t position,
 static inline void circlebuf_push_back(struct circlebuf *cb, const void *data,
 		size_t size)
 {
-	size_t new_end_pos = cb->end_pos + size;
+	size_t new_end_pos;
 
+	circlebuf_grow(cb, cb->size + size);
+	new_end_pos = cb->end_pos + size;
 	cb->size += size;
-	circlebuf_ensure_capacity(cb);
 
 	if (new_end_pos > cb->capacity) {
 		size_t back_size = cb->capacity - cb->end_pos;
@@ -159,38 +214,93 @@ static inline void circlebuf_push_back(struct circlebuf *cb, const void *data,
 			memcpy((uint8_t*)cb->data + cb->end_pos, data,
 					back_size);
 		memcpy(cb->data, (uint8_t*)data + back_size, loop_size);
-
-		new_end_pos -= cb->capacity;
 	} else {
 		memcpy((uint8_t*)cb->data + cb->end_pos, data, size);
 	}
 
-	cb->end_pos = new_end_pos;
+	cb->end_pos = circlebuf_wrap(cb, new_end_pos);
 }
 
-static inline void circlebuf_pop_front(struct circlebuf *cb, void *data,
-		size_t size)
+/**
+ * Returns the first 'size' bytes of the buffer in place, without removing
+ * them.  *size2 is 0 unless the data wraps around.
+ */
+static inline void circlebuf_peek_front(struct circlebuf *cb, size_t size,
+		void **data1, size_t *size1, void **data2, size_t *size2)
 {
 	size_t start_size;
 	assert(size <= cb->size);
 
 	start_size = cb->capacity - cb->start_pos;
+	*data1 = (uint8_t*)cb->data + cb->start_pos;
+
+	if (start_size < size) {
+		*size1 = start_size;
+		*data2 = cb->data;
+		*size2 = size - start_size;
+	} else {
+		*size1 = size;
+		*data2 = NULL;
+		*size2 = 0;
+	}
+}
+
+static inline void circlebuf_pop_front(struct circlebuf *cb, void *data,
+		size_t size)
+{
+	assert(size <= cb->size);
 
 	if (data) {
-		if (start_size < size) {
-			memcpy(data, (uint8_t*)cb->data + cb->start_pos,
-					start_size);
-			memcpy((uint8_t*)data + start_size, cb->data,
-					size - start_size);
-		} else {
-			memcpy(data, (uint8_t*)cb->data + cb->start_pos, size);
-		}
+		void   *data1, *data2;
+		size_t size1, size2;
+
+		circlebuf_peek_front(cb, size, &data1, &size1, &data2, &size2);
+
+		memcpy(data, data1, size1);
+		if (size2)
+			memcpy((uint8_t*)data + size1, data2, size2);
 	}
 
 	cb->size -= size;
-	cb->start_pos += size;
-	if (cb->start_pos >= cb->capacity)
-		cb->start_pos -= cb->capacity;
+	cb->start_pos = circlebuf_wrap(cb, cb->start_pos + size);
+}
+
+/**
+ * Makes room for 'size' more bytes at the end of the buffer and returns
+ * that space in place.  The data isn't part of the buffer until
+ * circlebuf_commit_back is called, and the spans are only valid until the
+ * buffer is modified again.
+ */
+static inline void circlebuf_reserve_back(struct circlebuf *cb, size_t size,
+		void **data1, size_t *size1, void **data2, size_t *size2)
+{
+	size_t end_pos, back_size;
+
+	circlebuf_grow(cb, cb->size + size);
+
+	end_pos   = circlebuf_wrap(cb, cb->end_pos);
+	back_size = cb->capacity - end_pos;
+	*data1    = (uint8_t*)cb->data + end_pos;
+
+	if (back_size < size) {
+		*size1 = back_size;
+		*data2 = cb->data;
+		*size2 = size - back_size;
+	} else {
+		*size1 = size;
+		*data2 = NULL;
+		*size2 = 0;
+	}
+}
+
+/** Adds 'size' bytes written after circlebuf_reserve_back to the buffer */
+static inline void circlebuf_commit_back(struct circlebuf *cb, size_t size)
+{
+	assert(cb->size + size <= cb->capacity);
+
+	cb->size   += size;
+	cb->end_pos = circlebuf_wrap(cb,
+			circlebuf_wrap(cb, cb->end_pos) + size);
 }
 
 #ifdef __cplusplus
@@ -90,6 +90,12 @@ uint64_t os_gettime_ns(void)
 	return *(uint64_t*) &nano;
 }
 
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cores > 0) ? (int)cores : 1;
+}
+
 /* gets the location ~/Library/Application Support/[name] */
 char *os_get_config_path(const char *name)
 {
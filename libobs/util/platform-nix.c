@@ -82,6 +82,12 @@ uint64_t os_gettime_ns(void)
 	return ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
 }
 
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cores > 0) ? (int)cores : 1;
+}
+
 /* should return $HOME/.[name] */
 char *os_get_config_path(const char *name)
 {
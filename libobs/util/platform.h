@@ -62,6 +62,8 @@ EXPORT void os_sleep_ms(uint32_t duration);
 
 EXPORT uint64_t os_gettime_ns(void);
 
+EXPORT int os_get_logical_cores(void);
+
 EXPORT char *os_get_config_path(const char *name);
 
 EXPORT bool os_file_exists(const char *path);
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2013 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free single-producer/single-consumer circular buffer
+ *
+ *   Unlike circlebuf, the capacity is fixed (rounded up to a power of two)
+ *   and writes fail instead of growing the buffer.  One thread may write
+ *   (reserve_back/commit_back/push_back) while another reads
+ *   (peek_front/pop_front) without any locking.
+ *
+ *   Positions run modulo twice the capacity so that a full buffer can be
+ *   told apart from an empty one.  Each side caches the other side's
+ *   position and only reloads it when it seems to be out of space or data,
+ *   and the two sides are kept on separate cache lines.
+ */
+
+#define SPSC_CACHE_LINE 64
+
+struct spsc_circlebuf {
+	uint8_t       *data;
+	size_t        capacity;
+	char          pad0[SPSC_CACHE_LINE];
+
+	/* consumer side */
+	volatile long head;
+	size_t        cached_tail;
+	char          pad1[SPSC_CACHE_LINE];
+
+	/* producer side */
+	volatile long tail;
+	size_t        cached_head;
+	char          pad2[SPSC_CACHE_LINE];
+};
+
+static inline void spsc_circlebuf_init_tagged(struct spsc_circlebuf *cb,
+		size_t capacity, enum bmem_tag tag)
+{
+	size_t pow2_capacity = 1;
+
+	while (pow2_capacity < capacity)
+		pow2_capacity <<= 1;
+
+	memset(cb, 0, sizeof(struct spsc_circlebuf));
+	cb->data     = bmalloc_tagged(pow2_capacity, tag);
+	cb->capacity = pow2_capacity;
+}
+
+static inline void spsc_circlebuf_init(struct spsc_circlebuf *cb,
+		size_t capacity)
+{
+	spsc_circlebuf_init_tagged(cb, capacity, BMEM_TAG_GENERAL);
+}
+
+static inline void spsc_circlebuf_free(struct spsc_circlebuf *cb)
+{
+	bfree(cb->data);
+	memset(cb, 0, sizeof(struct spsc_circlebuf));
+}
+
+static inline size_t spsc_circlebuf_distance(const struct spsc_circlebuf *cb,
+		size_t head, size_t tail)
+{
+	return (tail - head) & (cb->capacity * 2 - 1);
+}
+
+/* gets the spans of 'size' bytes starting at a position */
+static inline void spsc_circlebuf_spans(const struct spsc_circlebuf *cb,
+		size_t pos, size_t size,
+		void **data1, size_t *size1, void **data2, size_t *size2)
+{
+	size_t start = pos & (cb->capacity - 1);
+	size_t start_size = cb->capacity - start;
+
+	*data1 = cb->data + start;
+
+	if (start_size < size) {
+		*size1 = start_size;
+		*data2 = cb->data;
+		*size2 = size - start_size;
+	} else {
+		*size1 = size;
+		*data2 = NULL;
+		*size2 = 0;
+	}
+}
+
+/** Returns the amount of data in the buffer.  Safe to call from either side,
+ * but the result may be stale as soon as it's returned */
+static inline size_t spsc_circlebuf_size(const struct spsc_circlebuf *cb)
+{
+	size_t head = (size_t)os_atomic_load_long(&cb->head);
+	size_t tail = (size_t)os_atomic_load_long(&cb->tail);
+	return spsc_circlebuf_distance(cb, head, tail);
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer */
+
+/** Returns the space available for writing.  Producer only */
+static inline size_t spsc_circlebuf_free_space(struct spsc_circlebuf *cb)
+{
+	size_t tail = (size_t)cb->tail;
+
+	cb->cached_head = (size_t)os_atomic_load_long(&cb->head);
+	return cb->capacity - spsc_circlebuf_distance(cb, cb->cached_head,
+			tail);
+}
+
+/**
+ * Returns 'size' bytes of free space at the end of the buffer as up to two
+ * spans, or false if there isn't enough space.  The data becomes visible to
+ * the consumer when spsc_circlebuf_commit_back is called.  Producer only.
+ */
+static inline bool spsc_circlebuf_reserve_back(struct spsc_circlebuf *cb,
+		size_t size, void **data1, size_t *size1,
+		void **data2, size_t *size2)
+{
+	size_t tail = (size_t)cb->tail;
+
+	if (cb->capacity -
+	    spsc_circlebuf_distance(cb, cb->cached_head, tail) < size &&
+	    spsc_circlebuf_free_space(cb) < size)
+		return false;
+
+	spsc_circlebuf_spans(cb, tail, size, data1, size1, data2, size2);
+	return true;
+}
+
+static inline void spsc_circlebuf_commit_back(struct spsc_circlebuf *cb,
+		size_t size)
+{
+	size_t tail = ((size_t)cb->tail + size) & (cb->capacity * 2 - 1);
+	os_atomic_set_long(&cb->tail, (long)tail);
+}
+
+static inline bool spsc_circlebuf_push_back(struct spsc_circlebuf *cb,
+		const void *data, size_t size)
+{
+	void   *data1, *data2;
+	size_t size1, size2;
+
+	if (!spsc_circlebuf_reserve_back(cb, size, &data1, &size1,
+				&data2, &size2))
+		return false;
+
+	memcpy(data1, data, size1);
+	if (size2)
+		memcpy(data2, (const uint8_t*)data + size1, size2);
+
+	spsc_circlebuf_commit_back(cb, size);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer */
+
+/** Returns the amount of data available for reading.  Consumer only */
+static inline size_t spsc_circlebuf_available(struct spsc_circlebuf *cb)
+{
+	size_t head = (size_t)cb->head;
+
+	cb->cached_tail = (size_t)os_atomic_load_long(&cb->tail);
+	return spsc_circlebuf_distance(cb, head, cb->cached_tail);
+}
+
+/**
+ * Returns the first 'size' bytes of the buffer in place as up to two spans,
+ * or false if there isn't that much data.  Consumer only.
+ */
+static inline bool spsc_circlebuf_peek_front(struct spsc_circlebuf *cb,
+		size_t size, void **data1, size_t *size1,
+		void **data2, size_t *size2)
+{
+	size_t head = (size_t)cb->head;
+
+	if (spsc_circlebuf_distance(cb, head, cb->cached_tail) < size &&
+	    spsc_circlebuf_available(cb) < size)
+		return false;
+
+	spsc_circlebuf_spans(cb, head, size, data1, size1, data2, size2);
+	return true;
+}
+
+/** Removes 'size' bytes from the front, copying them to 'data' if it's not
+ * NULL.  Returns false if there isn't that much data.  Consumer only */
+static inline bool spsc_circlebuf_pop_front(struct spsc_circlebuf *cb,
+		void *data, size_t size)
+{
+	void   *data1, *data2;
+	size_t size1, size2;
+	size_t head;
+
+	if (!spsc_circlebuf_peek_front(cb, size, &data1, &size1,
+				&data2, &size2))
+		return false;
+
+	if (data) {
+		memcpy(data, data1, size1);
+		if (size2)
+			memcpy((uint8_t*)data + size1, data2, size2);
+	}
+
+	head = ((size_t)cb->head + size) & (cb->capacity * 2 - 1);
+	os_atomic_set_long(&cb->head, (long)head);
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
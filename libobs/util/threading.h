@@ -27,6 +27,7 @@
 #include "c99defs.h"
 
 #ifdef _MSC_VER
+#include <intrin.h>
 #include "../../deps/w32-pthreads/pthread.h"
 #include "../../deps/w32-pthreads/semaphore.h"
 #else
@@ -131,6 +132,138 @@ static inline void event_reset(event_t *event)
 	pthread_mutex_unlock(&event->mutex);
 }
 
+/*
+ *   Atomic operations.  All operations are full memory barriers.
+ */
+
+#ifdef _MSC_VER
+
+static inline long os_atomic_inc_long(volatile long *val)
+{
+	return _InterlockedIncrement(val);
+}
+
+static inline long os_atomic_dec_long(volatile long *val)
+{
+	return _InterlockedDecrement(val);
+}
+
+static inline long os_atomic_add_long(volatile long *val, long add)
+{
+	return _InterlockedExchangeAdd(val, add) + add;
+}
+
+static inline long os_atomic_set_long(volatile long *ptr, long val)
+{
+	return _InterlockedExchange(ptr, val);
+}
+
+static inline long os_atomic_load_long(const volatile long *ptr)
+{
+	return _InterlockedOr((volatile long*)ptr, 0);
+}
+
+static inline bool os_atomic_compare_swap_long(volatile long *val,
+		long old_val, long new_val)
+{
+	return _InterlockedCompareExchange(val, new_val, old_val) == old_val;
+}
+
+/* the 64bit add/or intrinsics are x64-only, compare-exchange isn't */
+static inline int64_t os_atomic_load_int64(const volatile int64_t *ptr)
+{
+	return _InterlockedCompareExchange64((volatile int64_t*)ptr, 0, 0);
+}
+
+static inline int64_t os_atomic_add_int64(volatile int64_t *val, int64_t add)
+{
+	int64_t old_val;
+
+	do {
+		old_val = *val;
+	} while (_InterlockedCompareExchange64(val, old_val + add, old_val) !=
+			old_val);
+
+	return old_val + add;
+}
+
+static inline int64_t os_atomic_set_int64(volatile int64_t *ptr,
+		int64_t val)
+{
+	int64_t old_val;
+
+	do {
+		old_val = *ptr;
+	} while (_InterlockedCompareExchange64(ptr, val, old_val) != old_val);
+
+	return old_val;
+}
+
+static inline bool os_atomic_compare_swap_int64(volatile int64_t *val,
+		int64_t old_val, int64_t new_val)
+{
+	return _InterlockedCompareExchange64(val, new_val, old_val) == old_val;
+}
+
+#else
+
+static inline long os_atomic_inc_long(volatile long *val)
+{
+	return __atomic_add_fetch(val, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long os_atomic_dec_long(volatile long *val)
+{
+	return __atomic_sub_fetch(val, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline long os_atomic_add_long(volatile long *val, long add)
+{
+	return __atomic_add_fetch(val, add, __ATOMIC_SEQ_CST);
+}
+
+static inline long os_atomic_set_long(volatile long *ptr, long val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline long os_atomic_load_long(const volatile long *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline bool os_atomic_compare_swap_long(volatile long *val,
+		long old_val, long new_val)
+{
+	return __atomic_compare_exchange_n(val, &old_val, new_val, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t os_atomic_add_int64(volatile int64_t *val, int64_t add)
+{
+	return __atomic_add_fetch(val, add, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t os_atomic_load_int64(const volatile int64_t *ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t os_atomic_set_int64(volatile int64_t *ptr,
+		int64_t val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+static inline bool os_atomic_compare_swap_int64(volatile int64_t *val,
+		int64_t old_val, int64_t new_val)
+{
+	return __atomic_compare_exchange_n(val, &old_val, new_val, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
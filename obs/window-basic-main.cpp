@@ -305,6 +305,7 @@ bool OBSBasic::InitAudio()
 	ai.format = AUDIO_FORMAT_16BIT;
 	ai.speakers = SPEAKERS_STEREO;
 	ai.buffer_ms = 700;
+	ai.frames_per_block = AUDIO_OUTPUT_FRAMES;
 
 	return obs_reset_audio(&ai);
 }
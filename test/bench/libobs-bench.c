@@ -0,0 +1,910 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/darray.h>
+#include <util/circlebuf.h>
+#include <util/spsc-circlebuf.h>
+#include <util/threading.h>
+#include <callback/calldata.h>
+#include <callback/signal.h>
+#include <media-io/format-conversion.h>
+#include <media-io/audio-resampler.h>
+#include <obs-data.h>
+
+/*
+ * Throughput benchmarks for libobs kernels and containers.
+ *
+ *   libobs-bench [-f text|csv|json] [-o file] [-t min_ms] [filter]
+ *
+ * Each case runs in batches (doubling the batch size) until a batch takes at
+ * least min_ms, and the last batch is reported.  Only cases whose name
+ * contains 'filter' are run.
+ */
+
+enum output_format {
+	OUTPUT_TEXT,
+	OUTPUT_CSV,
+	OUTPUT_JSON
+};
+
+struct bench_case {
+	const char *name;
+	int        param;
+
+	/* returns NULL if the case can't run on this system */
+	void   *(*create)(int param);
+	void   (*destroy)(void *data);
+
+	/* runs one iteration, returns the number of bytes processed (or 0) */
+	size_t (*run)(void *data);
+};
+
+struct bench_result {
+	const char *name;
+	uint64_t   iterations;
+	uint64_t   total_ns;
+	uint64_t   bytes;
+};
+
+static void bench_log(enum log_type type, const char *msg, va_list args)
+{
+	if (type <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void fill_random(uint8_t *data, size_t size)
+{
+	size_t i;
+	for (i = 0; i < size; i++)
+		data[i] = (uint8_t)rand();
+}
+
+/* ------------------------------------------------------------------------- */
+/* format conversion */
+
+/* conversion cases run at each of these frame sizes */
+enum conversion_size {
+	CONVERSION_720P,
+	CONVERSION_1080P,
+	CONVERSION_2160P
+};
+
+static const uint32_t conversion_sizes[][2] = {
+	{1280, 720},
+	{1920, 1080},
+	{3840, 2160}
+};
+
+/* the case parameter holds the conversion path and the frame size */
+#define CONVERSION_PARAM(path, size) ((int)(path) | ((int)(size) << 8))
+
+struct conversion_data {
+	uint32_t width;
+	uint32_t height;
+	uint8_t  *input;
+	uint8_t  *output;
+	void     *planes[3];
+};
+
+static void *conversion_create(int param)
+{
+	enum format_conversion_path path = param & 0xFF;
+	enum conversion_size        frame_size = param >> 8;
+	struct conversion_data      *data;
+	uint32_t width  = conversion_sizes[frame_size][0];
+	uint32_t height = conversion_sizes[frame_size][1];
+	size_t   size   = width * height * 4;
+
+	if (!format_conversion_set_path(path))
+		return NULL;
+
+	data = bmalloc(sizeof(struct conversion_data));
+	data->width  = width;
+	data->height = height;
+	data->input  = bmalloc(size);
+	data->output = bmalloc(size);
+	data->planes[0] = data->output;
+	data->planes[1] = data->output + width * height;
+	data->planes[2] = data->output + width * height * 5 / 4;
+
+	fill_random(data->input, size);
+	return data;
+}
+
+static void conversion_destroy(void *param)
+{
+	struct conversion_data *data = param;
+
+	format_conversion_set_path(format_conversion_best_path());
+	bfree(data->input);
+	bfree(data->output);
+	bfree(data);
+}
+
+static size_t run_uyvx_to_i420(void *param)
+{
+	struct conversion_data *data = param;
+	compress_uyvx_to_i420(data->input, data->width, data->height,
+			data->width * 4, 0, data->height, data->planes);
+	return data->width * data->height * 4;
+}
+
+static size_t run_uyvx_to_nv12(void *param)
+{
+	struct conversion_data *data = param;
+	compress_uyvx_to_nv12(data->input, data->width, data->height,
+			data->width * 4, 0, data->height, data->planes);
+	return data->width * data->height * 4;
+}
+
+static size_t run_decompress_420(void *param)
+{
+	struct conversion_data *data = param;
+	decompress_420(data->input, data->width, data->height,
+			data->width * 4, 0, data->height, data->output);
+	return data->width * data->height * 3 / 2;
+}
+
+static size_t run_decompress_nv12(void *param)
+{
+	struct conversion_data *data = param;
+	decompress_nv12(data->input, data->width, data->height,
+			data->width * 4, 0, data->height, data->output);
+	return data->width * data->height * 3 / 2;
+}
+
+static size_t run_decompress_422(void *param)
+{
+	struct conversion_data *data = param;
+	decompress_422(data->input, data->width, data->height,
+			data->width * 4, 0, data->height, data->output, true);
+	return data->width * data->height * 2;
+}
+
+/* ------------------------------------------------------------------------- */
+/* circlebuf */
+
+struct circlebuf_data {
+	struct circlebuf buf;
+	size_t           chunk_size;
+	uint8_t          *chunk;
+};
+
+static void *circlebuf_create_mode(int chunk_size, bool pow2)
+{
+	struct circlebuf_data *data = bmalloc(sizeof(struct circlebuf_data));
+
+	data->chunk_size = (size_t)chunk_size;
+	data->chunk      = bmalloc(data->chunk_size);
+	fill_random(data->chunk, data->chunk_size);
+
+	if (pow2)
+		circlebuf_init_pow2(&data->buf);
+	else
+		circlebuf_init(&data->buf);
+
+	/* keep some data buffered so that pushes/pops wrap around */
+	circlebuf_push_back(&data->buf, data->chunk, data->chunk_size);
+	circlebuf_push_back(&data->buf, data->chunk, data->chunk_size / 2);
+	return data;
+}
+
+static void *circlebuf_create(int chunk_size)
+{
+	return circlebuf_create_mode(chunk_size, false);
+}
+
+static void *circlebuf_pow2_create(int chunk_size)
+{
+	return circlebuf_create_mode(chunk_size, true);
+}
+
+static void circlebuf_destroy(void *param)
+{
+	struct circlebuf_data *data = param;
+
+	circlebuf_free(&data->buf);
+	bfree(data->chunk);
+	bfree(data);
+}
+
+static size_t run_circlebuf(void *param)
+{
+	struct circlebuf_data *data = param;
+
+	circlebuf_push_back(&data->buf, data->chunk, data->chunk_size);
+	circlebuf_pop_front(&data->buf, data->chunk, data->chunk_size);
+	return data->chunk_size * 2;
+}
+
+/* writes and reads the ring memory in place */
+static size_t run_circlebuf_in_place(void *param)
+{
+	struct circlebuf_data *data = param;
+	void   *data1, *data2;
+	size_t size1, size2;
+
+	circlebuf_reserve_back(&data->buf, data->chunk_size,
+			&data1, &size1, &data2, &size2);
+	memset(data1, 0x55, size1);
+	if (size2)
+		memset(data2, 0x55, size2);
+	circlebuf_commit_back(&data->buf, data->chunk_size);
+
+	circlebuf_peek_front(&data->buf, data->chunk_size,
+			&data1, &size1, &data2, &size2);
+	data->chunk[0] ^= *(uint8_t*)data1;
+	circlebuf_pop_front(&data->buf, NULL, data->chunk_size);
+	return data->chunk_size * 2;
+}
+
+/* ------------------------------------------------------------------------- */
+/* spsc circlebuf */
+
+#define SPSC_CAPACITY (64 * 1024)
+
+/* each iteration pushes one chunk while a reader thread pops them */
+struct spsc_data {
+	struct spsc_circlebuf buf;
+	size_t                chunk_size;
+	uint8_t               *chunk;
+	uint8_t               *read_chunk;
+	volatile long         stop;
+	pthread_t             reader;
+};
+
+static void *spsc_reader_thread(void *param)
+{
+	struct spsc_data *data = param;
+
+	while (!os_atomic_load_long(&data->stop)) {
+		if (!spsc_circlebuf_pop_front(&data->buf, data->read_chunk,
+					data->chunk_size))
+			os_sleep_ms(0);
+	}
+
+	return NULL;
+}
+
+static void *spsc_create(int chunk_size)
+{
+	struct spsc_data *data = bmalloc(sizeof(struct spsc_data));
+
+	memset(data, 0, sizeof(struct spsc_data));
+	data->chunk_size = (size_t)chunk_size;
+	data->chunk      = bmalloc(data->chunk_size);
+	data->read_chunk = bmalloc(data->chunk_size);
+	fill_random(data->chunk, data->chunk_size);
+
+	spsc_circlebuf_init(&data->buf, SPSC_CAPACITY);
+
+	if (pthread_create(&data->reader, NULL, spsc_reader_thread,
+				data) != 0) {
+		spsc_circlebuf_free(&data->buf);
+		bfree(data->chunk);
+		bfree(data->read_chunk);
+		bfree(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+static void spsc_destroy(void *param)
+{
+	struct spsc_data *data = param;
+
+	os_atomic_set_long(&data->stop, 1);
+	pthread_join(data->reader, NULL);
+
+	spsc_circlebuf_free(&data->buf);
+	bfree(data->chunk);
+	bfree(data->read_chunk);
+	bfree(data);
+}
+
+static size_t run_spsc_threaded(void *param)
+{
+	struct spsc_data *data = param;
+
+	while (!spsc_circlebuf_push_back(&data->buf, data->chunk,
+				data->chunk_size))
+		os_sleep_ms(0);
+
+	return data->chunk_size;
+}
+
+/* ------------------------------------------------------------------------- */
+/* audio resampler */
+
+#define RESAMPLE_FRAMES 1024
+
+struct resampler_data {
+	audio_resampler_t resampler;
+	float             input[RESAMPLE_FRAMES * 2];
+};
+
+static void *resampler_create(int output_rate)
+{
+	struct resampler_data *data = bmalloc(sizeof(struct resampler_data));
+	struct resample_info src = {48000, AUDIO_FORMAT_FLOAT, SPEAKERS_STEREO};
+	struct resample_info dst = {(uint32_t)output_rate, AUDIO_FORMAT_16BIT,
+		SPEAKERS_STEREO};
+	size_t i;
+
+	data->resampler = audio_resampler_create(&dst, &src);
+	if (!data->resampler) {
+		bfree(data);
+		return NULL;
+	}
+
+	for (i = 0; i < RESAMPLE_FRAMES * 2; i++)
+		data->input[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+
+	return data;
+}
+
+static void resampler_destroy(void *param)
+{
+	struct resampler_data *data = param;
+
+	audio_resampler_destroy(data->resampler);
+	bfree(data);
+}
+
+static size_t run_resampler(void *param)
+{
+	struct resampler_data *data = param;
+	const uint8_t *input[MAX_AUDIO_CHANNELS] = {(uint8_t*)data->input};
+	uint8_t  *output[MAX_AUDIO_CHANNELS];
+	uint32_t frames;
+	uint64_t offset;
+
+	audio_resampler_resample(data->resampler, output, &frames,
+			input, RESAMPLE_FRAMES, &offset);
+	return sizeof(data->input);
+}
+
+/* ------------------------------------------------------------------------- */
+/* darray */
+
+#define DARRAY_ITEMS 65536
+
+static void *darray_create(int unused)
+{
+	struct darray *array = bmalloc(sizeof(struct darray));
+	darray_init(array);
+	return array;
+}
+
+static void darray_destroy(void *param)
+{
+	darray_free(param);
+	bfree(param);
+}
+
+/* grows an array from empty, one item at a time */
+static size_t run_darray_push_back(void *param)
+{
+	DARRAY(uint32_t) array;
+	uint32_t i;
+
+	da_init(array);
+	for (i = 0; i < DARRAY_ITEMS; i++)
+		da_push_back(array, &i);
+	da_free(array);
+
+	return DARRAY_ITEMS * sizeof(uint32_t);
+}
+
+/* resizes a reused array and appends chunks of items to it */
+static size_t run_darray_push_back_array(void *param)
+{
+	struct darray *array = param;
+	uint32_t items[256];
+	size_t i;
+
+	memset(items, 0, sizeof(items));
+
+	darray_resize(sizeof(uint32_t), array, 0);
+	for (i = 0; i < DARRAY_ITEMS / 256; i++)
+		darray_push_back_array(sizeof(uint32_t), array, items, 256);
+
+	return DARRAY_ITEMS * sizeof(uint32_t);
+}
+
+/* ------------------------------------------------------------------------- */
+/* obs_data */
+
+#define DATA_KEYS 32
+
+struct obs_data_bench {
+	obs_data_t data;
+	char       names[DATA_KEYS][16];
+};
+
+static void *obs_data_bench_create(int unused)
+{
+	struct obs_data_bench *bench = bmalloc(sizeof(struct obs_data_bench));
+	int i;
+
+	bench->data = obs_data_create();
+	for (i = 0; i < DATA_KEYS; i++) {
+		sprintf(bench->names[i], "setting_%d", i);
+		obs_data_setint(bench->data, bench->names[i], i);
+	}
+
+	return bench;
+}
+
+static void obs_data_bench_destroy(void *param)
+{
+	struct obs_data_bench *bench = param;
+
+	obs_data_release(bench->data);
+	bfree(bench);
+}
+
+static size_t run_obs_data_setint(void *param)
+{
+	struct obs_data_bench *bench = param;
+	int i;
+
+	for (i = 0; i < DATA_KEYS; i++)
+		obs_data_setint(bench->data, bench->names[i], i * 2);
+	return 0;
+}
+
+static size_t run_obs_data_getint(void *param)
+{
+	struct obs_data_bench *bench = param;
+	long long total = 0;
+	int i;
+
+	for (i = 0; i < DATA_KEYS; i++)
+		total += obs_data_getint(bench->data, bench->names[i]);
+	return total < 0 ? 1 : 0;
+}
+
+static size_t run_obs_data_setstring(void *param)
+{
+	struct obs_data_bench *bench = param;
+	int i;
+
+	for (i = 0; i < DATA_KEYS; i++)
+		obs_data_setstring(bench->data, bench->names[i],
+				bench->names[DATA_KEYS - i - 1]);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* calldata */
+
+static void *calldata_bench_create(int unused)
+{
+	struct calldata *data = bmalloc(sizeof(struct calldata));
+	calldata_init(data);
+	return data;
+}
+
+static void calldata_bench_destroy(void *param)
+{
+	calldata_free(param);
+	bfree(param);
+}
+
+/* marshals a typical signal's parameters in and back out */
+static size_t run_calldata(void *param)
+{
+	struct calldata *data = param;
+	const char *str;
+	void       *ptr;
+	int        val;
+	double     dval;
+
+	calldata_clear(data);
+	calldata_setptr(data, "source", data);
+	calldata_setint(data, "value", 5);
+	calldata_setdouble(data, "volume", 0.5);
+	calldata_setstring(data, "name", "benchmark");
+
+	calldata_getptr(data, "source", &ptr);
+	calldata_getint(data, "value", &val);
+	calldata_getdouble(data, "volume", &dval);
+	calldata_getstring(data, "name", &str);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* small object allocation (param selects the slab allocator) */
+
+#define SCENE_SOURCES  64
+#define SIGNAL_SLOTS   8
+
+struct scene_load_data {
+	char names[SCENE_SOURCES][32];
+	char files[SCENE_SOURCES][32];
+};
+
+static void *scene_load_create(int slab)
+{
+	struct scene_load_data *data = bmalloc(sizeof(struct scene_load_data));
+	int i;
+
+	bmem_set_slab_allocator(slab != 0);
+
+	for (i = 0; i < SCENE_SOURCES; i++) {
+		sprintf(data->names[i], "source %d", i);
+		sprintf(data->files[i], "/images/%d.png", i);
+	}
+
+	return data;
+}
+
+static void scene_load_destroy(void *param)
+{
+	bmem_set_slab_allocator(false);
+	bfree(param);
+}
+
+/* builds and frees the settings of a scene's worth of sources, the way
+ * they're created when a scene is loaded */
+static size_t run_scene_load(void *param)
+{
+	struct scene_load_data *data = param;
+	obs_data_array_t sources = obs_data_array_create();
+	int i;
+
+	for (i = 0; i < SCENE_SOURCES; i++) {
+		obs_data_t source   = obs_data_create();
+		obs_data_t settings = obs_data_create();
+
+		obs_data_setstring(settings, "file", data->files[i]);
+		obs_data_setint(settings, "x", i * 10);
+		obs_data_setint(settings, "y", i * 20);
+		obs_data_setdouble(settings, "cx", 1920.0);
+		obs_data_setdouble(settings, "cy", 1080.0);
+		obs_data_setbool(settings, "visible", true);
+
+		obs_data_setstring(source, "name", data->names[i]);
+		obs_data_setstring(source, "id", "image_source");
+		obs_data_setobj(source, "settings", settings);
+
+		obs_data_array_push_back(sources, source);
+		obs_data_release(settings);
+		obs_data_release(source);
+	}
+
+	obs_data_array_release(sources);
+	return 0;
+}
+
+static void signal_bench_callback(void *param, calldata_t data)
+{
+	void *ptr;
+	calldata_getptr(data, "source", &ptr);
+	*(long*)param += ptr != NULL;
+}
+
+struct signal_bench {
+	signal_handler_t handler;
+	long             count;
+};
+
+static void *signal_bench_create(int slab)
+{
+	struct signal_bench *data = bmalloc(sizeof(struct signal_bench));
+	int i;
+
+	bmem_set_slab_allocator(slab != 0);
+
+	data->handler = signal_handler_create();
+	data->count   = 0;
+	for (i = 0; i < SIGNAL_SLOTS; i++)
+		signal_handler_connect(data->handler, "source_activate",
+				signal_bench_callback, &data->count);
+	return data;
+}
+
+static void signal_bench_destroy(void *param)
+{
+	struct signal_bench *data = param;
+
+	bmem_set_slab_allocator(false);
+	signal_handler_destroy(data->handler);
+	bfree(data);
+}
+
+/* a signal with its own calldata, the way sources emit them */
+static size_t run_signal_dispatch(void *param)
+{
+	struct signal_bench *data = param;
+	struct calldata params;
+
+	calldata_init(&params);
+	calldata_setptr(&params, "source", data);
+	calldata_setstring(&params, "name", "benchmark");
+	signal_handler_signal(data->handler, "source_activate", &params);
+	calldata_free(&params);
+	return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#define CONVERSION_SIZE_CASES(path, path_name, size, size_name) \
+	{"convert/uyvx_to_i420/" size_name "/" path_name, \
+		CONVERSION_PARAM(path, size), \
+		conversion_create, conversion_destroy, run_uyvx_to_i420}, \
+	{"convert/uyvx_to_nv12/" size_name "/" path_name, \
+		CONVERSION_PARAM(path, size), \
+		conversion_create, conversion_destroy, run_uyvx_to_nv12}, \
+	{"convert/decompress_420/" size_name "/" path_name, \
+		CONVERSION_PARAM(path, size), \
+		conversion_create, conversion_destroy, run_decompress_420}, \
+	{"convert/decompress_nv12/" size_name "/" path_name, \
+		CONVERSION_PARAM(path, size), \
+		conversion_create, conversion_destroy, run_decompress_nv12}, \
+	{"convert/decompress_422/" size_name "/" path_name, \
+		CONVERSION_PARAM(path, size), \
+		conversion_create, conversion_destroy, run_decompress_422}
+
+#define CONVERSION_CASES(path, path_name) \
+	CONVERSION_SIZE_CASES(path, path_name, CONVERSION_720P,  "720p"), \
+	CONVERSION_SIZE_CASES(path, path_name, CONVERSION_1080P, "1080p"), \
+	CONVERSION_SIZE_CASES(path, path_name, CONVERSION_2160P, "2160p")
+
+static const struct bench_case bench_cases[] = {
+	CONVERSION_CASES(FORMAT_CONVERSION_SCALAR, "scalar"),
+	CONVERSION_CASES(FORMAT_CONVERSION_SSE2,   "sse2"),
+	CONVERSION_CASES(FORMAT_CONVERSION_SSSE3,  "ssse3"),
+	CONVERSION_CASES(FORMAT_CONVERSION_AVX2,   "avx2"),
+
+	{"circlebuf/push_pop/64", 64,
+		circlebuf_create, circlebuf_destroy, run_circlebuf},
+	{"circlebuf/push_pop/4096", 4096,
+		circlebuf_create, circlebuf_destroy, run_circlebuf},
+	{"circlebuf/push_pop_pow2/64", 64,
+		circlebuf_pow2_create, circlebuf_destroy, run_circlebuf},
+	{"circlebuf/push_pop_pow2/4096", 4096,
+		circlebuf_pow2_create, circlebuf_destroy, run_circlebuf},
+	{"circlebuf/in_place/4096", 4096,
+		circlebuf_create, circlebuf_destroy, run_circlebuf_in_place},
+	{"spsc_circlebuf/threaded/64", 64,
+		spsc_create, spsc_destroy, run_spsc_threaded},
+	{"spsc_circlebuf/threaded/4096", 4096,
+		spsc_create, spsc_destroy, run_spsc_threaded},
+
+	{"audio_resampler/float_48000_to_16bit_44100", 44100,
+		resampler_create, resampler_destroy, run_resampler},
+	{"audio_resampler/float_48000_to_16bit_48000", 48000,
+		resampler_create, resampler_destroy, run_resampler},
+
+	{"darray/push_back", 0,
+		darray_create, darray_destroy, run_darray_push_back},
+	{"darray/push_back_array", 0,
+		darray_create, darray_destroy, run_darray_push_back_array},
+
+	{"obs_data/setint", 0,
+		obs_data_bench_create, obs_data_bench_destroy,
+		run_obs_data_setint},
+	{"obs_data/getint", 0,
+		obs_data_bench_create, obs_data_bench_destroy,
+		run_obs_data_getint},
+	{"obs_data/setstring", 0,
+		obs_data_bench_create, obs_data_bench_destroy,
+		run_obs_data_setstring},
+
+	{"calldata/marshal", 0,
+		calldata_bench_create, calldata_bench_destroy, run_calldata},
+
+	{"alloc/scene_load/malloc", 0,
+		scene_load_create, scene_load_destroy, run_scene_load},
+	{"alloc/scene_load/slab", 1,
+		scene_load_create, scene_load_destroy, run_scene_load},
+	{"alloc/signal_dispatch/malloc", 0,
+		signal_bench_create, signal_bench_destroy, run_signal_dispatch},
+	{"alloc/signal_dispatch/slab", 1,
+		signal_bench_create, signal_bench_destroy, run_signal_dispatch}
+};
+
+#define NUM_CASES (sizeof(bench_cases) / sizeof(bench_cases[0]))
+
+static bool run_case(const struct bench_case *bc, uint64_t min_ns,
+		struct bench_result *result)
+{
+	void     *data = bc->create(bc->param);
+	uint64_t iterations = 1;
+
+	if (!data)
+		return false;
+
+	/* warm up */
+	bc->run(data);
+
+	for (;;) {
+		uint64_t start = os_gettime_ns();
+		uint64_t bytes = 0;
+		uint64_t i;
+
+		for (i = 0; i < iterations; i++)
+			bytes += bc->run(data);
+
+		result->total_ns = os_gettime_ns() - start;
+		result->bytes    = bytes;
+
+		if (result->total_ns >= min_ns)
+			break;
+
+		iterations *= 2;
+	}
+
+	result->name       = bc->name;
+	result->iterations = iterations;
+
+	bc->destroy(data);
+	return true;
+}
+
+static inline double ns_per_op(const struct bench_result *result)
+{
+	return (double)result->total_ns / (double)result->iterations;
+}
+
+static inline double mb_per_sec(const struct bench_result *result)
+{
+	if (!result->total_ns)
+		return 0.0;
+	return (double)result->bytes / 1048576.0 /
+		((double)result->total_ns / 1000000000.0);
+}
+
+static void output_header(FILE *file, enum output_format format)
+{
+	if (format == OUTPUT_CSV) {
+		fprintf(file, "name,iterations,total_ns,ns_per_op,mb_per_sec\n");
+
+	} else if (format == OUTPUT_JSON) {
+		enum format_conversion_path path = format_conversion_best_path();
+
+		fprintf(file, "{\n");
+		fprintf(file, "\t\"logical_cores\": %d,\n",
+				os_get_logical_cores());
+		fprintf(file, "\t\"conversion_path\": \"%s\",\n",
+				format_conversion_path_name(path));
+		fprintf(file, "\t\"benchmarks\": [");
+
+	} else {
+		fprintf(file, "%-48s %12s %14s %12s\n",
+				"name", "iterations", "ns/op", "MB/s");
+	}
+}
+
+static void output_result(FILE *file, enum output_format format,
+		const struct bench_result *result, bool first)
+{
+	if (format == OUTPUT_CSV) {
+		fprintf(file, "%s,%llu,%llu,%.2f,%.2f\n", result->name,
+				(unsigned long long)result->iterations,
+				(unsigned long long)result->total_ns,
+				ns_per_op(result), mb_per_sec(result));
+
+	} else if (format == OUTPUT_JSON) {
+		fprintf(file, "%s\n\t\t{\"name\": \"%s\", \"iterations\": %llu, "
+				"\"total_ns\": %llu, \"ns_per_op\": %.2f, "
+				"\"mb_per_sec\": %.2f}",
+				first ? "" : ",", result->name,
+				(unsigned long long)result->iterations,
+				(unsigned long long)result->total_ns,
+				ns_per_op(result), mb_per_sec(result));
+
+	} else {
+		fprintf(file, "%-48s %12llu %14.1f %12.1f\n", result->name,
+				(unsigned long long)result->iterations,
+				ns_per_op(result), mb_per_sec(result));
+	}
+}
+
+static void output_footer(FILE *file, enum output_format format)
+{
+	if (format == OUTPUT_JSON)
+		fprintf(file, "\n\t]\n}\n");
+}
+
+static void print_usage(void)
+{
+	fprintf(stderr, "usage: libobs-bench [-f text|csv|json] [-o file] "
+	                "[-t min_ms] [filter]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	enum output_format format = OUTPUT_TEXT;
+	const char *output_path   = NULL;
+	const char *filter        = NULL;
+	uint64_t   min_ns         = 200000000ULL;
+	FILE       *file          = stdout;
+	bool       first          = true;
+	size_t     i;
+	int        arg;
+
+	base_set_log_handler(bench_log);
+
+	for (arg = 1; arg < argc; arg++) {
+		const char *val = (arg + 1 < argc) ? argv[arg + 1] : NULL;
+
+		if (strcmp(argv[arg], "-f") == 0 && val) {
+			if (strcmp(val, "csv") == 0)
+				format = OUTPUT_CSV;
+			else if (strcmp(val, "json") == 0)
+				format = OUTPUT_JSON;
+			else if (strcmp(val, "text") == 0)
+				format = OUTPUT_TEXT;
+			else {
+				print_usage();
+				return 1;
+			}
+			arg++;
+
+		} else if (strcmp(argv[arg], "-o") == 0 && val) {
+			output_path = val;
+			arg++;
+
+		} else if (strcmp(argv[arg], "-t") == 0 && val) {
+			min_ns = strtoull(val, NULL, 10) * 1000000ULL;
+			arg++;
+
+		} else if (argv[arg][0] != '-' && !filter) {
+			filter = argv[arg];
+
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (output_path) {
+		file = fopen(output_path, "w");
+		if (!file) {
+			fprintf(stderr, "Could not open '%s'\n", output_path);
+			return 1;
+		}
+	}
+
+	srand(0);
+	output_header(file, format);
+
+	for (i = 0; i < NUM_CASES; i++) {
+		const struct bench_case *bc = bench_cases + i;
+		struct bench_result result;
+
+		if (filter && !strstr(bc->name, filter))
+			continue;
+
+		if (!run_case(bc, min_ns, &result)) {
+			fprintf(stderr, "%s: not supported, skipped\n",
+					bc->name);
+			continue;
+		}
+
+		output_result(file, format, &result, first);
+		fflush(file);
+		first = false;
+	}
+
+	output_footer(file, format);
+
+	if (file != stdout)
+		fclose(file);
+
+	if (bnum_allocs())
+		fprintf(stderr, "Number of memory leaks: %llu\n",
+				(unsigned long long)bnum_allocs());
+
+	return 0;
+}
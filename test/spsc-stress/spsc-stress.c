@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/spsc-circlebuf.h>
+#include <util/threading.h>
+
+/*
+ * Producer/consumer stress test for spsc_circlebuf.
+ *
+ *   spsc-stress [iterations]
+ *
+ * For each configuration a writer thread pushes a byte stream in randomly
+ * sized pieces while the main thread reads it back in differently sized
+ * pieces.  Every byte is derived from its position in the stream, so any
+ * gap, reordering or corruption shows up as a mismatch.  Both the copying
+ * (push_back/pop_front) and in-place (reserve_back/peek_front) paths are
+ * used, and the small capacities make every piece likely to wrap.
+ *
+ * Returns 0 if every configuration passes.
+ */
+
+#define DEFAULT_ITERATIONS 2000000
+
+struct stress_config {
+	size_t capacity;
+	size_t max_write;
+	size_t max_read;
+};
+
+static const struct stress_config configs[] = {
+	{4,    1,    1},
+	{8,    3,    5},
+	{16,   7,    16},
+	{64,   64,   13},
+	{256,  100,  255},
+	{4096, 1000, 4096}
+};
+
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+struct stress_data {
+	struct spsc_circlebuf      buf;
+	const struct stress_config *config;
+	uint64_t                   iterations;
+	uint64_t                   total;
+	volatile long              done;
+	volatile long              stop;
+	pthread_t                  writer;
+};
+
+static inline uint32_t next_random(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static inline size_t random_size(uint32_t *state, size_t max_size)
+{
+	return 1 + next_random(state) % max_size;
+}
+
+/* value of the byte at a position in the stream */
+static inline uint8_t stream_byte(uint64_t pos)
+{
+	pos ^= pos >> 33;
+	pos *= 0xff51afd7ed558ccdULL;
+	pos ^= pos >> 33;
+	return (uint8_t)pos;
+}
+
+static void fill_stream(uint8_t *data, size_t size, uint64_t pos)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = stream_byte(pos + i);
+}
+
+/* returns the offset of the first bad byte, or 'size' if all are good */
+static size_t check_stream(const uint8_t *data, size_t size, uint64_t pos)
+{
+	for (size_t i = 0; i < size; i++)
+		if (data[i] != stream_byte(pos + i))
+			return i;
+	return size;
+}
+
+/* writes one piece, waiting for space.  returns false if the reader
+ * stopped */
+static bool write_piece(struct stress_data *data, uint8_t *piece,
+		size_t size, uint64_t pos, bool in_place)
+{
+	void   *data1, *data2;
+	size_t size1, size2;
+
+	if (!in_place) {
+		fill_stream(piece, size, pos);
+		while (!spsc_circlebuf_push_back(&data->buf, piece, size)) {
+			if (os_atomic_load_long(&data->stop))
+				return false;
+			sched_yield();
+		}
+		return true;
+	}
+
+	while (!spsc_circlebuf_reserve_back(&data->buf, size, &data1, &size1,
+				&data2, &size2)) {
+		if (os_atomic_load_long(&data->stop))
+			return false;
+		sched_yield();
+	}
+
+	fill_stream(data1, size1, pos);
+	if (size2)
+		fill_stream(data2, size2, pos + size1);
+
+	spsc_circlebuf_commit_back(&data->buf, size);
+	return true;
+}
+
+static void *writer_thread(void *param)
+{
+	struct stress_data *data  = param;
+	uint8_t            *piece = bmalloc(data->config->max_write);
+	uint32_t           state  = 0x12345678;
+	uint64_t           pos    = 0;
+
+	for (uint64_t i = 0; i < data->iterations; i++) {
+		size_t size = random_size(&state, data->config->max_write);
+
+		if (!write_piece(data, piece, size, pos, (i & 1) != 0))
+			break;
+		pos += size;
+	}
+
+	data->total = pos;
+	os_atomic_set_long(&data->done, 1);
+
+	bfree(piece);
+	return NULL;
+}
+
+/* reads a piece that is known to be available, returns false on a
+ * mismatch */
+static bool read_piece(struct spsc_circlebuf *buf, uint8_t *piece,
+		size_t size, uint64_t pos, bool in_place)
+{
+	void   *data1, *data2;
+	size_t size1, size2;
+	size_t bad;
+
+	if (!in_place) {
+		if (!spsc_circlebuf_pop_front(buf, piece, size)) {
+			fprintf(stderr, "pop_front failed at stream "
+			                "position %llu\n",
+			                (unsigned long long)pos);
+			return false;
+		}
+
+		bad = check_stream(piece, size, pos);
+
+	} else {
+		if (!spsc_circlebuf_peek_front(buf, size, &data1, &size1,
+					&data2, &size2)) {
+			fprintf(stderr, "peek_front failed at stream "
+			                "position %llu\n",
+			                (unsigned long long)pos);
+			return false;
+		}
+
+		bad = check_stream(data1, size1, pos);
+		if (bad == size1 && size2)
+			bad = size1 + check_stream(data2, size2, pos + size1);
+
+		spsc_circlebuf_pop_front(buf, NULL, size);
+	}
+
+	if (bad != size) {
+		fprintf(stderr, "mismatch at stream position %llu\n",
+				(unsigned long long)(pos + bad));
+		return false;
+	}
+
+	return true;
+}
+
+static bool run_config(const struct stress_config *config,
+		uint64_t iterations)
+{
+	struct stress_data data;
+	uint8_t            *piece;
+	uint32_t           state   = 0x9abcdef0;
+	uint64_t           pos     = 0;
+	uint64_t           reads   = 0;
+	bool               success = true;
+
+	memset(&data, 0, sizeof(data));
+	data.config     = config;
+	data.iterations = iterations;
+	spsc_circlebuf_init(&data.buf, config->capacity);
+
+	if (pthread_create(&data.writer, NULL, writer_thread, &data) != 0) {
+		fprintf(stderr, "could not create writer thread\n");
+		spsc_circlebuf_free(&data.buf);
+		return false;
+	}
+
+	piece = bmalloc(config->max_read);
+
+	/* take what's there when less than the chosen size is available,
+	 * waiting for all of it could deadlock with a writer that is waiting
+	 * for space */
+	for (;;) {
+		size_t size      = random_size(&state, config->max_read);
+		bool   done      = os_atomic_load_long(&data.done) != 0;
+		size_t available = spsc_circlebuf_available(&data.buf);
+
+		if (!available) {
+			if (done)
+				break;
+
+			sched_yield();
+			continue;
+		}
+
+		if (available < size)
+			size = available;
+
+		if (!read_piece(&data.buf, piece, size, pos,
+					(reads++ & 1) != 0)) {
+			success = false;
+			break;
+		}
+
+		pos += size;
+	}
+
+	if (!success)
+		os_atomic_set_long(&data.stop, 1);
+
+	pthread_join(data.writer, NULL);
+
+	if (success && pos != data.total) {
+		fprintf(stderr, "read %llu bytes, expected %llu\n",
+				(unsigned long long)pos,
+				(unsigned long long)data.total);
+		success = false;
+	}
+
+	printf("capacity %-5u write <= %-5u read <= %-5u %llu bytes: %s\n",
+			(unsigned int)config->capacity,
+			(unsigned int)config->max_write,
+			(unsigned int)config->max_read,
+			(unsigned long long)pos, success ? "ok" : "FAILED");
+
+	bfree(piece);
+	spsc_circlebuf_free(&data.buf);
+	return success;
+}
+
+static void stress_log(enum log_type type, const char *msg, va_list args)
+{
+	if (type <= LOG_WARNING) {
+		vfprintf(stderr, msg, args);
+		fprintf(stderr, "\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t iterations = DEFAULT_ITERATIONS;
+	bool     success    = true;
+
+	base_set_log_handler(stress_log);
+
+	if (argc > 1)
+		iterations = strtoull(argv[1], NULL, 10);
+
+	for (size_t i = 0; i < NUM_CONFIGS; i++)
+		if (!run_config(configs + i, iterations))
+			success = false;
+
+	return success ? 0 : 1;
+}
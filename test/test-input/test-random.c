@@ -55,7 +55,7 @@ void random_destroy(struct random_tex *rt)
 
 uint32_t random_get_output_flags(struct random_tex *rt)
 {
-	return SOURCE_VIDEO | SOURCE_DEFAULT_EFFECT;
+	return SOURCE_VIDEO | SOURCE_DEFAULT_EFFECT | SOURCE_STATIC_VIDEO;
 }
 
 void random_video_render(struct random_tex *rt, obs_source_t filter_target)